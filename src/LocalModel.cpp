@@ -19,8 +19,14 @@
 #include "LocalModel.h"
 #include "XspecSpectrum.h"
 
+#include "Relcache.h"
+#include "Relthreads.h"
+
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
+#include <memory>
+#include <mutex>
 
 
 
@@ -64,7 +70,7 @@ void LocalModel::relxill_model(const XspecSpectrum &spectrum) {
     delete rel_param;
     delete xill_param;
   } else {
-    relxill_kernel(spectrum, m_model_params, &status);
+    relxill_kernel(spectrum, m_model_params, get_cache_context(), &status);
   }
 
   if (status != EXIT_SUCCESS) {
@@ -88,7 +94,7 @@ void LocalModel::conv_model(const XspecSpectrum &spectrum) {
   relParam *rel_param = LocalModel::get_rel_params();
 
   int status = EXIT_SUCCESS;
-  relconv_kernel(spectrum.energy, spectrum.flux, spectrum.num_flux_bins(), rel_param, &status);
+  relconv_kernel(spectrum.energy, spectrum.flux, spectrum.num_flux_bins(), rel_param, get_cache_context(), &status);
 
   if (status != EXIT_SUCCESS) {
     throw ModelEvalFailed("executing convolution failed");
@@ -139,15 +145,20 @@ void LocalModel::xillver_model(const XspecSpectrum &spectrum) {
  * @param xspec_flux[num_flux_bins]: - flux array (already allocated), used to return the calculated values
  *                    - for convolution models this is also the input flux
  * @param num_flux_bins
+ * @param instance_id: identifies the model component (for its own cache), Xspec gives the spectrum number
+ * @param component_handle: separates several components of the same model and instance (for their own
+ *                          cache, see new_model_cache_handle), Xspec does not give any
  */
 void xspec_C_wrapper_eval_model(ModelName model_name,
                                 const double *parameter_values,
                                 double *xspec_flux,
                                 int num_flux_bins,
-                                const double *xspec_energy) {
+                                const double *xspec_energy,
+                                int instance_id,
+                                int component_handle) {
 
   try {
-    LocalModel local_model{parameter_values, model_name};
+    LocalModel local_model{parameter_values, model_name, instance_id, component_handle};
 
     XspecSpectrum spectrum{xspec_energy, xspec_flux, static_cast<size_t>(num_flux_bins)};
     local_model.eval_model(spectrum);
@@ -158,3 +169,153 @@ void xspec_C_wrapper_eval_model(ModelName model_name,
     // TODO: what should we do if the evaluation fails? return zeros?
 
 }
+
+
+/** keys by which the parameter sets of a batch are grouped: the relat. parameters (of the relline profile)
+ *  and the xillver parameters (the relat. parameters of redo_xillver_calc are already part of the first) **/
+static CacheKey get_batch_rel_key(const LocalModel &local_model, const XspecSpectrum &spectrum) {
+  if (local_model.get_model_params().model_type() == T_Model::Xill) {
+    return {};
+  }
+  relParam *rel_param = local_model.get_rel_params();
+  CacheKey key = get_relbase_cache_key(rel_param, spectrum.energy, spectrum.num_flux_bins());
+  delete rel_param;
+  return key;
+}
+
+static CacheKey get_batch_xill_key(const LocalModel &local_model) {
+  T_Model model_type = local_model.get_model_params().model_type();
+  if (model_type != T_Model::Xill && model_type != T_Model::Relxill) {
+    return {};
+  }
+  xillParam *xill_param = local_model.get_xill_params();
+  CacheKey key = get_xill_param_cache_key(xill_param);
+  if (is_alpha_model(xill_param->model_type)) {
+    key.add(xill_param->refl_frac);
+  }
+  delete xill_param;
+  return key;
+}
+
+/** sort the parameter sets into groups with the same relat. parameters (in the order of their first
+ *  appearance), where the sets with the same xillver parameters are next to each other, such that the
+ *  relline profile and the xillver spectra can be re-used from the cache of the previous set
+ *  - groups larger than max_group_size are split, such that all threads get some work **/
+static std::vector<std::vector<int>> group_batch_param_sets(ModelName model_name, const double *parameter_values,
+                                                            int num_param_sets, size_t num_params,
+                                                            const XspecSpectrum &spectrum, size_t max_group_size) {
+
+  std::vector<std::vector<int>> rel_groups;
+  std::vector<std::vector<uint64_t>> xill_hashes;
+  std::unordered_map<CacheKey, size_t, CacheKeyHash> rel_group_index;
+
+  for (int iset = 0; iset < num_param_sets; iset++) {
+    LocalModel local_model{parameter_values + iset * num_params, model_name};
+
+    auto inserted = rel_group_index.emplace(get_batch_rel_key(local_model, spectrum), rel_groups.size());
+    if (inserted.second) {
+      rel_groups.emplace_back();
+      xill_hashes.emplace_back();
+    }
+    rel_groups[inserted.first->second].push_back(iset);
+    xill_hashes[inserted.first->second].push_back(get_batch_xill_key(local_model).hash());
+  }
+
+  std::vector<std::vector<int>> groups;
+  for (size_t igroup = 0; igroup < rel_groups.size(); igroup++) {
+    std::vector<size_t> order(rel_groups[igroup].size());
+    for (size_t ii = 0; ii < order.size(); ii++) {
+      order[ii] = ii;
+    }
+    const auto &hashes = xill_hashes[igroup];
+    std::stable_sort(order.begin(), order.end(), [&hashes](size_t ii, size_t jj) { return hashes[ii] < hashes[jj]; });
+
+    for (size_t ii = 0; ii < order.size(); ii++) {
+      if (ii % max_group_size == 0) {
+        groups.emplace_back();
+      }
+      groups.back().push_back(rel_groups[igroup][order[ii]]);
+    }
+  }
+  return groups;
+}
+
+/**
+ * Evaluate a model for many parameter sets at once (e.g., for all walkers of an MCMC ensemble)
+ * @param model_name: unique name of the model
+ * @param parameter_values[num_param_sets*num_params]: the parameter sets, one after the other
+ * @param num_param_sets
+ * @param xspec_flux[num_param_sets*num_flux_bins]: returns the spectrum of every parameter set (for
+ *                   convolution models this is also the input flux of every set)
+ * @param num_flux_bins
+ * @param xspec_energy[num_flux_bins+1]: input energy grid, identical for all sets
+ * @param num_threads: number of threads (0 to use get_num_threads)
+ * @return number of parameter sets which failed (their flux is set to zero), 0 if all succeeded
+ * @details
+ *  - the sets with the same relat. parameters are evaluated one after the other in the same thread,
+ *    sorted by their xillver parameters, such that the relline profile (and the xillver spectra) are
+ *    only calculated once (see group_batch_param_sets)
+ *  - every thread has its own RelxillContext, which is kept for the next call (such that its caches are
+ *    re-used, e.g., by the next step of an MCMC ensemble), the tables are shared
+ *  - no exception is thrown, as it is called from C
+ */
+int xspec_C_wrapper_eval_model_batch(ModelName model_name,
+                                     const double *parameter_values,
+                                     int num_param_sets,
+                                     double *xspec_flux,
+                                     int num_flux_bins,
+                                     const double *xspec_energy,
+                                     int num_threads) {
+
+  if (num_param_sets <= 0) {
+    return 0;
+  }
+  if (num_threads <= 0) {
+    num_threads = get_num_threads();
+  }
+  num_threads = std::max(1, std::min(num_threads, num_param_sets));
+
+  std::vector<std::vector<int>> groups;
+  size_t num_params;
+  try {
+    num_params = ModelDatabase::instance().param_list(model_name).num_params();
+    XspecSpectrum grid_spectrum{xspec_energy, xspec_flux, static_cast<size_t>(num_flux_bins)};
+    const size_t max_group_size = (num_param_sets + num_threads - 1) / num_threads;
+    groups = group_batch_param_sets(model_name, parameter_values, num_param_sets, num_params, grid_spectrum,
+                                    max_group_size);
+  } catch (std::exception &e) {
+    std::cout << e.what();
+    std::fill(xspec_flux, xspec_flux + ((size_t) num_param_sets) * num_flux_bins, 0.0);
+    return num_param_sets;
+  }
+
+  // the contexts of the threads are only used by one batch at a time
+  static std::mutex batch_contexts_mutex;
+  static auto batch_contexts = new std::vector<std::unique_ptr<RelxillContext>>;  // never freed, as the global one
+  std::lock_guard<std::mutex> lock(batch_contexts_mutex);
+  while (batch_contexts->size() < static_cast<size_t>(num_threads)) {
+    batch_contexts->emplace_back(new RelxillContext);
+  }
+
+  std::vector<int> status_set(num_param_sets, EXIT_SUCCESS);
+  parallel_for(static_cast<int>(groups.size()), num_threads, [&](int igroup, int ithread) {
+    for (int iset: groups[igroup]) {
+      double *flux_set = xspec_flux + ((size_t) iset) * num_flux_bins;
+      try {
+        LocalModel local_model{parameter_values + iset * num_params, model_name};
+        XspecSpectrum spectrum{xspec_energy, flux_set, static_cast<size_t>(num_flux_bins)};
+        local_model.eval_model(spectrum, (*batch_contexts)[ithread].get());
+      } catch (std::exception &e) {
+        status_set[iset] = EXIT_FAILURE;
+        std::fill(flux_set, flux_set + num_flux_bins, 0.0);
+      }
+    }
+  });
+
+  int num_failed = static_cast<int>(std::count(status_set.begin(), status_set.end(), EXIT_FAILURE));
+  if (num_failed > 0) {
+    std::cout << " *** error: evaluation of " << num_failed << " of " << num_param_sets
+              << " parameter sets failed" << std::endl;
+  }
+  return num_failed;
+}
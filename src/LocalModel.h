@@ -32,6 +32,7 @@ extern "C" {
 
 #include "Relreturn_BlackBody.h"
 #include "Relxill.h"
+#include "Relcontext.h"
 #include "ModelDatabase.h"
 #include "ModelParams.h"
 
@@ -77,15 +78,20 @@ class LocalModel {
       m_model_params{ ModelParams(par, model_name, ModelDatabase::instance().model_info(model_name)) }
           {  };
 
-    LocalModel(const double* inp_param, ModelName model_name)
+    LocalModel(const double* inp_param, ModelName model_name, int instance_id = 0, int component_handle = 0)
         : LocalModel(ModelDatabase::instance().param_list(model_name), model_name )
     {
       set_input_params(inp_param);
+      m_instance_id = instance_id;
+      m_component_handle = component_handle;
     };
 
-    explicit LocalModel(ModelName model_name) :
+    explicit LocalModel(ModelName model_name, int instance_id = 0, int component_handle = 0) :
         LocalModel(ModelDatabase::instance().param_list(model_name), model_name)
-    {  };
+    {
+      m_instance_id = instance_id;
+      m_component_handle = component_handle;
+    };
 
     /** set the value of a single parameter
      * @param XPar param
@@ -103,9 +109,13 @@ class LocalModel {
      * Evaluate the LocalModel (in the Rest Frame of the Source)
      * (applies the redshift to the energy grid)
      * @param spectrum
+     * @param context: caches used for the evaluation (default: the current context of the thread), such
+     *   that models can be evaluated in several threads at the same time, each with its own context
      * @output spectrum.flux
      */
-    void eval_model(XspecSpectrum &spectrum) {
+    void eval_model(XspecSpectrum &spectrum, RelxillContext *context = nullptr) {
+
+      RelxillContextGuard context_guard((context != nullptr) ? context : RelxillContext::current());
 
       spectrum.shift_energy_grid_redshift(m_model_params.get_otherwise_default(XPar::z,0));
 
@@ -138,8 +148,16 @@ class LocalModel {
     return m_model_params;
   }
 
+  /** cache context of this model component in the current RelxillContext (shared by all LocalModels of the
+   *  same model, instance and component handle) **/
+  ModelCacheContext *get_cache_context() const {
+    return get_model_cache_context(m_model_params.get_model_name(), m_instance_id, m_component_handle);
+  }
+
  private:
   ModelParams m_model_params;
+  int m_instance_id = 0;  // identifies the model component, if the same model is used several times
+  int m_component_handle = 0;  // separates components of the same model and instance (see new_model_cache_handle)
 
   void line_model(const XspecSpectrum &spectrum);
   void relxill_model(const XspecSpectrum &spectrum);
@@ -159,7 +177,17 @@ void xspec_C_wrapper_eval_model(ModelName model_name,
                                 const double *parameter_values,
                                 double *xspec_flux,
                                 int num_flux_bins,
-                                const double *xspec_energy);
+                                const double *xspec_energy,
+                                int instance_id = 0,
+                                int component_handle = 0);
+
+int xspec_C_wrapper_eval_model_batch(ModelName model_name,
+                                     const double *parameter_values,
+                                     int num_param_sets,
+                                     double *xspec_flux,
+                                     int num_flux_bins,
+                                     const double *xspec_energy,
+                                     int num_threads = 0);
 
 
 
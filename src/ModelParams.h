@@ -162,7 +162,7 @@ class ParamList {
     }
   }
 
-  auto get_parnames(){
+  auto get_parnames() const {
     return m_parnames;
   }
 
@@ -18,23 +18,74 @@
 #include "Relbase.h"
 #include "Xillspec.h"
 #include "Relphysics.h"
+#include "Relfftw.h"
+#include "Relcontext.h"
+#include "Relthreads.h"
+#include "Xillprefetch.h"
+
+#include <algorithm>
+#include <atomic>
 
 extern "C" {
 #include <fftw3.h>   // assumes installation in heasoft
 #include "writeOutfiles.h"
 }
 
-// new CACHE routines
-cnode *cache_relbase = nullptr;
+// the caches (relline profiles, spectra and transforms) are stored in the RelxillContext
+double *global_ener_std = nullptr;
 
 
-int save_1eV_pos = 0;
+/** allocate "n" arrays of length "len" in one contiguous block (arr[ii] = arr[0] + ii*len) **/
+template<typename T>
+static T **new_contiguous_fftw_arrays(int n, int len, T *(*fftw_alloc)(size_t), int *status) {
+  auto arr = new T *[n];
+  arr[0] = fftw_alloc(((size_t) n) * len);
+  CHECK_MALLOC_RET_STATUS(arr[0], status, arr)
+  for (int ii = 1; ii < n; ii++) {
+    arr[ii] = arr[0] + ((size_t) ii) * len;
+  }
+  return arr;
+}
 
+template<typename T>
+static void free_contiguous_fftw_arrays(T **arr) {
+  if (arr != nullptr) {
+    fftw_free(arr[0]);
+    delete[] arr;
+  }
+}
 
-double *global_ener_std = nullptr;
+/** allocate all arrays of the cache, which depend on the number of energy bins of the convolution **/
+static void new_specCache_fftw_arrays(specCache *spec, int n_ener, int *status) {
 
-specCache *global_spec_cache = nullptr;
+  spec->n_ener = n_ener;
+  const int n_freq = spec->n_ener / 2 + 1;
+  const int n_cache = spec->n_cache;
+
+  spec->fft_xill = new_contiguous_fftw_arrays(n_cache, spec->n_ener, fftw_alloc_real, status);
+  spec->fft_rel = new_contiguous_fftw_arrays(n_cache, spec->n_ener, fftw_alloc_real, status);
+
+  spec->fftw_xill = new_contiguous_fftw_arrays(n_cache, n_freq, fftw_alloc_complex, status);
+  spec->fftw_rel = new_contiguous_fftw_arrays(n_cache, n_freq, fftw_alloc_complex, status);
+
+  spec->fftw_backwards_input = fftw_alloc_complex(((size_t) n_cache) * n_freq);
+  spec->fftw_output = fftw_alloc_real(((size_t) n_cache) * spec->n_ener);
+  CHECK_MALLOC_VOID_STATUS(spec->fftw_backwards_input, status)
+  CHECK_MALLOC_VOID_STATUS(spec->fftw_output, status)
+
+  // plan is owned by the plan cache (see Relfftw.h) and must be executed with fftw_execute_dft_c2r
+  spec->plan_c2r = get_fftw_plan_c2r(spec->n_ener, spec->fftw_backwards_input, spec->fftw_output, status);
+}
 
+static void free_specCache_fftw_arrays(specCache *spec) {
+  free_contiguous_fftw_arrays(spec->fft_xill);
+  free_contiguous_fftw_arrays(spec->fft_rel);
+  free_contiguous_fftw_arrays(spec->fftw_xill);
+  free_contiguous_fftw_arrays(spec->fftw_rel);
+
+  fftw_free(spec->fftw_backwards_input);
+  fftw_free(spec->fftw_output);
+}
 
 specCache *new_specCache(int n_cache, int *status) {
 
@@ -42,39 +93,25 @@ specCache *new_specCache(int n_cache, int *status) {
 
   spec->n_cache = n_cache;
   spec->nzones = 0;
-  spec->n_ener = N_ENER_CONV;
 
+  // the energy grid is set with the first convolution (see init_fftw_conv_energy_grid)
+  spec->ener = nullptr;
+  spec->ind_1keV = 0;
   spec->conversion_factor_energyflux = nullptr;
+  spec->fftw_norm_band_weights = nullptr;
+  spec->fft_rel_valid = 0;
+  spec->n_rel_transforms = 0;
+  spec->float_cache = nullptr;
 
-  spec->fft_xill = new double**[n_cache];
-  spec->fft_rel = new double**[n_cache];
-
-  spec->fftw_xill = new fftw_complex*[n_cache];
-  spec->fftw_rel = new fftw_complex*[n_cache];
-
-  spec->fftw_backwards_input = fftw_alloc_complex(spec->n_ener);
-  spec->fftw_output = new double[spec->n_ener];
-
-  spec->plan_c2r = fftw_plan_dft_c2r_1d(spec->n_ener, spec->fftw_backwards_input, spec->fftw_output,FFTW_ESTIMATE);
+  new_specCache_fftw_arrays(spec, N_ENER_CONV, status);
 
   spec->xill_spec = new xillSpec*[n_cache];
-
-  int ii;
-  int jj;
-  int m = 2;
-  for (ii = 0; ii < n_cache; ii++) {
-    spec->fft_xill[ii] = new double*[m];
-    spec->fft_rel[ii] = new double*[m];
-
-    spec->fftw_xill[ii] = fftw_alloc_complex(spec->n_ener);
-    spec->fftw_rel[ii] = fftw_alloc_complex(spec->n_ener);
-
-   for (jj = 0; jj < m; jj++) {
-      spec->fft_xill[ii][jj] = new double[spec->n_ener];
-      spec->fft_rel[ii][jj] = new double[spec->n_ener];
-    }
+  spec->fftw_xill_incl = new fftw_complex*[n_cache];
+  for (int ii = 0; ii < n_cache; ii++) {
     spec->xill_spec[ii] = nullptr;
+    spec->fftw_xill_incl[ii] = nullptr;
   }
+  spec->xill_incl_fft_valid = 0;
   spec->out_spec = nullptr;
 
   return spec;
@@ -88,9 +125,68 @@ static void init_specCache(specCache **spec, const int n_zones, int *status) {
 
 
 specCache *init_global_specCache(int *status) {
-  init_specCache(&global_spec_cache, N_ZONES_MAX, status);
+  RelxillContext *relxill_context = RelxillContext::current();
+  init_specCache(&relxill_context->spec_cache, N_ZONES_MAX, status);
   CHECK_RELXILL_ERROR("failed initializing Relconv Spec Cache", status);
-  return global_spec_cache;
+  return relxill_context->spec_cache;
+}
+
+static void free_model_cache_context(ModelCacheContext *context) {
+  free_specCache(context->spec_cache);
+  free(context->cached_rel_param);
+  free(context->cached_xill_param);
+  delete[] context->relconv_kernel;
+  delete context;
+}
+
+int new_model_cache_handle() {
+  static std::atomic<int> last_handle{0};
+  return ++last_handle;
+}
+
+ModelCacheContext *get_model_cache_context(ModelName model_name, int instance_id, int component_handle) {
+  RelxillContext *relxill_context = RelxillContext::current();
+  auto &model_cache_contexts = relxill_context->model_cache_contexts;
+  relxill_context->model_cache_context_uses++;
+
+  auto key = std::make_tuple(model_name, instance_id, component_handle);
+  auto elem = model_cache_contexts.find(key);
+  if (elem != model_cache_contexts.end()) {
+    elem->second->last_used = relxill_context->model_cache_context_uses;
+    return elem->second;
+  }
+
+  if (model_cache_contexts.size() >= N_MODEL_CACHE_CONTEXTS_MAX) {
+    auto oldest = std::min_element(model_cache_contexts.begin(), model_cache_contexts.end(),
+                                   [](const auto &lhs, const auto &rhs) {
+                                     return lhs.second->last_used < rhs.second->last_used;
+                                   });
+    free_model_cache_context(oldest->second);
+    model_cache_contexts.erase(oldest);
+  }
+
+  auto context = new ModelCacheContext{nullptr, nullptr, nullptr, nullptr, relxill_context, 0, 0,
+                                       relxill_context->model_cache_context_uses};
+  model_cache_contexts[key] = context;
+  if (is_debug_run()) {
+    printf(" DEBUG:  created a new cache context (model %i, instance %i, handle %i) \n",
+           static_cast<int>(model_name), instance_id, component_handle);
+  }
+  return context;
+}
+
+specCache *get_context_spec_cache(ModelCacheContext *context, int n_zones, int *status) {
+  init_specCache(&context->spec_cache, n_zones, status);
+  CHECK_RELXILL_ERROR("failed initializing the Spec Cache of the model component", status);
+  return context->spec_cache;
+}
+
+void free_model_cache_contexts() {
+  auto &model_cache_contexts = RelxillContext::current()->model_cache_contexts;
+  for (auto &elem: model_cache_contexts) {
+    free_model_cache_context(elem.second);
+  }
+  model_cache_contexts.clear();
 }
 
 static double* calculate_energyflux_conversion(const double* ener, int n_ener, int* status){
@@ -112,6 +208,109 @@ static double* calculate_energyflux_conversion(const double* ener, int n_ener, i
 
 
 
+/** mark the single precision relat. transforms as outdated (as the double precision ones were calculated) **/
+static void invalidate_fftwf_rel_transforms(specCache *cache) {
+  if (cache->float_cache != nullptr) {
+    cache->float_cache->fft_rel_valid = 0;
+  }
+}
+
+static void free_specCacheFloat(specCacheFloat *fcache) {
+  if (fcache != nullptr) {
+#ifdef RELXILL_FFTW_FLOAT
+    fftwf_free(fcache->fft_xill);
+    fftwf_free(fcache->fft_rel);
+    fftwf_free(fcache->fftw_xill);
+    fftwf_free(fcache->fftw_rel);
+    fftwf_free(fcache->fftw_backwards_input);
+    fftwf_free(fcache->fftw_output);
+#endif
+    delete fcache;
+  }
+}
+
+static int did_conv_energy_grid_change(const double *ener, int n, const specCache *cache) {
+  if (cache->ener == nullptr || n != cache->n_ener) {
+    return 1;
+  }
+  for (int ii = 0; ii <= n; ii++) {
+    if (ener[ii] != cache->ener[ii]) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/** set up everything which only depends on the energy grid of the convolution
+ *  - if the grid changed, the arrays are re-allocated (if necessary) and all stored transforms are
+ *    invalidated, i.e., the relat. and the xillver transforms are re-calculated in the next call **/
+static void init_fftw_conv_energy_grid(const double *ener, int n, specCache *cache, int *status) {
+
+  CHECK_STATUS_VOID(*status);
+
+  if (!did_conv_energy_grid_change(ener, n, cache)) {
+    return;
+  }
+
+  if (n != cache->n_ener) {
+    free_specCache_fftw_arrays(cache);
+    new_specCache_fftw_arrays(cache, n, status);
+    CHECK_STATUS_VOID(*status);
+  }
+
+  delete[] cache->ener;
+  cache->ener = new double[n + 1];
+  for (int ii = 0; ii <= n; ii++) {
+    cache->ener[ii] = ener[ii];
+  }
+
+  delete[] cache->conversion_factor_energyflux;
+  cache->conversion_factor_energyflux = calculate_energyflux_conversion(ener, n, status);
+
+  fftw_free(cache->fftw_norm_band_weights);
+  cache->fftw_norm_band_weights = nullptr;
+
+  free_specCacheFloat(cache->float_cache);
+  cache->float_cache = nullptr;
+
+  /* need to find out where the 1keV for the filter is, which defines if energies are blue or redshifted*/
+  cache->ind_1keV = binary_search(ener, n + 1, 1.0);
+
+  cache->fft_rel_valid = 0;
+  cache->xill_incl_fft_valid = 0;
+}
+
+/** multiply the (complex) Fourier transforms of the xillver and relat. spectra (fftw_complex or fftwf_complex) **/
+template<typename Complex>
+static void multiply_fftw_spectra(const Complex *fftw_xill, const Complex *fftw_rel, Complex *product, int n_freq) {
+  // as fftw_complex is an array of two values, operate on the real and imaginary parts directly
+  const auto *xill = &(fftw_xill[0][0]);
+  const auto *rel = &(fftw_rel[0][0]);
+  auto *prod = &(product[0][0]);
+  for (int ii = 0; ii < 2 * n_freq; ii += 2) {
+    prod[ii] = xill[ii] * rel[ii] - xill[ii + 1] * rel[ii + 1];
+    prod[ii + 1] = xill[ii] * rel[ii + 1] + xill[ii + 1] * rel[ii];
+  }
+}
+
+/** copy the relat. spectrum to the FFT input array, rotated such that 1keV is the first element **/
+template<typename Real>
+static void set_fft_rel_input(const double *frel, Real *fft_rel, int n, const double *conversion_factor,
+                              int ind_1keV) {
+  for (int ii = 0; ii < n; ii++) {
+    int irot = (ii - ind_1keV + n) % n;
+    fft_rel[irot] = (Real) (frel[ii] * conversion_factor[ii]);
+  }
+}
+
+/** copy the xillver spectrum to the FFT input array (zero if fxill==nullptr) **/
+template<typename Real>
+static void set_fft_xill_input(const double *fxill, Real *fft_xill, int n, const double *conversion_factor) {
+  for (int ii = 0; ii < n; ii++) {
+    fft_xill[ii] = (fxill == nullptr) ? 0 : (Real) (fxill[ii] * conversion_factor[ii]);
+  }
+}
+
 /** @brief FFTW VERSION: convolve the (bin-integrated) spectra f1 and f2 (which need to have a certain binning)
  *  @details fout: gives the output
  *  f1 input (reflection) specrum
@@ -127,20 +326,15 @@ void fftw_conv_spectrum(const double *ener, const double *fxill, const double *f
   // needs spec cache to be set up
   assert(cache != nullptr);
 
-  if (cache->conversion_factor_energyflux == nullptr){
-    cache->conversion_factor_energyflux = calculate_energyflux_conversion(ener, n, status);
-  }
-
+  init_fftw_conv_energy_grid(ener, n, cache, status);
+  CHECK_STATUS_VOID(*status);
 
-  /* need to find out where the 1keV for the filter is, which defines if energies are blue or redshifted*/
-  if (save_1eV_pos == 0 ||
-      (!((ener[save_1eV_pos] <= 1.0) &&
-          (ener[save_1eV_pos + 1] > 1.0)))) {
-    save_1eV_pos = binary_search(ener, n + 1, 1.0);
+  // the stored relat. transforms are not valid any more if the energy grid changed
+  if (!cache->fft_rel_valid) {
+    re_rel = 1;
   }
 
   int ii;
-  int irot;
 
   /**********************************************************************/
   /** cache either the relat. or the xillver part, as only one of the
@@ -150,48 +344,744 @@ void fftw_conv_spectrum(const double *ener, const double *fxill, const double *f
   /** #1: for the xillver part **/
   if (re_xill) {
     for (ii = 0; ii < n; ii++) {
-      cache->fft_xill[izone][0][ii] = fxill[ii] * cache->conversion_factor_energyflux[ii] ;
+      cache->fft_xill[izone][ii] = fxill[ii] * cache->conversion_factor_energyflux[ii] ;
     }
 
-    fftw_plan plan_xill = fftw_plan_dft_r2c_1d(n, cache->fft_xill[izone][0], cache->fftw_xill[izone],FFTW_ESTIMATE);
-    fftw_execute(plan_xill);
-    fftw_destroy_plan(plan_xill);
+    fftw_plan plan_xill = get_fftw_plan_r2c(n, cache->fft_xill[izone], cache->fftw_xill[izone], status);
+    CHECK_STATUS_VOID(*status);
+    fftw_execute_dft_r2c(plan_xill, cache->fft_xill[izone], cache->fftw_xill[izone]);
   }
 
   /** #2: for the relat. part **/
   if (re_rel){
-    for (ii = 0; ii < n; ii++) {
-      irot = (ii - save_1eV_pos + n) % n;
-      cache->fft_rel[izone][0][irot] = frel[ii] * cache->conversion_factor_energyflux[ii];
+    set_fft_rel_input(frel, cache->fft_rel[izone], n, cache->conversion_factor_energyflux, cache->ind_1keV);
+
+    fftw_plan plan_rel = get_fftw_plan_r2c(n, cache->fft_rel[izone], cache->fftw_rel[izone], status);
+    CHECK_STATUS_VOID(*status);
+    fftw_execute_dft_r2c(plan_rel, cache->fft_rel[izone], cache->fftw_rel[izone]);
+    cache->fft_rel_valid = 1;
+    cache->n_rel_transforms++;
+    invalidate_fftwf_rel_transforms(cache);
+  }
+
+  // the real-to-complex transform only has n/2+1 independent elements
+  multiply_fftw_spectra(cache->fftw_xill[izone], cache->fftw_rel[izone], cache->fftw_backwards_input, n / 2 + 1);
+
+  fftw_execute_dft_c2r(cache->plan_c2r, cache->fftw_backwards_input, cache->fftw_output);
+
+  for (ii = 0; ii < n; ii++) {
+    fout[ii] = cache->fftw_output[ii] /  cache->conversion_factor_energyflux[ii]; 
+  }
+
+}
+
+/** call func(izone_lo, nzones_chunk, status) for contiguous chunks of N_ZONES_FFT_CHUNK zones of [0,nzones),
+ *  such that the batched transforms of the chunks are done in parallel (see get_num_threads); the chunks
+ *  do not depend on the number of threads, so neither does the result (bitwise); the arrays of the
+ *  specCache are separate for every zone, so the chunks do not share any workspace **/
+template<typename Func>
+static void for_each_zone_chunk(int nzones, Func func, int *status) {
+  const int num_chunks = (nzones + N_ZONES_FFT_CHUNK - 1) / N_ZONES_FFT_CHUNK;
+  std::vector<int> status_chunk(num_chunks, EXIT_SUCCESS);
+  parallel_for(num_chunks, get_num_threads(), [&](int ichunk, int) {
+    const int izone_lo = ichunk * N_ZONES_FFT_CHUNK;
+    const int izone_hi = std::min(izone_lo + N_ZONES_FFT_CHUNK, nzones);
+    func(izone_lo, izone_hi - izone_lo, &status_chunk[ichunk]);
+  });
+  for (int chunk_status: status_chunk) {
+    if (chunk_status != EXIT_SUCCESS) {
+      *status = chunk_status;
+    }
+  }
+}
+
+/** forward transforms and their product (see fftw_multiply_transformed_zones) for the zones
+ *  [izone_lo, izone_lo+nzones), which are transformed at once **/
+static void fftw_multiply_transformed_zone_chunk(const double *const *fxill, const double *const *frel, int n,
+                                                 int izone_lo, int nzones, int re_rel, int re_xill,
+                                                 specCache *cache, int *status) {
+
+  const double *conversion_factor = cache->conversion_factor_energyflux;
+  const int n_freq = n / 2 + 1;
+  const int izone_hi = izone_lo + nzones;
+
+  if (re_xill) {
+    for (int izone = izone_lo; izone < izone_hi; izone++) {
+      set_fft_xill_input(fxill[izone], cache->fft_xill[izone], n, conversion_factor);
     }
 
-    fftw_plan plan_rel = fftw_plan_dft_r2c_1d(n, cache->fft_rel[izone][0], cache->fftw_rel[izone],FFTW_ESTIMATE);
-    fftw_execute(plan_rel);
-    fftw_destroy_plan(plan_rel);
+    fftw_plan plan_xill =
+        get_fftw_plan_many_r2c(n, nzones, cache->fft_xill[izone_lo], cache->fftw_xill[izone_lo], status);
+    CHECK_STATUS_VOID(*status);
+    fftw_execute_dft_r2c(plan_xill, cache->fft_xill[izone_lo], cache->fftw_xill[izone_lo]);
+
+  } else {  // transforms are given, only need to make sure skipped zones do not contribute
+    for (int izone = izone_lo; izone < izone_hi; izone++) {
+      if (fxill[izone] == nullptr) {
+        setArrayToZero(&(cache->fftw_xill[izone][0][0]), 2 * n_freq);
+      }
+    }
   }
 
-  // complex multiplication (TODO: fix that complex multiplication is not by hand)
-  for (ii = 0; ii < n; ii++) {
-//    cache->fftw_backwards_input[ii] = cache->fftw_xill[izone][ii] * cache->fftw_rel[izone][ii];
-    cache->fftw_backwards_input[ii][0] =
-        cache->fftw_xill[izone][ii][0] * cache->fftw_rel[izone][ii][0] -
-        cache->fftw_xill[izone][ii][1] * cache->fftw_rel[izone][ii][1];
+  if (re_rel) {
+    for (int izone = izone_lo; izone < izone_hi; izone++) {
+      set_fft_rel_input(frel[izone], cache->fft_rel[izone], n, conversion_factor, cache->ind_1keV);
+    }
+    fftw_plan plan_rel =
+        get_fftw_plan_many_r2c(n, nzones, cache->fft_rel[izone_lo], cache->fftw_rel[izone_lo], status);
+    CHECK_STATUS_VOID(*status);
+    fftw_execute_dft_r2c(plan_rel, cache->fft_rel[izone_lo], cache->fftw_rel[izone_lo]);
+  }
+
+  multiply_fftw_spectra(cache->fftw_xill[izone_lo], cache->fftw_rel[izone_lo],
+                        cache->fftw_backwards_input + ((size_t) izone_lo) * n_freq, nzones * n_freq);
+}
 
-    cache->fftw_backwards_input[ii][1] =
-        cache->fftw_xill[izone][ii][0] * cache->fftw_rel[izone][ii][1] +
-            cache->fftw_xill[izone][ii][1] * cache->fftw_rel[izone][ii][0];
+/** forward transforms of the xillver (if re_xill=1) and the relat. (if re_rel=1) spectra of all zones
+ *  at once (in chunks of zones for several threads), and their product stored in
+ *  cache->fftw_backwards_input[nzones*n_freq] **/
+static void fftw_multiply_transformed_zones(const double *ener, const double *const *fxill,
+                                            const double *const *frel, int n, int nzones, int re_rel,
+                                            int re_xill, specCache *cache, int *status) {
 
+  CHECK_STATUS_VOID(*status);
+
+  assert(cache != nullptr);
+  assert(nzones <= cache->n_cache);
+
+  init_fftw_conv_energy_grid(ener, n, cache, status);
+  CHECK_STATUS_VOID(*status);
+
+  if (!cache->fft_rel_valid) {
+    re_rel = 1;
   }
 
-  fftw_execute(cache->plan_c2r);
+  for_each_zone_chunk(nzones, [&](int izone_lo, int nzones_chunk, int *chunk_status) {
+    fftw_multiply_transformed_zone_chunk(fxill, frel, n, izone_lo, nzones_chunk, re_rel, re_xill, cache,
+                                         chunk_status);
+  }, status);
+  CHECK_STATUS_VOID(*status);
 
-  for (ii = 0; ii < n; ii++) {
-    fout[ii] = cache->fftw_output[ii] /  cache->conversion_factor_energyflux[ii]; 
+  if (re_rel) {
+    cache->fft_rel_valid = 1;
+    cache->n_rel_transforms++;
+    invalidate_fftwf_rel_transforms(cache);
+  }
+}
+
+/** double precision version of fftw_conv_spectrum_zones **/
+static void fftw_conv_spectrum_zones_double(const double *ener, const double *const *fxill, const double *const *frel,
+                                            double *fout, int n, int nzones, int re_rel, int re_xill,
+                                            specCache *cache, int *status) {
+
+  fftw_multiply_transformed_zones(ener, fxill, frel, n, nzones, re_rel, re_xill, cache, status);
+  CHECK_STATUS_VOID(*status);
+
+  const int n_freq = n / 2 + 1;
+  const double *conversion_factor = cache->conversion_factor_energyflux;
+  for_each_zone_chunk(nzones, [&](int izone_lo, int nzones_chunk, int *chunk_status) {
+    fftw_complex *backwards_input = cache->fftw_backwards_input + ((size_t) izone_lo) * n_freq;
+    double *output = cache->fftw_output + ((size_t) izone_lo) * n;
+    fftw_plan plan_c2r = get_fftw_plan_many_c2r(n, nzones_chunk, backwards_input, output, chunk_status);
+    CHECK_STATUS_VOID(*chunk_status);
+    fftw_execute_dft_c2r(plan_c2r, backwards_input, output);
+
+    for (int izone = izone_lo; izone < izone_lo + nzones_chunk; izone++) {
+      const double *conv_output = cache->fftw_output + ((size_t) izone) * n;
+      double *fout_zone = fout + ((size_t) izone) * n;
+      for (int ii = 0; ii < n; ii++) {
+        fout_zone[ii] = conv_output[ii] / conversion_factor[ii];
+      }
+    }
+  }, status);
+
+}
+
+/** transform the xillver spectra of all inclinations, after rebinning them to the convolution grid **/
+static void fftw_transform_xillver_inclinations(const double *ener, int n, const xillSpec *xill_spec,
+                                                fftw_complex *fftw_xill_incl, const double *conversion_factor,
+                                                int *status) {
+
+  const int n_incl = xill_spec->n_incl;
+  double *fft_input = fftw_alloc_real(((size_t) n_incl) * n);
+  CHECK_MALLOC_VOID_STATUS(fft_input, status)
+
+  for (int ii = 0; ii < n_incl; ii++) {
+    double *fft_input_incl = fft_input + ((size_t) ii) * n;
+    rebin_spectrum(ener, fft_input_incl, n, xill_spec->ener, xill_spec->flu[ii], xill_spec->n_ener);
+    for (int jj = 0; jj < n; jj++) {
+      fft_input_incl[jj] *= conversion_factor[jj];
+    }
+  }
+
+  fftw_plan plan = get_fftw_plan_many_r2c(n, n_incl, fft_input, fftw_xill_incl, status);
+  if (*status == EXIT_SUCCESS) {
+    fftw_execute_dft_r2c(plan, fft_input, fftw_xill_incl);
+  }
+  fftw_free(fft_input);
+}
+
+/** @brief calculate the transforms of the angle weighted xillver spectra (see calc_xillver_angdep) of all
+ *  zones directly in Fourier space, and store them in the specCache
+ *  @details
+ *   - as the angular weighting, the rebinning and the FFT are linear, the transform of a zone is given by
+ *     the dist-weighted sum of the transforms of the single inclinations, divided by norm_factors[ii]
+ *   - the transforms of the inclinations are only calculated if the xillver spectra changed
+ *     (i.e., if cache->xill_incl_fft_valid=0), such that only relat. parameters changing does not
+ *     need any xillver FFT (use re_xill=0 for the convolution afterwards)
+ * **/
+void fftw_mix_xillver_inclinations(const double *ener, int n, xillSpec *const *xill_spec, double *const *dist,
+                                   const double *norm_factors, int nzones, specCache *cache, int *status) {
+
+  CHECK_STATUS_VOID(*status);
+  assert(nzones <= cache->n_cache);
+
+  init_fftw_conv_energy_grid(ener, n, cache, status);
+  CHECK_STATUS_VOID(*status);
+  const int n_freq = n / 2 + 1;
+
+  // the transforms of the zones are independent and calculated in parallel
+  const int num_threads = get_num_threads();
+  if (!cache->xill_incl_fft_valid) {
+    std::vector<int> status_zone(nzones, EXIT_SUCCESS);
+    parallel_for(nzones, num_threads, [&](int izone, int) {
+      fftw_free(cache->fftw_xill_incl[izone]);
+      cache->fftw_xill_incl[izone] = fftw_alloc_complex(((size_t) xill_spec[izone]->n_incl) * n_freq);
+      CHECK_MALLOC_VOID_STATUS(cache->fftw_xill_incl[izone], &status_zone[izone])
+
+      fftw_transform_xillver_inclinations(ener, n, xill_spec[izone], cache->fftw_xill_incl[izone],
+                                          cache->conversion_factor_energyflux, &status_zone[izone]);
+    });
+    for (int zone_status: status_zone) {
+      if (zone_status != EXIT_SUCCESS) {
+        *status = zone_status;
+      }
+    }
+    CHECK_STATUS_VOID(*status);
+    cache->xill_incl_fft_valid = 1;
+  }
+
+  parallel_for(nzones, num_threads, [&](int izone, int) {
+    double *fftw_xill = &(cache->fftw_xill[izone][0][0]);
+    setArrayToZero(fftw_xill, 2 * n_freq);
+
+    for (int ii = 0; ii < xill_spec[izone]->n_incl; ii++) {
+      const double weight = dist[izone][ii] / norm_factors[izone];
+      const double *fftw_incl = &(cache->fftw_xill_incl[izone][((size_t) ii) * n_freq][0]);
+      for (int kk = 0; kk < 2 * n_freq; kk++) {
+        fftw_xill[kk] += weight * fftw_incl[kk];
+      }
+    }
+  });
+}
+
+static int is_in_fft_norm_band(const double *ener, int ii) {
+  return (ener[ii] >= EMIN_XILLVER && ener[ii + 1] < EMAX_XILLVER);
+}
+
+/** calculate the transform of the weights w[ii] = 1/conversion_factor[ii] in the band in which
+ *  the FFT output is normalized (see calcFFTNormFactor) and zero otherwise, such that the
+ *  sum of the convolved output in this band can be calculated directly in Fourier space **/
+static fftw_complex *calc_fftw_norm_band_weights(const double *ener, int n, const double *conversion_factor,
+                                                 int *status) {
+
+  double *weights = fftw_alloc_real(n);
+  fftw_complex *fftw_weights = fftw_alloc_complex(n / 2 + 1);
+  CHECK_MALLOC_RET_STATUS(weights, status, nullptr)
+  CHECK_MALLOC_RET_STATUS(fftw_weights, status, nullptr)
+
+  for (int ii = 0; ii < n; ii++) {
+    weights[ii] = is_in_fft_norm_band(ener, ii) ? 1.0 / conversion_factor[ii] : 0.0;
+  }
+
+  fftw_plan plan = get_fftw_plan_r2c(n, weights, fftw_weights, status);
+  if (*status == EXIT_SUCCESS) {
+    fftw_execute_dft_r2c(plan, weights, fftw_weights);
+  }
+  fftw_free(weights);
+
+  return fftw_weights;
+}
+
+/** sum of the (not normalized) convolved spectrum in the normalization band, calculated from its
+ *  transform: the output of the c2r transform is real, therefore only n/2+1 terms are needed **/
+template<typename Complex>
+static double calc_fftw_sum_in_norm_band(const Complex *product, const fftw_complex *weights, int n) {
+  const int n_freq = n / 2 + 1;
+  double sum = 0.0;
+  for (int kk = 1; kk < n_freq; kk++) {
+    sum += product[kk][0] * weights[kk][0] + product[kk][1] * weights[kk][1];
+  }
+  sum *= 2;
+  sum += product[0][0] * weights[0][0];
+  if (n % 2 == 0) {  // the Nyquist frequency is only contained once
+    sum -= product[n_freq - 1][0] * weights[n_freq - 1][0] + product[n_freq - 1][1] * weights[n_freq - 1][1];
+  }
+  return sum;
+}
+
+/** normalize the products of the transforms of all zones (see calcFFTNormFactor) in Fourier space and
+ *  sum them up in the array of the first zone; returns 0 if no zone contributes **/
+template<typename Complex>
+static int sum_normalized_fftw_products(const double *ener, const double *const *fxill, const double *const *frel,
+                                        Complex *products, int n, int nzones, const fftw_complex *norm_band_weights) {
+
+  const int n_freq = n / 2 + 1;
+  Complex *sum_product = products;
+  int is_first_zone = 1;
+  for (int izone = 0; izone < nzones; izone++) {
+    if (fxill[izone] == nullptr) {
+      continue;
+    }
+
+    double sum_xillver = 0.0;
+    double sum_relline = 0.0;
+    for (int jj = 0; jj < n; jj++) {
+      if (is_in_fft_norm_band(ener, jj)) {
+        sum_xillver += fxill[izone][jj];
+        sum_relline += frel[izone][jj];
+      }
+    }
+
+    const Complex *product = products + ((size_t) izone) * n_freq;
+    double norm_fac = sum_relline * sum_xillver / calc_fftw_sum_in_norm_band(product, norm_band_weights, n);
+
+    if (is_first_zone) {
+      for (int kk = 0; kk < n_freq; kk++) {
+        sum_product[kk][0] = norm_fac * product[kk][0];
+        sum_product[kk][1] = norm_fac * product[kk][1];
+      }
+      is_first_zone = 0;
+    } else {
+      for (int kk = 0; kk < n_freq; kk++) {
+        sum_product[kk][0] += norm_fac * product[kk][0];
+        sum_product[kk][1] += norm_fac * product[kk][1];
+      }
+    }
   }
 
+  return !is_first_zone;
 }
 
+static void init_fftw_norm_band_weights(const double *ener, int n, specCache *cache, int *status) {
+  if (cache->fftw_norm_band_weights == nullptr) {
+    cache->fftw_norm_band_weights = calc_fftw_norm_band_weights(ener, n, cache->conversion_factor_energyflux, status);
+  }
+}
+
+/** double precision version of fftw_conv_spectrum_zones_summed **/
+static void fftw_conv_spectrum_zones_summed_double(const double *ener, const double *const *fxill,
+                                                   const double *const *frel, double *fout, int n, int nzones,
+                                                   int re_rel, int re_xill, specCache *cache, int *status) {
+
+  fftw_multiply_transformed_zones(ener, fxill, frel, n, nzones, re_rel, re_xill, cache, status);
+  init_fftw_norm_band_weights(ener, n, cache, status);
+  CHECK_STATUS_VOID(*status);
 
+  if (!sum_normalized_fftw_products(ener, fxill, frel, cache->fftw_backwards_input, n, nzones,
+                                    cache->fftw_norm_band_weights)) {
+    setArrayToZero(fout, n);
+    return;
+  }
+
+  fftw_execute_dft_c2r(cache->plan_c2r, cache->fftw_backwards_input, cache->fftw_output);
+
+  for (int ii = 0; ii < n; ii++) {
+    fout[ii] = cache->fftw_output[ii] / cache->conversion_factor_energyflux[ii];
+  }
+}
+
+#ifdef RELXILL_FFTW_FLOAT
+
+static specCacheFloat *new_specCacheFloat(int n_cache, int n_ener, int *status) {
+
+  auto *fcache = new specCacheFloat;
+  fcache->n_ener = n_ener;
+  fcache->fft_rel_valid = 0;
+
+  const size_t n_real = ((size_t) n_cache) * n_ener;
+  const size_t n_complex = ((size_t) n_cache) * (n_ener / 2 + 1);
+  fcache->fft_xill = fftwf_alloc_real(n_real);
+  fcache->fft_rel = fftwf_alloc_real(n_real);
+  fcache->fftw_xill = fftwf_alloc_complex(n_complex);
+  fcache->fftw_rel = fftwf_alloc_complex(n_complex);
+  fcache->fftw_backwards_input = fftwf_alloc_complex(n_complex);
+  fcache->fftw_output = fftwf_alloc_real(n_real);
+  CHECK_MALLOC_RET_STATUS(fcache->fft_xill, status, fcache)
+  CHECK_MALLOC_RET_STATUS(fcache->fft_rel, status, fcache)
+  CHECK_MALLOC_RET_STATUS(fcache->fftw_xill, status, fcache)
+  CHECK_MALLOC_RET_STATUS(fcache->fftw_rel, status, fcache)
+  CHECK_MALLOC_RET_STATUS(fcache->fftw_backwards_input, status, fcache)
+  CHECK_MALLOC_RET_STATUS(fcache->fftw_output, status, fcache)
+
+  return fcache;
+}
+
+/** single precision version of fftw_multiply_transformed_zones (always re-calculates the xillver transforms),
+ *  the product is stored in fcache->fftw_backwards_input[nzones*n_freq] **/
+static void fftwf_multiply_transformed_zones(const double *ener, const double *const *fxill,
+                                             const double *const *frel, int n, int nzones, int re_rel,
+                                             specCache *cache, int *status) {
+
+  CHECK_STATUS_VOID(*status);
+  assert(nzones <= cache->n_cache);
+
+  init_fftw_conv_energy_grid(ener, n, cache, status);
+  if (cache->float_cache == nullptr) {
+    cache->float_cache = new_specCacheFloat(cache->n_cache, n, status);
+  }
+  CHECK_STATUS_VOID(*status);
+
+  specCacheFloat *fcache = cache->float_cache;
+  const double *conversion_factor = cache->conversion_factor_energyflux;
+  const int n_freq = n / 2 + 1;
+
+  for (int izone = 0; izone < nzones; izone++) {
+    set_fft_xill_input(fxill[izone], fcache->fft_xill + ((size_t) izone) * n, n, conversion_factor);
+  }
+  fftwf_plan plan_xill = get_fftwf_plan_many_r2c(n, nzones, fcache->fft_xill, fcache->fftw_xill, status);
+  CHECK_STATUS_VOID(*status);
+  fftwf_execute_dft_r2c(plan_xill, fcache->fft_xill, fcache->fftw_xill);
+
+  if (re_rel || !fcache->fft_rel_valid) {
+    for (int izone = 0; izone < nzones; izone++) {
+      set_fft_rel_input(frel[izone], fcache->fft_rel + ((size_t) izone) * n, n, conversion_factor, cache->ind_1keV);
+    }
+    fftwf_plan plan_rel = get_fftwf_plan_many_r2c(n, nzones, fcache->fft_rel, fcache->fftw_rel, status);
+    CHECK_STATUS_VOID(*status);
+    fftwf_execute_dft_r2c(plan_rel, fcache->fft_rel, fcache->fftw_rel);
+    fcache->fft_rel_valid = 1;
+    cache->fft_rel_valid = 0;  // the double precision transforms are outdated now
+  }
+
+  multiply_fftw_spectra(fcache->fftw_xill, fcache->fftw_rel, fcache->fftw_backwards_input, nzones * n_freq);
+}
+
+/** single precision version of fftw_conv_spectrum_zones **/
+static void fftwf_conv_spectrum_zones(const double *ener, const double *const *fxill, const double *const *frel,
+                                      double *fout, int n, int nzones, int re_rel, specCache *cache, int *status) {
+
+  fftwf_multiply_transformed_zones(ener, fxill, frel, n, nzones, re_rel, cache, status);
+  CHECK_STATUS_VOID(*status);
+
+  specCacheFloat *fcache = cache->float_cache;
+  fftwf_plan plan_c2r = get_fftwf_plan_many_c2r(n, nzones, fcache->fftw_backwards_input, fcache->fftw_output, status);
+  CHECK_STATUS_VOID(*status);
+  fftwf_execute_dft_c2r(plan_c2r, fcache->fftw_backwards_input, fcache->fftw_output);
+
+  const double *conversion_factor = cache->conversion_factor_energyflux;
+  for (int izone = 0; izone < nzones; izone++) {
+    const float *conv_output = fcache->fftw_output + ((size_t) izone) * n;
+    double *fout_zone = fout + ((size_t) izone) * n;
+    for (int ii = 0; ii < n; ii++) {
+      fout_zone[ii] = conv_output[ii] / conversion_factor[ii];
+    }
+  }
+}
+
+/** single precision version of fftw_conv_spectrum_zones_summed **/
+static void fftwf_conv_spectrum_zones_summed(const double *ener, const double *const *fxill,
+                                             const double *const *frel, double *fout, int n, int nzones,
+                                             int re_rel, specCache *cache, int *status) {
+
+  fftwf_multiply_transformed_zones(ener, fxill, frel, n, nzones, re_rel, cache, status);
+  init_fftw_norm_band_weights(ener, n, cache, status);
+  CHECK_STATUS_VOID(*status);
+
+  specCacheFloat *fcache = cache->float_cache;
+  if (!sum_normalized_fftw_products(ener, fxill, frel, fcache->fftw_backwards_input, n, nzones,
+                                    cache->fftw_norm_band_weights)) {
+    setArrayToZero(fout, n);
+    return;
+  }
+
+  fftwf_plan plan_c2r = get_fftwf_plan_many_c2r(n, 1, fcache->fftw_backwards_input, fcache->fftw_output, status);
+  CHECK_STATUS_VOID(*status);
+  fftwf_execute_dft_c2r(plan_c2r, fcache->fftw_backwards_input, fcache->fftw_output);
+
+  for (int ii = 0; ii < n; ii++) {
+    fout[ii] = fcache->fftw_output[ii] / cache->conversion_factor_energyflux[ii];
+  }
+}
+
+enum class FftwFloatAccuracy { unchecked, sufficient, insufficient };
+static std::atomic<FftwFloatAccuracy> fftw_float_accuracy{FftwFloatAccuracy::unchecked};
+
+/** compare the output of the single precision convolution to the double precision one (for n_spec
+ *  spectra of n bins) and only use it from now on if the maximal deviation in the normalization band,
+ *  relative to the maximal value of the spectrum, is below FFTW_FLOAT_MAX_DEVIATION **/
+static void check_fftw_float_accuracy(const double *ener, const double *fout_float, const double *fout_double,
+                                      int n, int n_spec) {
+
+  double max_deviation = 0.0;
+  for (int ispec = 0; ispec < n_spec; ispec++) {
+    const double *spec_float = fout_float + ((size_t) ispec) * n;
+    const double *spec_double = fout_double + ((size_t) ispec) * n;
+
+    double max_diff = 0.0;
+    double max_val = 0.0;
+    for (int ii = 0; ii < n; ii++) {
+      if (is_in_fft_norm_band(ener, ii)) {
+        max_diff = fmax(max_diff, fabs(spec_float[ii] - spec_double[ii]));
+        max_val = fmax(max_val, fabs(spec_double[ii]));
+      }
+    }
+    if (max_val > 0) {
+      max_deviation = fmax(max_deviation, max_diff / max_val);
+    }
+  }
+
+  if (max_deviation < FFTW_FLOAT_MAX_DEVIATION) {
+    fftw_float_accuracy = FftwFloatAccuracy::sufficient;
+  } else {
+    fftw_float_accuracy = FftwFloatAccuracy::insufficient;
+    printf(" *** warning: single precision convolution deviates by %.2e (more than %.0e), using double precision \n",
+           max_deviation, FFTW_FLOAT_MAX_DEVIATION);
+  }
+
+  if (is_debug_run()) {
+    printf(" DEBUG:  single precision convolution deviates by %.2e from double precision \n", max_deviation);
+  }
+}
+
+/** calculate the convolution "conv_float" in single precision, and on the first use also "conv_double"
+ *  in double precision to check its accuracy (the output has n_spec spectra of n bins) **/
+template<typename ConvFloat, typename ConvDouble>
+static void fftwf_convolve_checked(const double *ener, double *fout, int n, int n_spec,
+                                   ConvFloat conv_float, ConvDouble conv_double, int re_rel) {
+
+  conv_float(fout, re_rel);
+
+  if (fftw_float_accuracy == FftwFloatAccuracy::unchecked) {
+    auto fout_double = new double[((size_t) n_spec) * n];
+    conv_double(fout_double);
+    check_fftw_float_accuracy(ener, fout, fout_double, n, n_spec);
+    if (fftw_float_accuracy == FftwFloatAccuracy::insufficient) {
+      std::copy(fout_double, fout_double + ((size_t) n_spec) * n, fout);
+    }
+    delete[] fout_double;
+  }
+}
+
+#endif
+
+/** check if the single precision convolution should be used (set by the ENV variable RELXILL_FFTW_FLOAT)
+ *  - only possible if the xillver transforms are calculated (re_xill=1), as the transforms combined in
+ *    Fourier space (see fftw_mix_xillver_inclinations) are only available in double precision
+ *  - not used any more if it was found to be not accurate enough on the first use **/
+static int use_fftw_float_convolution(int re_xill) {
+  if (!do_fftw_float_convolution()) {
+    return 0;
+  }
+#ifdef RELXILL_FFTW_FLOAT
+  return re_xill && fftw_float_accuracy != FftwFloatAccuracy::insufficient;
+#else
+  (void) re_xill;  // only used with RELXILL_FFTW_FLOAT
+  static int warned = 0;
+  if (!warned) {
+    printf(" *** warning: single precision convolution not available, as relxill was compiled without the\n");
+    printf("     cmake option RELXILL_FFTW_FLOAT; using double precision instead \n");
+    warned = 1;
+  }
+  return 0;
+#endif
+}
+
+/** convolution of the zones by FFT, in single precision if set (see use_fftw_float_convolution), which
+ *  is checked against the double precision result on the first use **/
+static void fftw_conv_spectrum_zones_transformed(const double *ener, const double *const *fxill,
+                                                 const double *const *frel, double *fout, int n, int nzones,
+                                                 int re_rel, int re_xill, specCache *cache, int *status) {
+
+  if (use_fftw_float_convolution(re_xill)) {
+#ifdef RELXILL_FFTW_FLOAT
+    fftwf_convolve_checked(ener, fout, n, nzones, [&](double *out, int re_rel_float) {
+      fftwf_conv_spectrum_zones(ener, fxill, frel, out, n, nzones, re_rel_float, cache, status);
+    }, [&](double *out) {
+      fftw_conv_spectrum_zones_double(ener, fxill, frel, out, n, nzones, 1, re_xill, cache, status);
+    }, re_rel);
+    return;
+#endif
+  }
+
+  fftw_conv_spectrum_zones_double(ener, fxill, frel, fout, n, nzones, re_rel, re_xill, cache, status);
+}
+
+/** summed convolution of the zones by FFT (see fftw_conv_spectrum_zones_transformed) **/
+static void fftw_conv_spectrum_zones_summed_transformed(const double *ener, const double *const *fxill,
+                                                        const double *const *frel, double *fout, int n, int nzones,
+                                                        int re_rel, int re_xill, specCache *cache, int *status) {
+
+  if (use_fftw_float_convolution(re_xill)) {
+#ifdef RELXILL_FFTW_FLOAT
+    fftwf_convolve_checked(ener, fout, n, 1, [&](double *out, int re_rel_float) {
+      fftwf_conv_spectrum_zones_summed(ener, fxill, frel, out, n, nzones, re_rel_float, cache, status);
+    }, [&](double *out) {
+      fftw_conv_spectrum_zones_summed_double(ener, fxill, frel, out, n, nzones, 1, re_xill, cache, status);
+    }, re_rel);
+    return;
+#endif
+  }
+
+  fftw_conv_spectrum_zones_summed_double(ener, fxill, frel, fout, n, nzones, re_rel, re_xill, cache, status);
+}
+
+/** first bin and number of bins (returned) in which the relat. profile is non-zero **/
+static int get_kernel_support(const double *frel, int n, int *ind_lo) {
+  int ind_hi = n - 1;
+  while (ind_hi >= 0 && frel[ind_hi] == 0.0) {
+    ind_hi--;
+  }
+  *ind_lo = 0;
+  while (*ind_lo < ind_hi && frel[*ind_lo] == 0.0) {
+    (*ind_lo)++;
+  }
+  return ind_hi - (*ind_lo) + 1;
+}
+
+/** cost model: the direct convolution needs n*width multiply-adds, while the FFT needs three transforms
+ *  (xillver, relat., inverse) of O(n*log2(n)) operations per zone **/
+static int is_direct_convolution_faster(int width, int n) {
+  return width < CONV_DIRECT_COST_RATIO * log2(n);
+}
+
+/** the zones [nzones_fft,nzones) are convolved directly, as their kernel is narrow (or their spectrum is zero);
+ *  as the outer zones are usually the narrowest, the zones [0,nzones_fft) can still be transformed at once **/
+static int get_number_of_fft_zones(const double *const *fxill, const double *const *frel, int n, int nzones) {
+  for (int izone = nzones - 1; izone >= 0; izone--) {
+    int ind_lo;
+    if (fxill[izone] != nullptr && !is_direct_convolution_faster(get_kernel_support(frel[izone], n, &ind_lo), n)) {
+      return izone + 1;
+    }
+  }
+  return 0;
+}
+
+/** @brief direct convolution of a single zone, giving the identical (i.e., NOT normalized) output as the FFT
+ *  @details
+ *   - circular convolution of the energy flux spectra on the log grid, with the kernel rotated such that
+ *     1keV is at zero shift, i.e., fout[ii]*cf[ii] = n * sum_jj fxill[ii-jj+ind_1keV]*cf * frel[jj]*cf[jj]
+ *     (the factor n is the one of the unnormalized inverse FFT)
+ *   - only the bins of the kernel support contribute, and for each of them the inner loop over all
+ *     output bins is split in two contiguous parts (instead of wrapping the index), such that it can be vectorized
+ *   - work is an array of n bins
+ **/
+static void conv_spectrum_direct(const double *fxill, const double *frel, double *fout, int n, double *work,
+                                 const specCache *cache) {
+
+  const double *conversion_factor = cache->conversion_factor_energyflux;
+  for (int ii = 0; ii < n; ii++) {
+    work[ii] = fxill[ii] * conversion_factor[ii];
+  }
+  setArrayToZero(fout, n);
+
+  int ind_lo;
+  const int width = get_kernel_support(frel, n, &ind_lo);
+  for (int jj = ind_lo; jj < ind_lo + width; jj++) {
+    const double weight = n * frel[jj] * conversion_factor[jj];
+    if (weight == 0.0) {
+      continue;
+    }
+
+    const int shift = ((jj - cache->ind_1keV) % n + n) % n;
+    for (int ii = shift; ii < n; ii++) {
+      fout[ii] += weight * work[ii - shift];
+    }
+    for (int ii = 0; ii < shift; ii++) {
+      fout[ii] += weight * work[ii - shift + n];
+    }
+  }
+
+  for (int ii = 0; ii < n; ii++) {
+    fout[ii] /= conversion_factor[ii];
+  }
+}
+
+/** @brief FFTW VERSION for several zones: convolve fxill[ii] with frel[ii] for all zones ii<nzones at once
+ *  @details
+ *   - all zones are transformed by a single batched FFTW plan (and the complex multiplication is
+ *     done in one pass over all zones), which is significantly faster than zone by zone
+ *   - zones with fxill[ii]==nullptr are skipped and their output is set to zero
+ *   - the output fout[nzones*n] is stored contiguously and is NOT normalized (see normalizeFFTOutput)
+ *   - if re_rel=0 (re_xill=0), the transforms of the relat. (xillver) spectra stored in the "specCache" are
+ *     used instead (see fftw_mix_xillver_inclinations for the xillver part)
+ *   - done in single precision if set (see use_fftw_float_convolution)
+ *   - the outer zones with a narrow kernel are convolved directly (see get_number_of_fft_zones)
+ * **/
+void fftw_conv_spectrum_zones(const double *ener, const double *const *fxill, const double *const *frel,
+                              double *fout, int n, int nzones, int re_rel, int re_xill, specCache *cache,
+                              int *status) {
+
+  init_fftw_conv_energy_grid(ener, n, cache, status);
+  CHECK_STATUS_VOID(*status);
+
+  const int nzones_fft = get_number_of_fft_zones(fxill, frel, n, nzones);
+  if (nzones_fft > 0) {
+    fftw_conv_spectrum_zones_transformed(ener, fxill, frel, fout, n, nzones_fft, re_rel, re_xill, cache, status);
+  }
+
+  // the narrow zones are convolved in parallel, with a work array for every thread
+  const int num_threads = get_num_threads();
+  std::vector<std::vector<double>> work(num_threads, std::vector<double>(n));
+  parallel_for(nzones - nzones_fft, num_threads, [&](int ii, int ithread) {
+    const int izone = nzones_fft + ii;
+    double *fout_zone = fout + ((size_t) izone) * n;
+    if (fxill[izone] == nullptr) {
+      setArrayToZero(fout_zone, n);
+    } else {
+      conv_spectrum_direct(fxill[izone], frel[izone], fout_zone, n, work[ithread].data(), cache);
+    }
+  });
+}
+
+/** @brief FFTW VERSION for several zones, which returns the sum of all normalized convolved spectra
+ *  @details
+ *   - identical to summing the output of fftw_conv_spectrum_zones after normalizing every zone,
+ *     but the normalization (see calcFFTNormFactor) is applied in Fourier space, such that
+ *     only a single inverse transform is necessary
+ *   - zones with fxill[ii]==nullptr are skipped
+ *   - output fout[n]
+ *   - done in single precision if set, and narrow zones are convolved directly (see fftw_conv_spectrum_zones)
+ * **/
+void fftw_conv_spectrum_zones_summed(const double *ener, const double *const *fxill, const double *const *frel,
+                                     double *fout, int n, int nzones, int re_rel, int re_xill, specCache *cache,
+                                     int *status) {
+
+  init_fftw_conv_energy_grid(ener, n, cache, status);
+  CHECK_STATUS_VOID(*status);
+
+  const int nzones_fft = get_number_of_fft_zones(fxill, frel, n, nzones);
+  if (nzones_fft > 0) {
+    fftw_conv_spectrum_zones_summed_transformed(ener, fxill, frel, fout, n, nzones_fft, re_rel, re_xill, cache,
+                                                status);
+  } else {
+    setArrayToZero(fout, n);
+  }
+
+  // the narrow zones are convolved in parallel (with a work array for every thread), and then
+  // added in the order of the zones
+  const int nzones_direct = nzones - nzones_fft;
+  const int num_threads = get_num_threads();
+  std::vector<std::vector<double>> work(num_threads, std::vector<double>(n));
+  std::vector<double> fout_direct(((size_t) nzones_direct) * n);
+  parallel_for(nzones_direct, num_threads, [&](int ii, int ithread) {
+    const int izone = nzones_fft + ii;
+    if (fxill[izone] != nullptr) {
+      double *fout_zone = fout_direct.data() + ((size_t) ii) * n;
+      conv_spectrum_direct(fxill[izone], frel[izone], fout_zone, n, work[ithread].data(), cache);
+      normalizeFFTOutput(ener, fxill[izone], frel[izone], fout_zone, n);
+    }
+  });
+
+  for (int ii = 0; ii < nzones_direct; ii++) {
+    if (fxill[nzones_fft + ii] != nullptr) {
+      const double *fout_zone = fout_direct.data() + ((size_t) ii) * n;
+      for (int jj = 0; jj < n; jj++) {
+        fout[jj] += fout_zone[jj];
+      }
+    }
+  }
+}
 
 /**
  * @Function: calcFFTNormFactor
@@ -206,7 +1096,7 @@ double calcFFTNormFactor(const double *ener, const double *fxill, const double *
   double sum_xillver = 0.0;
   double sum_conv = 0.0;
   for (int jj = 0; jj < n; jj++) {
-    if (ener[jj] >= EMIN_XILLVER && ener[jj + 1] < EMAX_XILLVER) {
+    if (is_in_fft_norm_band(ener, jj)) {
       sum_xillver += fxill[jj];
       sum_relline += frel[jj];
       sum_conv += fout[jj];
@@ -234,6 +1124,7 @@ void convolveSpectrumFFTNormalized(const double *ener, const double *fxill, cons
 }
 
 void get_relxill_conv_energy_grid(int *n_ener, double **ener, int *status) {
+  std::lock_guard<std::mutex> lock(shared_table_mutex());
   if (global_ener_std == nullptr) {
     global_ener_std = (double *) malloc((N_ENER_CONV + 1) * sizeof(double));
     CHECK_MALLOC_VOID_STATUS(global_ener_std, status)
@@ -245,6 +1136,80 @@ void get_relxill_conv_energy_grid(int *n_ener, double **ener, int *status) {
 }
 
 
+/** smallest even number >= n, which only has the prime factors 2, 3, 5 and 7 (FFTW is fastest for those) **/
+static int get_fft_friendly_size(int n) {
+  for (int m = n + n % 2;; m += 2) {
+    int rest = m;
+    for (int fac: {2, 3, 5, 7}) {
+      while (rest % fac == 0) {
+        rest /= fac;
+      }
+    }
+    if (rest == 1) {
+      return m;
+    }
+  }
+}
+
+/**
+ * @brief energy grid for the convolution, restricted to the band needed for a spectrum in [emin,emax]
+ * @details
+ *   - only used if set by the ENV variable RELXILL_CONV_GRID_ADAPTIVE, otherwise the standard grid of
+ *     get_relxill_conv_energy_grid is returned
+ *   - the convolved spectrum in [emin,emax] only depends on the unconvolved spectrum in [emin/gmax,emax/gmin]
+ *     and the relline profile of the 1keV line lies in [gmin,gmax] (with the extreme g-factors of sys_par);
+ *     the grid covers both bands plus a margin of CONV_GRID_MARGIN
+ *   - it is a sub-grid of the standard grid, i.e., it has the same resolution (dE/E=0.27%) and the bins
+ *     are identical, but its number of bins is chosen to be FFT-friendly (see get_fft_friendly_size)
+ *   - the returned array points into the standard grid and must not be freed
+ **/
+void get_relxill_conv_energy_grid_adaptive(double emin, double emax, const RelSysPar *sys_par,
+                                           int *n_ener, double **ener, int *status) {
+
+  get_relxill_conv_energy_grid(n_ener, ener, status);
+  CHECK_STATUS_VOID(*status);
+
+  if (!use_adaptive_conv_energy_grid()) {
+    return;
+  }
+
+  double gmin = sys_par->gmin[0];
+  double gmax = sys_par->gmax[0];
+  for (int ii = 1; ii < sys_par->nr; ii++) {
+    gmin = fmin(gmin, sys_par->gmin[ii]);
+    gmax = fmax(gmax, sys_par->gmax[ii]);
+  }
+
+  double ener_lo = fmin(gmin, emin / gmax) / CONV_GRID_MARGIN;
+  double ener_hi = fmax(gmax, emax / gmin) * CONV_GRID_MARGIN;
+
+  int ind_lo = binary_search(*ener, N_ENER_CONV + 1, ener_lo);
+  int ind_hi = binary_search(*ener, N_ENER_CONV + 1, ener_hi) + 1;
+
+  int n_band = get_fft_friendly_size(ind_hi - ind_lo);
+  if (n_band >= N_ENER_CONV) {
+    return;
+  }
+
+  // extend the grid to the upper end, or to the lower end if we reached the end of the standard grid
+  ind_lo = (ind_lo + n_band > N_ENER_CONV) ? N_ENER_CONV - n_band : ind_lo;
+
+  (*n_ener) = n_band;
+  (*ener) += ind_lo;
+}
+
+
+/** the cached relconv kernel can be used if neither the relat. parameters nor the energy grid changed
+ *  (the transform of the kernel is stored in the spec_cache of the context for the same energy grid) **/
+static int is_relconv_kernel_cached(const ModelCacheContext *context, const double *ener, int n_ener,
+                                    const relParam *rel_param) {
+  if (context->relconv_kernel == nullptr || shouldOutfilesBeWritten()) {
+    return 0;
+  }
+  return !did_rel_param_change(context->cached_rel_param, rel_param)
+      && !did_conv_energy_grid_change(ener, n_ener, context->spec_cache);
+}
+
 void set_flux_outside_defined_range_to_zero(const double* ener, double* spec, int n_ener, double emin, double emax){
   int warned = 0;
   for (int ii=0; ii<n_ener; ii++){
@@ -268,28 +1233,53 @@ void set_flux_outside_defined_range_to_zero(const double* ener, double* spec, in
  *   and zero outside this range
  * @param double[n_ener_inp+1] ener_inp
  * @param double[n_ener_inp] spec_ener_inp
+ * @param context: cache context of the model component, which stores the kernel and its transform
+ *                 (evaluated in the RelxillContext owning it)
  *  **/
-void relconv_kernel(double *ener_inp, double *spec_inp, int n_ener_inp, relParam *rel_param, int *status) {
+void relconv_kernel(double *ener_inp, double *spec_inp, int n_ener_inp, relParam *rel_param,
+                    ModelCacheContext *context, int *status) {
+
+  RelxillContextGuard context_guard(context->relxill_context);
 
   // get the (fixed!) energy grid for a RELLINE for a convolution
   // -> as we do a simple FFT, we can now take into account that we
   // need it to be number = 2^N */
   int n_ener; double *ener;
-  get_relxill_conv_energy_grid(&n_ener, &ener, status);
+  get_relxill_conv_energy_grid_adaptive(ener_inp[0], ener_inp[n_ener_inp], get_system_parameters(rel_param, status),
+                                        &n_ener, &ener, status);
 
-  relline_spec_multizone *rel_profile = relbase(ener, n_ener, rel_param, status);
+  specCache *spec_cache = get_context_spec_cache(context, 1, status);
+  CHECK_STATUS_VOID(*status);
 
-  // simple convolution only makes sense for 1 zone !
-  assert(rel_profile->n_zones == 1);
+  // the relline kernel and its transform only need to be re-calculated if the relat. parameters changed
+  const int recompute_kernel = !is_relconv_kernel_cached(context, ener, n_ener, rel_param);
+  if (recompute_kernel) {
+    context->misses++;
+    relline_spec_multizone *rel_profile = relbase(ener, n_ener, rel_param, status);
+    CHECK_STATUS_VOID(*status);
+
+    // simple convolution only makes sense for 1 zone !
+    assert(rel_profile->n_zones == 1);
+
+    delete[] context->relconv_kernel;
+    context->relconv_kernel = new double[n_ener];
+    for (int ii = 0; ii < n_ener; ii++) {
+      context->relconv_kernel[ii] = rel_profile->flux[0][ii];
+    }
+    set_cached_rel_param(rel_param, &context->cached_rel_param, status);
+  } else {
+    context->hits++;
+    if (is_debug_run()) {
+      printf(" DEBUG:  RELCONV: re-using the transform of the cached kernel\n");
+    }
+  }
 
   auto rebin_flux =  new double[n_ener];
   rebin_spectrum(ener, rebin_flux, n_ener, ener_inp, spec_inp, n_ener_inp);
 
-  specCache* spec_cache = init_global_specCache(status);
-  CHECK_STATUS_VOID(*status);
   auto conv_out = new double[n_ener];
-  convolveSpectrumFFTNormalized(ener, rebin_flux, rel_profile->flux[0], conv_out, n_ener,
-                    1, 1, 0, spec_cache, status);
+  convolveSpectrumFFTNormalized(ener, rebin_flux, context->relconv_kernel, conv_out, n_ener,
+                    recompute_kernel, 1, 0, spec_cache, status);
   CHECK_STATUS_VOID(*status);
 
   // rebin to the output grid
@@ -305,6 +1295,7 @@ void relconv_kernel(double *ener_inp, double *spec_inp, int n_ener_inp, relParam
 
 
 
+
 void add_primary_component(double *ener, int n_ener, double *flu, relParam *rel_param, xillParam *xill_input_param,
                            RelSysPar *sys_par, int *status) {
 
@@ -463,10 +1454,61 @@ void write_output_rel_param(relParam *pa) {
   printf(" - gamma = %e\n", pa->gamma);
 }
 
+/** memory of the relline spectrum, as needed for the budget of the cache **/
+static size_t size_of_rel_spec(const relline_spec_multizone *spec) {
+  size_t n_values = (size_t) spec->n_zones * spec->n_ener + spec->n_ener + 1 + spec->n_zones + 1;
+  if (spec->rel_cosne != nullptr) {
+    n_values += (size_t) (spec->rel_cosne->n_zones + 1) * spec->rel_cosne->n_cosne;
+  }
+  return sizeof(relline_spec_multizone) + n_values * sizeof(double);
+}
+
+/** @brief calculate the basic relativistic line shape for a given parameter setup (not cached)
+ *  @details
+ *    - the caller owns the returned profile and has to free it with free_rel_spec
+ *    - needed for parameters with correction factors of the returning radiation, which can not be cached
+ * input: ener(n_ener), param
+ * input: RelSysPar
+ * optional input: xillver grid
+ * output: photar(n_ener)  [photons/bin]
+**/
+relline_spec_multizone* calc_relbase_profile(double *ener, int n_ener, relParam *param,
+                                            RelSysPar *sysPar,
+                                            xillTable *xill_tab,
+                                            const double *radialZones,
+                                            int nzones,
+                                            int *status) {
+
+  param->num_zones = nzones;
+
+  // init the spectra where we store the flux
+  relline_spec_multizone *spec = nullptr;
+  init_relline_spec_multizone(&spec, param, xill_tab, radialZones, &ener, n_ener, status);
+
+  calc_relline_profile(spec, sysPar, param, status); // returned units are 'photons/bin'
+
+  if (*status != EXIT_SUCCESS) {
+    printf(" *** error: calculation of relline profile failed \n");
+    write_output_rel_param(param);
+    throw std::exception();
+  }
+
+  // normalize it and calculate the angular distribution (if necessary)
+  renorm_relline_profile(spec, param, status);
+
+  if (shouldOutfilesBeWritten()) {
+    save_emis_profiles(sysPar);
+    save_relline_profile(spec);
+  }
+
+  return spec;
+}
+
 /** @brief relbase function calculating the basic relativistic line shape for a given parameter setup
  *  @details
  *    - assuming a 1keV line, by a grid given in keV!
- *    - it is cached
+ *    - it is cached (the profile is owned by the cache, see LruCache for how long it stays valid)
+ *    - not for parameters with correction factors of the returning radiation (see calc_relbase_profile)
  * input: ener(n_ener), param
  * input: RelSysPar
  * optional input: xillver grid
@@ -479,49 +1521,42 @@ relline_spec_multizone* relbase_profile(double *ener, int n_ener, relParam *para
                                        int nzones,
                                        int *status) {
 
+  assert(param->rrad_corr_factors == nullptr);
 
-  inpar* inp = get_inputvals_struct(ener, n_ener, param, status);
-  cache_info *ca_info = cli_check_cache(cache_relbase, inp, check_cache_relpar, status);
-  relline_spec_multizone *spec = nullptr;
-
-  // set a pointer to the spectrum
-  if (is_relbase_cached((ca_info)) == 0) {
-
-    // init the spectra where we store the flux
-    param->num_zones = nzones;
-    init_relline_spec_multizone(&spec, param, xill_tab, radialZones, &ener, n_ener, status);
+  RelxillContext *context = RelxillContext::current();
+  if (context->cache_relbase == nullptr) {
+    context->cache_relbase =
+        new LruCache<relline_spec_multizone>(get_cache_max_bytes(), size_of_rel_spec, free_rel_spec);
+  }
+  LruCache<relline_spec_multizone> *cache_relbase = context->cache_relbase;
 
-    calc_relline_profile(spec, sysPar, status); // returned units are 'photons/bin'
+  param->num_zones = nzones;
+  CacheKey key = get_relbase_cache_key(param, ener, n_ener);
+  relline_spec_multizone *spec = cache_relbase->find(key);
 
-    if (*status != EXIT_SUCCESS) {
-      printf(" *** error: calculation of relline profile failed \n");
-      write_output_rel_param(param);
-      throw std::exception();
-    }
+  // set a pointer to the spectrum
+  if (spec == nullptr) {
 
-    // normalize it and calculate the angular distribution (if necessary)
-    renorm_relline_profile(spec, param, status);
+    spec = calc_relbase_profile(ener, n_ener, param, sysPar, xill_tab, radialZones, nzones, status);
 
-    // last step: store parameters and cached relline_spec_multizone (this prepends a new node to the cache)
-    add_relspec_to_cache(&cache_relbase, param, spec, status);
-    if (is_debug_run() && *status == EXIT_SUCCESS) {
-      printf(" DEBUG:  Adding new RELBASE eval to cache; the count is %i \n", cli_count_elements(cache_relbase));
+    // last step: store the relline_spec_multizone in the cache (which owns it from now on)
+    cache_relbase->insert(key, spec);
+    if (is_debug_run()) {
+      printf(" DEBUG:  Adding new RELBASE eval to cache; the count is %zu (%zu hits, %zu misses) \n",
+             cache_relbase->size(), cache_relbase->hits(), cache_relbase->misses());
     }
   } else {
     if (is_debug_run()) {
       printf(" DEBUG:  RELBASE-Cache: re-using calculated values\n");
     }
-    spec = ca_info->store->data->relbase_spec;
-  }
 
-  if (shouldOutfilesBeWritten()) {
-    save_emis_profiles(sysPar);
-    save_relline_profile(spec);
+    // the output files are written during the calculation, so we need to do it again (the cached
+    // profile may still be in use, so it is not replaced)
+    if (shouldOutfilesBeWritten()) {
+      free_rel_spec(calc_relbase_profile(ener, n_ener, param, sysPar, xill_tab, radialZones, nzones, status));
+    }
   }
 
-  free(inp);
-  free(ca_info);
-
   return spec;
 }
 
@@ -590,6 +1625,9 @@ void free_rel_spec(relline_spec_multizone *spec) {
 }
 
 void free_cached_tables() {
+  // the xillver spectra must not be loaded in the background while the tables are freed
+  XillverPrefetcher::instance().cancel();
+
   free_relprofile_cache();
 
   free_cached_relTable();
@@ -600,28 +1638,15 @@ void free_cached_tables() {
  // free(cached_rel_param);
  // free(cached_xill_param);
 
-  free_specCache(global_spec_cache);
+  free_specCache(RelxillContext::current()->spec_cache);
+  RelxillContext::current()->spec_cache = nullptr;
+  free_model_cache_contexts();
 
   free(global_ener_std);
-  // free(global_ener_xill); // TODO, implement free of this global energy grid
-
-}
-
-void free_fft_cache(double ***sp, int n1, int n2) {
+  global_ener_std = nullptr;
 
-  int ii;
-  int jj;
-  if (sp != nullptr) {
-    for (ii = 0; ii < n1; ii++) {
-      if (sp[ii] != nullptr) {
-        for (jj = 0; jj < n2; jj++) {
-          free(sp[ii][jj]);
-        }
-      }
-      free(sp[ii]);
-    }
-    free(sp);
-  }
+  free_fftw_plan_cache();
+  // free(global_ener_xill); // TODO, implement free of this global energy grid
 
 }
 
@@ -649,16 +1674,9 @@ void free_spectrum(spectrum *spec) {
   }
 }
 
-void free_fftw_complex_cache(fftw_complex** val, int n){
-  for(int ii=0; ii<n; ii++){
-    fftw_free(val[ii]);
-  }
-}
-
 void free_specCache(specCache* spec_cache) {
 
   int ii;
-  int m = 2;
   if (spec_cache != nullptr) {
     if (spec_cache->xill_spec != nullptr) {
       for (ii = 0; ii < spec_cache->n_cache; ii++) {
@@ -666,32 +1684,29 @@ void free_specCache(specCache* spec_cache) {
           free_xill_spec(spec_cache->xill_spec[ii]);
         }
       }
-      free(spec_cache->xill_spec);
+      delete[] spec_cache->xill_spec;
     }
 
-    if (spec_cache->fft_xill != nullptr) {
-      free_fft_cache(spec_cache->fft_xill, spec_cache->n_cache, m);
-    }
+    free_specCache_fftw_arrays(spec_cache);
 
-    if (spec_cache->fftw_rel != nullptr) {
-      free_fft_cache(spec_cache->fft_rel, spec_cache->n_cache, m);
+    if (spec_cache->fftw_xill_incl != nullptr) {
+      for (ii = 0; ii < spec_cache->n_cache; ii++) {
+        fftw_free(spec_cache->fftw_xill_incl[ii]);
+      }
+      delete[] spec_cache->fftw_xill_incl;
     }
 
-    free_fftw_complex_cache(spec_cache->fftw_rel, spec_cache->n_cache);
-    free_fftw_complex_cache(spec_cache->fftw_xill, spec_cache->n_cache);
-    fftw_free(spec_cache->fftw_backwards_input);
-    fftw_destroy_plan(spec_cache->plan_c2r);
-    free(spec_cache->fftw_output);
+    free_specCacheFloat(spec_cache->float_cache);
 
-    if (spec_cache->conversion_factor_energyflux != nullptr){
-      free(spec_cache->conversion_factor_energyflux);
-    }
+    delete[] spec_cache->ener;
+    delete[] spec_cache->conversion_factor_energyflux;
+    fftw_free(spec_cache->fftw_norm_band_weights);
 
     free_spectrum(spec_cache->out_spec);
 
   }
 
-  free(spec_cache);
+  delete spec_cache;
 
 }
 
@@ -699,7 +1714,9 @@ void free_specCache(specCache* spec_cache) {
 
 void free_cache() {
   free_cache_syspar();
-  cli_delete_list(&cache_relbase);
+  RelxillContext *context = RelxillContext::current();
+  delete context->cache_relbase;
+  context->cache_relbase = nullptr;
 }
 
 
@@ -43,6 +43,10 @@ extern "C" {
 #define N_ENER_CONV  4096  // number of bins for the convolution, not that it needs to follow 2^N because of the FFT
 #define EMIN_RELXILL_CONV 0.00035  // minimal energy of the convolution (in keV)
 #define EMAX_RELXILL_CONV 2000.0 // maximal energy of the convolution (in keV)
+#define CONV_GRID_MARGIN 1.2  // relative energy margin of the adaptive convolution grid
+#define FFTW_FLOAT_MAX_DEVIATION 1e-5  // maximal relative deviation of the single precision convolution
+#define CONV_DIRECT_COST_RATIO 2.0  // kernels narrower than this times log2(n) bins are convolved directly
+#define N_ZONES_FFT_CHUNK 5  // number of zones transformed at once (fixed, such that the result is independent of the threads)
 
 /** minimal and maximal energy for reflection strength calculation **/
 #define RSTRENGTH_EMIN 20.0
@@ -72,11 +76,31 @@ typedef struct {
   int limb_law;
 
   int ng;
-  double **trff;
-  double **cosne;
+  const double *trff[2];   // [k][ng], pointing to the current radius of the system parameters
+  const double *cosne[2];
   double *gstar;
 } str_relb_func;
 
+class RelxillContext;
+
+/** caching state of a single model component, i.e., the last evaluation of relxill_kernel or relconv_kernel
+ *  (every component has its own context, such that several components in one fit do not overwrite each
+ *  others cached values) **/
+typedef struct {
+  specCache *spec_cache;
+  relParam *cached_rel_param;
+  xillParam *cached_xill_param;
+  double *relconv_kernel;  // relline profile on the energy grid of the spec_cache (only used by relconv)
+  RelxillContext *relxill_context;  // context which owns this one, the model component is evaluated in it
+  size_t hits;    // evaluations which re-used all cached values of the last one
+  size_t misses;  // evaluations which needed to re-calculate (parts of) the spectrum
+  size_t last_used;  // when the context was used last (to free the least recently used one)
+} ModelCacheContext;
+
+/** maximal number of cache contexts of model components in a RelxillContext (if more are used, the least
+ *  recently used contexts are freed) **/
+#define N_MODEL_CACHE_CONTEXTS_MAX 32
+
 /****** FUNCTION DEFINITIONS ******/
 
 /* get the current version number */
@@ -92,6 +116,14 @@ relline_spec_multizone* relbase_profile(double *ener, int n_ener, relParam *para
                                         int nzones,
                                         int *status);
 
+/* relline profile which is not cached (the caller has to free it with free_rel_spec) */
+relline_spec_multizone* calc_relbase_profile(double *ener, int n_ener, relParam *param,
+                                             RelSysPar *sysPar,
+                                             xillTable *xill_tab,
+                                             const double *radialZones,
+                                             int nzones,
+                                             int *status);
+
 
 relline_spec_multizone *relbase_multizone(double *ener,
                                           const int n_ener,
@@ -104,7 +136,8 @@ relline_spec_multizone *relbase_multizone(double *ener,
 void free_cached_tables(void);
 
 
-void relconv_kernel(double *ener_inp, double *spec_inp, int n_ener_inp, relParam *rel_param, int *status);
+void relconv_kernel(double *ener_inp, double *spec_inp, int n_ener_inp, relParam *rel_param,
+                    ModelCacheContext *context, int *status);
 
 
 /** function adding a primary component with the proper norm to the flux **/
@@ -123,8 +156,22 @@ double calcFFTNormFactor(const double *ener, const double *fxill, const double *
 
 /** caching routines **/
 specCache *init_global_specCache(int *status);
+
+/** new handle of a model component (never 0), with which several components of the same model and
+ *  instance get their own cache context (see get_model_cache_context) **/
+int new_model_cache_handle();
+
+/** get the cache context of a model component, which is identified by the model name, an instance id
+ *  (for XSPEC the number of the spectrum) and a handle of the component (see new_model_cache_handle, 0 if
+ *  none was requested); the context is created at the first call in the current RelxillContext
+ *  - XSPEC does not identify the components of a model within one dataset, so these share a context **/
+ModelCacheContext *get_model_cache_context(ModelName model_name, int instance_id, int component_handle);
+
+/** spec_cache of the context for n_zones (allocated at the first call) **/
+specCache *get_context_spec_cache(ModelCacheContext *context, int n_zones, int *status);
+
+void free_model_cache_contexts();
 void free_specCache(specCache *spec_cache);
-void free_fft_cache(double ***sp, int n1, int n2);
 void free_spectrum(spectrum *spec);
 
 spectrum *new_spectrum(int n_ener, const double *ener, int *status);
@@ -142,8 +189,24 @@ void free_cache(void);
 void convolveSpectrumFFTNormalized(const double *ener, const double *fxill, const double *frel, double *fout, int n,
                                    int re_rel, int re_xill, int izone, specCache *local_spec_cache, int *status);
 
+void fftw_conv_spectrum_zones(const double *ener, const double *const *fxill, const double *const *frel,
+                              double *fout, int n, int nzones, int re_rel, int re_xill, specCache *cache,
+                              int *status);
+
+void fftw_conv_spectrum_zones_summed(const double *ener, const double *const *fxill, const double *const *frel,
+                                     double *fout, int n, int nzones, int re_rel, int re_xill, specCache *cache,
+                                     int *status);
+
+void fftw_mix_xillver_inclinations(const double *ener, int n, xillSpec *const *xill_spec, double *const *dist,
+                                   const double *norm_factors, int nzones, specCache *cache, int *status);
+
+void normalizeFFTOutput(const double *ener, const double *fxill, const double *frel, double *fout, int n);
+
 void get_relxill_conv_energy_grid(int *n_ener, double **ener, int *status);
 
+void get_relxill_conv_energy_grid_adaptive(double emin, double emax, const RelSysPar *sys_par,
+                                           int *n_ener, double **ener, int *status);
+
 double calcNormWrtXillverTableSpec(const double *flux, const double *ener, const int n, int *status);
 
 void set_stdNormXillverEnerygrid(int *status);
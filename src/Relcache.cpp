@@ -19,30 +19,6 @@
 #include "Relcache.h"
 #include "Relbase.h"
 
-/** probably best move to "utils" **/
-inpar *get_inputvals_struct(double *ener, int n_ener, const relParam *rel_par, int *status) {
-  auto *inp = (inpar *) malloc(sizeof(inpar));
-  CHECK_MALLOC_RET_STATUS(inp, status, nullptr)
-
-  inp->ener = ener;
-  inp->n_ener = n_ener;
-  inp->rel_par = rel_par;
-
-  return inp;
-}
-
-/** probably best move to "utils" **/
-inpar *set_input_syspar(const relParam *rel_par, int *status) {
-  auto inp = (inpar *) malloc(sizeof(inpar));
-  CHECK_MALLOC_RET_STATUS(inp, status, nullptr)
-
-  inp->ener = nullptr;
-  inp->n_ener = 0;
-  inp->rel_par = rel_par;
-
-  return inp;
-}
-
 int are_values_different(double val1, double val2) {
   if (fabs(val1 - val2) <= CACHE_LIMIT) {
     return 0;
@@ -148,6 +124,57 @@ int did_rel_param_change(const relParam *cpar, const relParam *par) {
   return 0;
 }
 
+CacheKey get_syspar_cache_key(const relParam *param) {
+  CacheKey key;
+  key.add(param->a);
+  key.add(param->emis1);
+  key.add(param->emis2);
+  key.add(param->gamma);
+  key.add(param->height);
+  key.add(param->htop);
+  key.add(param->incl);
+  key.add(param->beta);
+  key.add(param->rin);
+  key.add(param->rbr);
+  key.add(param->rout);
+  key.add(param->limb);
+  key.add(param->return_rad);
+  return key;
+}
+
+CacheKey get_relbase_cache_key(const relParam *param, const double *ener, int n_ener) {
+  CacheKey key = get_syspar_cache_key(param);
+  key.add(param->emis_type);
+  key.add(param->model_type);
+  key.add(param->z);
+  key.add(param->lineE);
+  key.add(param->do_renorm_relline);
+  key.add(param->ion_grad_type);
+  key.add(param->num_zones);
+  key.add(use_relline_cdf_engine());
+  key.add_fingerprint(ener, n_ener + 1, CACHE_LIMIT_ENER);
+  return key;
+}
+
+CacheKey get_xill_param_cache_key(const xillParam *param) {
+  CacheKey key;
+  key.add(param->afe);
+  key.add(param->dens);
+  key.add(param->ect);
+  key.add(param->gam);
+  key.add(param->lxi);
+  key.add(param->kTbb);
+  key.add(param->frac_pl_bb);
+  key.add(param->z);
+  key.add(param->prim_type);
+  key.add(param->model_type);
+  key.add(param->iongrad_index);
+  key.add(param->distance);
+  key.add(param->mass_msolar);
+  key.add(param->norm_flux_cgs);
+  return key;
+}
+
 void set_cached_rel_param(const relParam *par, relParam **ca_rel_param, int *status) {
 
   assert(ca_rel_param != nullptr);
@@ -215,317 +242,3 @@ void set_cached_xill_param(xillParam *par, xillParam **ca_xill_param, int *statu
   (*ca_xill_param)->refl_frac = par->refl_frac;
 
 }
-
-static int did_energy_grid_change(double *ener, int n_ener, relline_spec_multizone *ca) {
-  const int not_changed = 0;
-  const int changed = 1;
-
-  if (ca == nullptr) {
-    return not_changed;
-  }
-
-  if (n_ener != ca->n_ener) {
-    return changed;
-  }
-
-  int ii;
-  for (ii = 0; ii < n_ener; ii++) {
-    if (fabs(ca->ener[ii] - ener[ii]) > 1e-4) {
-      return changed;
-    }
-  }
-
-  return not_changed;
-}
-
-cnode *cli_create(cdata *data, cnode *next, int *status) {
-  auto *new_node = new cnode;
-  CHECK_MALLOC_RET_STATUS(new_node, status, nullptr)
-
-  new_node->data = data;
-  new_node->next = next;
-
-  return new_node;
-}
-
-cnode *cli_prepend(cnode *head, cdata *data, int *status) {
-  CHECK_STATUS_RET(*status, nullptr);
-  cnode *new_node = cli_create(data, head, status);
-  head = new_node;
-  return head;
-}
-
-
-int cli_count_elements(cnode *head) {
-  cnode *cursor = head;
-  int nelem = 0;
-  while (cursor != nullptr) {
-    nelem++;
-    cursor = cursor->next;
-  }
-  return nelem;
-}
-
-/* delete the linked list */
-void cli_delete_list(cnode **pt_head) {
-  cnode *cursor = *pt_head;
-
-  cnode *next = nullptr;
-
-  while (cursor != nullptr) {
-    next = cursor->next;
-    free_cnode(&cursor);
-    cursor = next;
-  }
-
-  *pt_head = nullptr;
-}
-
-static cache_info *init_cache_info(cnode *node, int *status) {
-  auto *ca = (cache_info *) malloc(sizeof(cache_info));
-  CHECK_MALLOC_RET_STATUS(ca, status, nullptr)
-
-  // set where the storage is pointing to, to the current node pointer
-  ca->store = node;
-
-  ca->read = nullptr;  // not used right now!!
-  ca->store = nullptr;
-  ca->relcache = 0;
-  ca->syscache = 0;
-  ca->xilcache = 0;
-
-  return ca;
-}
-
-cnode *check_cache_syspar(cache_info *ca_info, inpar *inp, cnode *node) {
-
-  if (comp_sys_param(node->data->par_rel, inp->rel_par) == 0) {
-    // system parameters did not change in this iteration
-    ca_info->syscache = 1;
-    ca_info->read = nullptr;
-    ca_info->store = node;
-    return nullptr;
-
-  } else {
-    // parameters did change, let's try the next node
-    return node->next;
-  }
-}
-
-cnode *check_cache_relpar(cache_info *ca_info, inpar *inp, cnode *node) {
-
-  if (did_rel_param_change(node->data->par_rel, inp->rel_par) == 0) {
-    // system parameters did not change in this iteration
-    // however, one last check if the energy grid did change
-    if (did_energy_grid_change(inp->ener, inp->n_ener, node->data->relbase_spec)) {
-      return node->next;
-
-      // energy grid AND parameters did not change: found a MATCH
-    } else {
-      ca_info->relcache = 1;
-      ca_info->read = nullptr;
-      ca_info->store = node;
-      return nullptr;
-    }
-
-  } else {
-    // parameters did change, let's try the next node
-    return node->next;
-  }
-}
-
-
-static int get_cache_maxsize(){
-  if (shouldOutfilesBeWritten()){
-    return 1;
-  } else {
-    return CLI_NMAX;
-  }
-
-}
-
-cache_info *cli_check_cache(cnode *head,
-                            inpar *inp,
-                            cnode *(*check_cache)(cache_info *, inpar *, cnode *),
-                            int *status) {
-
-  CHECK_STATUS_RET(*status, nullptr);
-
-  cache_info *ca_info = init_cache_info(head, status);
-  CHECK_MALLOC_RET_STATUS(ca_info, status, nullptr)
-
-  const int cache_maxsize = get_cache_maxsize();
-
-  if (cache_maxsize==1){
-    return ca_info;
-  }
-
-  int c = 0;
-  cnode *cursor = head;
-  cnode *next = nullptr;
-  while (cursor != nullptr ) {
-
-    // if cursor is not nullptr, we already have one element
-    c++;
-
-    // let's check the cache: return value can be nullptr for 2 conditions:
-    // (1) found a match
-    // (2) end of the list
-    next = check_cache(ca_info, inp, cursor);
-
-    // if we are above the maximal number of elements, delete the rest and break
-    // (+) we need to set the cursor->next=nullptr
-    if (next != nullptr && c >= cache_maxsize - 1) {
-      if (is_debug_run()) {
-        printf(" DEBUG: Cached reached its limiting size of %i\n", cache_maxsize);
-      }
-      cli_delete_list(&next);
-      cursor->next = nullptr;
-      assert(next == nullptr);
-    }
-    cursor = next;
-  }
-
-  return ca_info;
-}
-
-// prepend new node and set parameters
-cnode *add_node_to_cache(cnode *head, const relParam *relpar, xillParam *xillpar, int *status) {
-
-  CHECK_STATUS_RET(*status, nullptr);
-
-  cdata *data = init_cdata(status);
-
-  assert(data != nullptr);
-  if (relpar != nullptr) {
-    set_cached_rel_param(relpar, &(data->par_rel), status);
-  }
-
-  if (xillpar != nullptr) {
-    set_cached_xill_param(xillpar, &(data->par_xill), status);
-  }
-
-  // prepend (i.e., create new node, assign data, and set the new head)
-  cnode *new_head = cli_prepend(head, data, status);
-
-  assert(new_head != nullptr);
-
-  CHECK_RELXILL_DEFAULT_ERROR(status);
-
-  return new_head;
-}
-
-void add_relspec_to_cache(cnode **node, const relParam *param, relline_spec_multizone *spec, int *status) {
-
-  CHECK_STATUS_VOID(*status);
-
-  cnode *old_head = *node;
-
-  // prepend new node and set parameters
-  cnode *new_head = add_node_to_cache(old_head, param, nullptr, status);
-
-  // set the data
-  new_head->data->relbase_spec = spec;
-
-  *node = new_head;
-
-  CHECK_RELXILL_DEFAULT_ERROR(status);
-}
-
-void set_cache_syspar(cnode **pt_head, const relParam *param, RelSysPar *syspar, int *status) {
-
-  CHECK_STATUS_VOID(*status);
-
-  // prepend new node and set parameters
-  cnode *new_head = add_node_to_cache(*pt_head, param, nullptr, status);
-
-  // set the data
-  new_head->data->relSysPar = syspar;
-
-  *pt_head = new_head;
-
-  CHECK_RELXILL_DEFAULT_ERROR(status);
-}
-
-/********* HELPER ROUTINES *********/
-
-
-cdata *init_cdata(int *status) {
-
-  CHECK_STATUS_RET(*status, nullptr);
-
-  auto *data = (cdata *) malloc(sizeof(cdata));
-  CHECK_MALLOC_RET_STATUS(data, status, nullptr)
-
-  data->par_rel = nullptr;
-  data->par_xill = nullptr;
-  data->relSysPar = nullptr;
-  data->relbase_spec = nullptr;
-  data->relxill_cache = nullptr;
-
-  return data;
-}
-
-void free_relxill_cache(specCache *ca) {
-
-  int ii;
-  int m = 2;
-  if (ca != nullptr) {
-    if (ca->xill_spec != nullptr) {
-      for (ii = 0; ii < ca->n_cache; ii++) {
-        if (ca->xill_spec[ii] != nullptr) {
-          free_xill_spec(ca->xill_spec[ii]);
-        }
-      }
-      free(ca->xill_spec);
-    }
-
-    if (ca->fft_xill != nullptr) {
-      free_fft_cache(ca->fft_xill, ca->n_cache, m);
-    }
-
-    if (ca->fft_rel != nullptr) {
-      free_fft_cache(ca->fft_rel, ca->n_cache, m);
-    }
-
-    free_spectrum(ca->out_spec);
-
-  }
-
-  free(ca);
-
-}
-
-static void free_cdata(cdata **pt_data) {
-
-  if (*pt_data != nullptr) {
-    cdata *data = *pt_data;
-    free(data->par_rel);
-    free(data->par_xill);
-    free_rel_spec(data->relbase_spec);
-    free_relxill_cache(data->relxill_cache);
-    free_relSysPar(data->relSysPar);
-    free(data);
-  }
-
-}
-
-void free_cnode(cnode **node) {
-
-  if ((*node) != nullptr) {
-    if ((*node)->data != nullptr) {
-      free_cdata(&((*node)->data));
-    }
-    free(*node);
-    *node = nullptr;
-  }
-
-}
-
-int is_relbase_cached(cache_info *self) {
-  return self->relcache;
-}
-
-int is_cached(cache_info *self) {
-  return self->relcache + self->xilcache;
-}
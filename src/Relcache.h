@@ -19,7 +19,15 @@
 #define RELCACHE_H_
 
 #include "ModelParams.h"
-#include <deque>
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <cassert>
 
 extern "C" {
 #include "common.h"
@@ -28,133 +36,198 @@ extern "C" {
 
 #define CACHE_LIMIT 1e-8
 
-/****** TYPEDEF******/
-
-#define CLI_NMAX 10
-
-typedef struct cdata {
-
-  xillParam *par_xill;
-  relParam *par_rel;
-
-  relline_spec_multizone *relbase_spec;
-  RelSysPar *relSysPar;
-  specCache *relxill_cache;
-} cdata;
-
-typedef struct cnode {
-  cdata *data;
-  struct cnode *next;
-} cnode;
-
-typedef struct cache_info {
-
-  int relcache;
-  int syscache;
-  int xilcache;
-
-  cnode *store;  // this is a pointer to the node, where the data is stored
-  cnode *read;   // NOT NEEDED RIGHT NOW XXX
-
-
-} cache_info;
-
-typedef struct inpar {
-  const relParam *rel_par;
-  double *ener;
-  int n_ener;
-} inpar;
-
-/** set the input parameters in one single structure **/
-inpar *get_inputvals_struct(double *ener, int n_ener, const relParam *rel_par, int *status);
-inpar *set_input_syspar(const relParam *rel_par, int *status);
+// precision of the energy grid to be considered identical in the caches
+#define CACHE_LIMIT_ENER 1e-4
 
 int are_values_different(double val1, double val2);
 
-/** create a caching node **/
-cnode *cli_create(cdata *data, cnode *next, int *status);
-
-/** delete the full list (starting from head) **/
-void cli_delete_list(cnode **head);
-int cli_count_elements(cnode *head);
-
-cnode *cli_prepend(cnode *head, cdata *data, int *status);
-// void cli_traverse(cnode* head,callback f);
+/** key of the caches: the parameter values, canonicalized to the precision CACHE_LIMIT (i.e., all
+ *  values which are identical at this precision give the same key, such that keys can be hashed) */
+class CacheKey {
+ public:
 
-cdata *init_cdata(int *status);
+  void add(double val) {
+    add_canonicalized(val, CACHE_LIMIT);
+  }
 
-// Routines to set the cached parameters
-void add_relspec_to_cache(cnode **node, const relParam *param, relline_spec_multizone *spec, int *status);
-void set_cache_syspar(cnode **node, const relParam *param, RelSysPar *syspar, int *status);
-void set_cached_xill_param(xillParam *par, xillParam **ca_xill_param, int *status);
+  void add(int val) {
+    m_values.push_back(val);
+  }
 
-cnode *check_cache_syspar(cache_info *ca_info, inpar *input, cnode *node);
-cnode *check_cache_relpar(cache_info *ca_info, inpar *input, cnode *node);
+  /** add the value without any canonicalization (i.e., only identical values give the same key) **/
+  void add_exact(double val) {
+    int64_t bits;
+    std::memcpy(&bits, &val, sizeof(bits));
+    m_values.push_back(bits);
+  }
 
-int did_rel_param_change(const relParam *cpar, const relParam *par);
+  /** add the fingerprint of an array (FNV-1a hash of its values at the given precision) **/
+  void add_fingerprint(const double *arr, int n, double precision) {
+    CacheKey arr_key;
+    for (int ii = 0; ii < n; ii++) {
+      arr_key.add_canonicalized(arr[ii], precision);
+    }
+    m_values.push_back(n);
+    m_values.push_back(static_cast<int64_t>(arr_key.hash()));
+  }
 
-cache_info *cli_check_cache(cnode *head,
-                            inpar *inp,
-                            cnode *(*check_cache)(cache_info *, inpar *, cnode *),
-                            int *status);
-//cache_info* cli_check_cache(cnode* head, input* input, cnode* *check_cache, int* status);
+  bool operator==(const CacheKey &other) const {
+    return m_values == other.m_values;
+  }
 
-int is_relbase_cached(cache_info *self);
-int is_xill_cached(cache_info *self);
-int is_cached(cache_info *self);
+  /** FNV-1a hash of the canonicalized values **/
+  uint64_t hash() const {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int64_t val: m_values) {
+      for (int ii = 0; ii < 8; ii++) {
+        hash ^= (static_cast<uint64_t>(val) >> (8 * ii)) & 0xff;
+        hash *= 1099511628211ULL;
+      }
+    }
+    return hash;
+  }
 
-void free_cnode(cnode **node);
+ private:
+  std::vector<int64_t> m_values;
+
+  void add_canonicalized(double val, double precision) {
+    double scaled = val / precision;
+    if (std::fabs(scaled) < 1e18) {
+      m_values.push_back(std::llround(scaled));
+    } else {  // too large to be rounded (or not finite), so we use the exact value
+      int64_t bits;
+      std::memcpy(&bits, &val, sizeof(bits));
+      m_values.push_back(bits);
+    }
+  }
+};
 
+struct CacheKeyHash {
+  size_t operator()(const CacheKey &key) const {
+    return static_cast<size_t>(key.hash());
+  }
+};
 
-/*
-class Cache{
+/** least recently used (LRU) cache, which owns the stored values
+ *  - values are found by their key in constant time (hashed)
+ *  - if the memory of all values (as given by size_of) exceeds the byte budget, or if there are
+ *    more than max_entries values (if max_entries>0), the least recently used values are deleted
+ *    (with free_value), except for the LRU_CACHE_MIN_ENTRIES most recent ones
+ *  - a value returned by "find" (or added by "insert") stays valid at least until the next
+ *    LRU_CACHE_MIN_ENTRIES values are inserted, i.e., a caller can keep using it while it adds the
+ *    value of its next step (as relxill_kernel does with the system parameters); values must not be
+ *    inserted with a key which is already cached, as this frees the value of the key
+ */
+const size_t LRU_CACHE_MIN_ENTRIES = 2;
 
-  explicit Cache(ModelParams model_params) : m_model_params{model_params}
-  {};
+template<typename T>
+class LruCache {
+ public:
+  typedef size_t (*SizeFunction)(const T *);
+  typedef void (*FreeFunction)(T *);
 
+  LruCache(size_t max_bytes, SizeFunction size_of, FreeFunction free_value, size_t max_entries = 0) :
+      m_max_bytes{max_bytes}, m_max_entries{max_entries}, m_size_of{size_of}, m_free_value{free_value} {
+  };
 
-  bool operator==(const Cache& _comp_cache){
-    auto parnames = m_model_params.get_parnames();
+  LruCache(const LruCache &) = delete;
+  LruCache &operator=(const LruCache &) = delete;
 
-     for(auto par=parnames.begin(); par!=parnames.cend(); ++par ) {
-       if (are_values_different( m_model_params.get_par(*par), _comp_cache.m_model_params.get_par(*par) ) == 0){
-         return false;
-       }
-     }
-     return true;
+  ~LruCache() {
+    clear();
   }
 
- private:
-  ModelParams m_model_params;
+  /** return the cached value (and mark it as the most recently used), or nullptr if not cached **/
+  T *find(const CacheKey &key) {
+    auto elem = m_index.find(key);
+    if (elem == m_index.end()) {
+      m_misses++;
+      return nullptr;
+    }
+    m_hits++;
+    m_entries.splice(m_entries.begin(), m_entries, elem->second);
+    return elem->second->value;
+  }
 
-};
+  /** add the value (the cache takes ownership of it), the key must not be cached yet (see above) **/
+  void insert(const CacheKey &key, T *value) {
+    auto elem = m_index.find(key);
+    assert(elem == m_index.end());
+    if (elem != m_index.end()) {
+      erase(elem->second);
+    }
 
-class PrimarySourceCache: Cache{
+    m_entries.push_front(Entry{key, value, m_size_of(value)});
+    m_index[key] = m_entries.begin();
+    m_num_bytes += m_entries.front().n_bytes;
 
+    while (is_over_budget() && m_entries.size() > LRU_CACHE_MIN_ENTRIES) {
+      if (is_debug_run()) {
+        printf(" DEBUG:  Cache exceeds its budget of %zu bytes or %zu values, deleting the least recently used value \n",
+               m_max_bytes, m_max_entries);
+      }
+      erase(std::prev(m_entries.end()));
+    }
+  }
 
+  void clear() {
+    for (auto &entry: m_entries) {
+      m_free_value(entry.value);
+    }
+    m_entries.clear();
+    m_index.clear();
+    m_num_bytes = 0;
+  }
 
-};
+  size_t size() const { return m_entries.size(); }
+  size_t num_bytes() const { return m_num_bytes; }
+  size_t max_bytes() const { return m_max_bytes; }
+  size_t hits() const { return m_hits; }
+  size_t misses() const { return m_misses; }
 
-class CacheStorage{
+ private:
+  struct Entry {
+    CacheKey key;
+    T *value;
+    size_t n_bytes;
+  };
+
+  std::list<Entry> m_entries;  // ordered from the most to the least recently used
+  std::unordered_map<CacheKey, typename std::list<Entry>::iterator, CacheKeyHash> m_index;
+
+  size_t m_max_bytes;
+  size_t m_max_entries;
+  size_t m_num_bytes = 0;
+  size_t m_hits = 0;
+  size_t m_misses = 0;
+
+  SizeFunction m_size_of;
+  FreeFunction m_free_value;
+
+  bool is_over_budget() const {
+    return m_num_bytes > m_max_bytes || (m_max_entries > 0 && m_entries.size() > m_max_entries);
+  }
 
- public:
+  void erase(typename std::list<Entry>::iterator entry) {
+    m_num_bytes -= entry->n_bytes;
+    m_free_value(entry->value);
+    m_index.erase(entry->key);
+    m_entries.erase(entry);
+  }
+};
 
-  CacheStorage(size_t _max_size) : max_size{_max_size}
-  {};
+/** key of the system parameters (all parameters the interpolated table and the emissivity depend on) **/
+CacheKey get_syspar_cache_key(const relParam *param);
 
-  void add(Cache _cache){
-    if (m_cache.size() > max_size){
-      m_cache.pop_front();
-    }
-    m_cache.push_back(_cache);
-  }
+/** key of the relline profile (additionally depends on the line energy, the zones and the energy grid) **/
+CacheKey get_relbase_cache_key(const relParam *param, const double *ener, int n_ener);
 
- private:
-  std::deque<Cache> m_cache;
-  size_t max_size;
-};
+/** key of the xillver parameters (all parameters compared by did_xill_param_change) **/
+CacheKey get_xill_param_cache_key(const xillParam *param);
 
- */
+// Routines to set the cached parameters
+void set_cached_xill_param(xillParam *par, xillParam **ca_xill_param, int *status);
 
+int did_rel_param_change(const relParam *cpar, const relParam *par);
 
 #endif /* RELCACHE_H_ */
@@ -0,0 +1,42 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+#include "Relcontext.h"
+#include "Relprofile.h"
+#include "Relxill.h"
+
+thread_local RelxillContext *RelxillContext::m_current = nullptr;
+
+RelxillContext *RelxillContext::global() {
+  static auto global_context = new RelxillContext;
+  return global_context;
+}
+
+RelxillContext::~RelxillContext() {
+  // the caches are freed by the modules they belong to, which act on the current context
+  RelxillContextGuard guard(this);
+  free_cache();
+  free_relprofile_cache();
+  free_relxill_output_cache();
+  free_model_cache_contexts();
+  free_specCache(spec_cache);
+}
+
+std::mutex &shared_table_mutex() {
+  static std::mutex table_mutex;
+  return table_mutex;
+}
@@ -0,0 +1,100 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+#ifndef RELCONTEXT_H_
+#define RELCONTEXT_H_
+
+#include "Relbase.h"
+
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <utility>
+
+struct RellineRadialBasis;
+
+/** all caches and scratch buffers of the model evaluation
+ *  - the models are always evaluated in the current context of the calling thread (see
+ *    RelxillContextGuard), such that different contexts can be evaluated concurrently
+ *  - threads without their own context share the global context (single threaded as before)
+ *  - the tables (relline, lamp post, xillver, returning radiation) are not part of the context,
+ *    they are loaded once and then shared read-only by all contexts (see shared_table_mutex) **/
+class RelxillContext {
+
+ public:
+  RelxillContext() = default;
+  ~RelxillContext();
+
+  RelxillContext(const RelxillContext &) = delete;
+  RelxillContext &operator=(const RelxillContext &) = delete;
+
+  /** context of the calling thread (the global context if none is set) **/
+  static RelxillContext *current() {
+    return (m_current != nullptr) ? m_current : global();
+  }
+
+  /** context of all threads without their own context (never freed, see free_cached_tables) **/
+  static RelxillContext *global();
+
+  // system parameters and relline profiles of the radii (Relprofile)
+  LruCache<RelSysPar> *cache_syspar = nullptr;
+  RelSysPar *cached_tab_sysPar = nullptr;  // rel table interpolated in the A-MU0 plane of (a, incl)
+  double cached_tab_plane_a = 0.0;
+  double cached_tab_plane_incl = 0.0;
+  int cached_tab_plane_valid = 0;
+  RellineRadialBasis *cached_relline_basis = nullptr;
+
+  // relline profiles and transforms of the convolution (Relbase)
+  LruCache<relline_spec_multizone> *cache_relbase = nullptr;
+  specCache *spec_cache = nullptr;
+  std::map<std::tuple<ModelName, int, int>, ModelCacheContext *> model_cache_contexts;
+  size_t model_cache_context_uses = 0;
+
+  // final spectra (Relxill)
+  LruCache<spectrum> *cache_output_spec = nullptr;
+
+ private:
+  friend class RelxillContextGuard;
+  static thread_local RelxillContext *m_current;
+};
+
+/** set the context of the calling thread for the lifetime of the guard (the previous one is
+ *  restored afterwards, nullptr selects the global context) **/
+class RelxillContextGuard {
+
+ public:
+  explicit RelxillContextGuard(RelxillContext *context)
+      : m_previous{RelxillContext::m_current} {
+    RelxillContext::m_current = context;
+  }
+
+  ~RelxillContextGuard() {
+    RelxillContext::m_current = m_previous;
+  }
+
+  RelxillContextGuard(const RelxillContextGuard &) = delete;
+  RelxillContextGuard &operator=(const RelxillContextGuard &) = delete;
+
+ private:
+  RelxillContext *m_previous;
+};
+
+/** lock for loading the tables and standard energy grids shared by all contexts (a table is
+ *  loaded only once, afterwards it is only read) **/
+std::mutex &shared_table_mutex();
+
+#endif //RELCONTEXT_H_
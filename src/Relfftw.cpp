@@ -0,0 +1,257 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+#include "Relfftw.h"
+
+#include <map>
+#include <string>
+#include <mutex>
+#include <tuple>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+// maximal byte offset with respect to the SIMD alignment of FFTW (at most 64 bytes for AVX512)
+#define FFTW_MAX_ALIGNMENT 64
+
+namespace {
+
+enum class FftwPlanType { R2C, C2R };
+
+// a plan is only valid for arrays of the same size, number of transforms and alignment
+typedef std::tuple<FftwPlanType, int, int, int, int> FftwPlanKey;
+
+/** the FFTW functions of the double (fftw_*) and single (fftwf_*) precision library **/
+struct FftwDouble {
+  typedef double Real;
+  typedef fftw_complex Complex;
+  typedef fftw_plan Plan;
+  static constexpr const char *wisdom_suffix = "";
+
+  static void *malloc(size_t n) { return fftw_malloc(n); }
+  static void free(void *p) { fftw_free(p); }
+  static int alignment_of(const void *p) { return fftw_alignment_of((double *) p); }
+  static Plan plan_many_r2c(int *n, int howmany, Real *in, int idist, Complex *out, int odist, unsigned flags) {
+    return fftw_plan_many_dft_r2c(1, n, howmany, in, nullptr, 1, idist, out, nullptr, 1, odist, flags);
+  }
+  static Plan plan_many_c2r(int *n, int howmany, Complex *in, int idist, Real *out, int odist, unsigned flags) {
+    return fftw_plan_many_dft_c2r(1, n, howmany, in, nullptr, 1, idist, out, nullptr, 1, odist, flags);
+  }
+  static void destroy_plan(Plan plan) { fftw_destroy_plan(plan); }
+  static int import_wisdom(const char *fname) { return fftw_import_wisdom_from_filename(fname); }
+  static int export_wisdom(const char *fname) { return fftw_export_wisdom_to_filename(fname); }
+};
+
+#ifdef RELXILL_FFTW_FLOAT
+struct FftwFloat {
+  typedef float Real;
+  typedef fftwf_complex Complex;
+  typedef fftwf_plan Plan;
+  static constexpr const char *wisdom_suffix = "_float";  // wisdom is specific to the precision
+
+  static void *malloc(size_t n) { return fftwf_malloc(n); }
+  static void free(void *p) { fftwf_free(p); }
+  static int alignment_of(const void *p) { return fftwf_alignment_of((float *) p); }
+  static Plan plan_many_r2c(int *n, int howmany, Real *in, int idist, Complex *out, int odist, unsigned flags) {
+    return fftwf_plan_many_dft_r2c(1, n, howmany, in, nullptr, 1, idist, out, nullptr, 1, odist, flags);
+  }
+  static Plan plan_many_c2r(int *n, int howmany, Complex *in, int idist, Real *out, int odist, unsigned flags) {
+    return fftwf_plan_many_dft_c2r(1, n, howmany, in, nullptr, 1, idist, out, nullptr, 1, odist, flags);
+  }
+  static void destroy_plan(Plan plan) { fftwf_destroy_plan(plan); }
+  static int import_wisdom(const char *fname) { return fftwf_import_wisdom_from_filename(fname); }
+  static int export_wisdom(const char *fname) { return fftwf_export_wisdom_to_filename(fname); }
+};
+#endif
+
+template<typename Fftw>
+struct FftwPlanCache {
+  std::map<FftwPlanKey, typename Fftw::Plan> plans;
+  int wisdom_imported = 0;
+};
+
+FftwPlanCache<FftwDouble> cached_fftw_plans;
+#ifdef RELXILL_FFTW_FLOAT
+FftwPlanCache<FftwFloat> cached_fftwf_plans;
+#endif
+
+// planning in FFTW is not thread-safe, only the execution of plans is
+std::mutex fftw_planner_mutex;
+
+}
+
+/** name of the wisdom file for the given precision (empty if not set) **/
+template<typename Fftw>
+static std::string get_fftw_wisdom_filename() {
+  const char *env = getenv(ENV_FFTW_WISDOM);
+  return (env == nullptr) ? std::string() : std::string(env) + Fftw::wisdom_suffix;
+}
+
+unsigned get_fftw_planner_flag() {
+  const char *env = getenv(ENV_FFTW_PLANNER);
+  if (env == nullptr || strcmp(env, "measure") == 0) {
+    return FFTW_MEASURE;
+  } else if (strcmp(env, "estimate") == 0) {
+    return FFTW_ESTIMATE;
+  } else if (strcmp(env, "patient") == 0) {
+    return FFTW_PATIENT;
+  } else if (strcmp(env, "exhaustive") == 0) {
+    return FFTW_EXHAUSTIVE;
+  }
+
+  printf(" *** warning: unknown value '%s' of %s, using 'measure' instead \n", env, ENV_FFTW_PLANNER);
+  return FFTW_MEASURE;
+}
+
+template<typename Fftw>
+static void import_fftw_wisdom(FftwPlanCache<Fftw> &cache) {
+  if (cache.wisdom_imported) {
+    return;
+  }
+  cache.wisdom_imported = 1;
+
+  std::string fname = get_fftw_wisdom_filename<Fftw>();
+  if (!fname.empty() && Fftw::import_wisdom(fname.c_str()) && is_debug_run()) {
+    printf(" DEBUG:  imported FFTW wisdom from %s \n", fname.c_str());
+  }
+}
+
+template<typename Fftw>
+static void export_fftw_wisdom() {
+  std::string fname = get_fftw_wisdom_filename<Fftw>();
+  if (!fname.empty() && !Fftw::export_wisdom(fname.c_str())) {
+    printf(" *** warning: could not write FFTW wisdom to %s \n", fname.c_str());
+  }
+}
+
+/** create a new plan on scratch arrays, as planning with anything else than FFTW_ESTIMATE
+ *  overwrites the input and output arrays; the scratch arrays are shifted to the given
+ *  alignment such that the plan can be executed on the original arrays */
+template<typename Fftw>
+static typename Fftw::Plan create_fftw_plan(FftwPlanType type, int n, int howmany, int align_in, int align_out,
+                                            int *status) {
+
+  typedef typename Fftw::Real Real;
+  typedef typename Fftw::Complex Complex;
+
+  // real arrays have n elements, the complex ones n/2+1 (we allocate both a bit larger to shift them)
+  const int n_freq = n / 2 + 1;
+  size_t n_bytes_real = howmany * n * sizeof(Real) + FFTW_MAX_ALIGNMENT;
+  size_t n_bytes_complex = howmany * n_freq * sizeof(Complex) + FFTW_MAX_ALIGNMENT;
+
+  char *scratch_in = (char *) Fftw::malloc((type == FftwPlanType::R2C) ? n_bytes_real : n_bytes_complex);
+  char *scratch_out = (char *) Fftw::malloc((type == FftwPlanType::R2C) ? n_bytes_complex : n_bytes_real);
+  if (scratch_in == nullptr || scratch_out == nullptr) {
+    RELXILL_ERROR("memory allocation for planning the FFT failed", status);
+    Fftw::free(scratch_in);
+    Fftw::free(scratch_out);
+    return nullptr;
+  }
+
+  unsigned flags = get_fftw_planner_flag();
+  typename Fftw::Plan plan;
+  if (type == FftwPlanType::R2C) {
+    plan = Fftw::plan_many_r2c(&n, howmany, (Real *) (scratch_in + align_in), n,
+                               (Complex *) (scratch_out + align_out), n_freq, flags);
+  } else {
+    plan = Fftw::plan_many_c2r(&n, howmany, (Complex *) (scratch_in + align_in), n_freq,
+                               (Real *) (scratch_out + align_out), n, flags);
+  }
+
+  Fftw::free(scratch_in);
+  Fftw::free(scratch_out);
+
+  if (plan == nullptr) {
+    RELXILL_ERROR("creating the FFTW plan failed", status);
+  }
+  return plan;
+}
+
+template<typename Fftw>
+static typename Fftw::Plan get_fftw_plan(FftwPlanCache<Fftw> &cache, FftwPlanType type, int n, int howmany,
+                                         const void *in, const void *out, int *status) {
+
+  CHECK_STATUS_RET(*status, nullptr);
+
+  int align_in = Fftw::alignment_of(in);
+  int align_out = Fftw::alignment_of(out);
+  auto key = std::make_tuple(type, n, howmany, align_in, align_out);
+
+  std::lock_guard<std::mutex> lock(fftw_planner_mutex);
+
+  auto cached = cache.plans.find(key);
+  if (cached != cache.plans.end()) {
+    return cached->second;
+  }
+
+  import_fftw_wisdom(cache);
+
+  typename Fftw::Plan plan = create_fftw_plan<Fftw>(type, n, howmany, align_in, align_out, status);
+  CHECK_STATUS_RET(*status, nullptr);
+
+  cache.plans[key] = plan;
+  export_fftw_wisdom<Fftw>();
+
+  if (is_debug_run()) {
+    printf(" DEBUG:  created new FFTW plan (n=%i, howmany=%i, %zu bytes per value), the plan cache contains %zu plans \n",
+           n, howmany, sizeof(typename Fftw::Real), cache.plans.size());
+  }
+
+  return plan;
+}
+
+template<typename Fftw>
+static void free_fftw_plans(FftwPlanCache<Fftw> &cache) {
+  for (auto &elem: cache.plans) {
+    Fftw::destroy_plan(elem.second);
+  }
+  cache.plans.clear();
+}
+
+fftw_plan get_fftw_plan_r2c(int n, const double *in, const fftw_complex *out, int *status) {
+  return get_fftw_plan(cached_fftw_plans, FftwPlanType::R2C, n, 1, in, out, status);
+}
+
+fftw_plan get_fftw_plan_c2r(int n, const fftw_complex *in, const double *out, int *status) {
+  return get_fftw_plan(cached_fftw_plans, FftwPlanType::C2R, n, 1, in, out, status);
+}
+
+fftw_plan get_fftw_plan_many_r2c(int n, int howmany, const double *in, const fftw_complex *out, int *status) {
+  return get_fftw_plan(cached_fftw_plans, FftwPlanType::R2C, n, howmany, in, out, status);
+}
+
+fftw_plan get_fftw_plan_many_c2r(int n, int howmany, const fftw_complex *in, const double *out, int *status) {
+  return get_fftw_plan(cached_fftw_plans, FftwPlanType::C2R, n, howmany, in, out, status);
+}
+
+#ifdef RELXILL_FFTW_FLOAT
+fftwf_plan get_fftwf_plan_many_r2c(int n, int howmany, const float *in, const fftwf_complex *out, int *status) {
+  return get_fftw_plan(cached_fftwf_plans, FftwPlanType::R2C, n, howmany, in, out, status);
+}
+
+fftwf_plan get_fftwf_plan_many_c2r(int n, int howmany, const fftwf_complex *in, const float *out, int *status) {
+  return get_fftw_plan(cached_fftwf_plans, FftwPlanType::C2R, n, howmany, in, out, status);
+}
+#endif
+
+void free_fftw_plan_cache() {
+  std::lock_guard<std::mutex> lock(fftw_planner_mutex);
+  free_fftw_plans(cached_fftw_plans);
+#ifdef RELXILL_FFTW_FLOAT
+  free_fftw_plans(cached_fftwf_plans);
+#endif
+}
@@ -0,0 +1,66 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+#ifndef RELFFTW_H_
+#define RELFFTW_H_
+
+extern "C" {
+#include <fftw3.h>   // assumes installation in heasoft
+#include "config.h"
+#include "relutility.h"
+}
+
+/** environment variables to configure the FFTW planning
+ *  - RELXILL_FFTW_PLANNER: "estimate", "measure" (default), "patient" or "exhaustive"
+ *  - RELXILL_FFTW_WISDOM:  file from which wisdom is imported and to which new wisdom is exported
+ *                          (with the suffix "_float" for the single precision plans)
+ */
+#define ENV_FFTW_PLANNER "RELXILL_FFTW_PLANNER"
+#define ENV_FFTW_WISDOM "RELXILL_FFTW_WISDOM"
+
+/** planner flag as set by the environment (default FFTW_MEASURE) **/
+unsigned get_fftw_planner_flag();
+
+/** get a plan for a real-to-complex transform of length n from the plan cache
+ *  - the plan is created once for every transform size and memory alignment of the arrays
+ *  - it has to be executed with fftw_execute_dft_r2c(plan, in, out), so it can be used for any
+ *    arrays with the same alignment as "in" and "out" (the arrays are not touched for planning) */
+fftw_plan get_fftw_plan_r2c(int n, const double *in, const fftw_complex *out, int *status);
+
+/** get a plan for a complex-to-real transform of length n from the plan cache
+ *  (to be executed with fftw_execute_dft_c2r, see get_fftw_plan_r2c) */
+fftw_plan get_fftw_plan_c2r(int n, const fftw_complex *in, const double *out, int *status);
+
+/** get a plan for "howmany" real-to-complex transforms of length n at once, where the input arrays
+ *  are stored contiguously in "in" (distance n) and the outputs in "out" (distance n/2+1) **/
+fftw_plan get_fftw_plan_many_r2c(int n, int howmany, const double *in, const fftw_complex *out, int *status);
+
+/** get a plan for "howmany" complex-to-real transforms of length n at once (the inverse of
+ *  get_fftw_plan_many_r2c, i.e., with input distance n/2+1 and output distance n) **/
+fftw_plan get_fftw_plan_many_c2r(int n, int howmany, const fftw_complex *in, const double *out, int *status);
+
+#ifdef RELXILL_FFTW_FLOAT
+/** single precision versions of get_fftw_plan_many_r2c and get_fftw_plan_many_c2r (only available if
+ *  compiled with the cmake option RELXILL_FFTW_FLOAT, as it needs the fftw3f library) **/
+fftwf_plan get_fftwf_plan_many_r2c(int n, int howmany, const float *in, const fftwf_complex *out, int *status);
+fftwf_plan get_fftwf_plan_many_c2r(int n, int howmany, const fftwf_complex *in, const float *out, int *status);
+#endif
+
+/** destroy all cached plans (the plans handed out before are invalid afterwards) **/
+void free_fftw_plan_cache();
+
+#endif //RELFFTW_H_
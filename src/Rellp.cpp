@@ -18,6 +18,7 @@
 
 #include "Rellp.h"
 #include "Relphysics.h"
+#include "Relcontext.h"
 
 extern "C" {
 #include "writeOutfiles.h"
@@ -405,6 +406,7 @@ void calc_emis_jet_extended(emisProfile *emisProf,
 static lpTable* get_lp_table(int* status){
   CHECK_STATUS_RET(*status,nullptr);
 
+  std::lock_guard<std::mutex> lock(shared_table_mutex());
   if (cached_lp_table == nullptr) {
     read_lp_table(LPTABLE_FILENAME, &cached_lp_table, status);
     CHECK_STATUS_RET(*status, nullptr);
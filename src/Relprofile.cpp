@@ -19,6 +19,12 @@
 #include "Relcache.h"
 #include "Rellp.h"
 #include "Relphysics.h"
+#include "Relthreads.h"
+#include "Relsimd.h"
+#include "Relcontext.h"
+
+#include <vector>
+#include <algorithm>
 
 extern "C" {
 #include "relutility.h"
@@ -26,15 +32,20 @@ extern "C" {
 #include "reltable.h"
 }
 
-cnode *cache_syspar = nullptr;
-
-/** global parameters, which can be used for several calls of the model */
+// the rel table is shared by all contexts (the caches of the system parameters are in RelxillContext)
 relTable *ptr_rellineTable = nullptr;
-RelSysPar *cached_tab_sysPar = nullptr;
 
 // precision to calculate gstar from [H:1-H] instead of [0:1]
 const double GFAC_H = 5e-3;
 
+// number of intervals in theta (g* = sin^2(theta)) per g* bin for the cumulative integral of the relline profile
+const int N_THETA_CDF = 16;
+// number of radii which are tabulated together for the cumulative integral
+const int N_RADII_BLOCK_CDF = 64;
+
+// alignment (in bytes) of the transfer function and cosne of the system parameters
+const size_t SYSPAR_SLAB_ALIGNMENT = 64;
+
 // interpolate the table in the A-MU0 plane (for one value of radius)
 static void interpol_a_mu0(int ii, double ifac_a, double ifac_mu0, int ind_a,
                            int ind_mu0, RelSysPar *sysPar, relTable *reltab) {
@@ -50,35 +61,47 @@ static void interpol_a_mu0(int ii, double ifac_a, double ifac_mu0, int ind_a,
                                          reltab->arr[ind_a][ind_mu0 + 1]->gmax[ii],
                                          reltab->arr[ind_a + 1][ind_mu0 + 1]->gmax[ii]);
 
+  double *trff[2] = {get_syspar_trff(sysPar, 0, ii), get_syspar_trff(sysPar, 1, ii)};
+  double *cosne[2] = {get_syspar_cosne(sysPar, 0, ii), get_syspar_cosne(sysPar, 1, ii)};
+
   int jj;
   for (jj = 0; jj < reltab->n_g; jj++) {
-    sysPar->trff[ii][jj][0] = interp_lin_2d_float(ifac_a, ifac_mu0,
-                                                  reltab->arr[ind_a][ind_mu0]->trff1[ii][jj],
-                                                  reltab->arr[ind_a + 1][ind_mu0]->trff1[ii][jj],
-                                                  reltab->arr[ind_a][ind_mu0 + 1]->trff1[ii][jj],
-                                                  reltab->arr[ind_a + 1][ind_mu0 + 1]->trff1[ii][jj]);
-
-    sysPar->trff[ii][jj][1] = interp_lin_2d_float(ifac_a, ifac_mu0,
-                                                  reltab->arr[ind_a][ind_mu0]->trff2[ii][jj],
-                                                  reltab->arr[ind_a + 1][ind_mu0]->trff2[ii][jj],
-                                                  reltab->arr[ind_a][ind_mu0 + 1]->trff2[ii][jj],
-                                                  reltab->arr[ind_a + 1][ind_mu0 + 1]->trff2[ii][jj]);
-
-    sysPar->cosne[ii][jj][0] = interp_lin_2d_float(ifac_a, ifac_mu0,
-                                                   reltab->arr[ind_a][ind_mu0]->cosne1[ii][jj],
-                                                   reltab->arr[ind_a + 1][ind_mu0]->cosne1[ii][jj],
-                                                   reltab->arr[ind_a][ind_mu0 + 1]->cosne1[ii][jj],
-                                                   reltab->arr[ind_a + 1][ind_mu0 + 1]->cosne1[ii][jj]);
-
-    sysPar->cosne[ii][jj][1] = interp_lin_2d_float(ifac_a, ifac_mu0,
-                                                   reltab->arr[ind_a][ind_mu0]->cosne2[ii][jj],
-                                                   reltab->arr[ind_a + 1][ind_mu0]->cosne2[ii][jj],
-                                                   reltab->arr[ind_a][ind_mu0 + 1]->cosne2[ii][jj],
-                                                   reltab->arr[ind_a + 1][ind_mu0 + 1]->cosne2[ii][jj]);
+    trff[0][jj] = interp_lin_2d_float(ifac_a, ifac_mu0,
+                                      reltab->arr[ind_a][ind_mu0]->trff1[ii][jj],
+                                      reltab->arr[ind_a + 1][ind_mu0]->trff1[ii][jj],
+                                      reltab->arr[ind_a][ind_mu0 + 1]->trff1[ii][jj],
+                                      reltab->arr[ind_a + 1][ind_mu0 + 1]->trff1[ii][jj]);
+
+    trff[1][jj] = interp_lin_2d_float(ifac_a, ifac_mu0,
+                                      reltab->arr[ind_a][ind_mu0]->trff2[ii][jj],
+                                      reltab->arr[ind_a + 1][ind_mu0]->trff2[ii][jj],
+                                      reltab->arr[ind_a][ind_mu0 + 1]->trff2[ii][jj],
+                                      reltab->arr[ind_a + 1][ind_mu0 + 1]->trff2[ii][jj]);
+
+    cosne[0][jj] = interp_lin_2d_float(ifac_a, ifac_mu0,
+                                       reltab->arr[ind_a][ind_mu0]->cosne1[ii][jj],
+                                       reltab->arr[ind_a + 1][ind_mu0]->cosne1[ii][jj],
+                                       reltab->arr[ind_a][ind_mu0 + 1]->cosne1[ii][jj],
+                                       reltab->arr[ind_a + 1][ind_mu0 + 1]->cosne1[ii][jj]);
+
+    cosne[1][jj] = interp_lin_2d_float(ifac_a, ifac_mu0,
+                                       reltab->arr[ind_a][ind_mu0]->cosne2[ii][jj],
+                                       reltab->arr[ind_a + 1][ind_mu0]->cosne2[ii][jj],
+                                       reltab->arr[ind_a][ind_mu0 + 1]->cosne2[ii][jj],
+                                       reltab->arr[ind_a + 1][ind_mu0 + 1]->cosne2[ii][jj]);
 
   }
 }
 
+/** allocate an array of n doubles, aligned to the cache lines (to be freed with free) **/
+static double *new_aligned_slab(size_t n, int *status) {
+  size_t n_bytes = n * sizeof(double);
+  n_bytes = (n_bytes + SYSPAR_SLAB_ALIGNMENT - 1) / SYSPAR_SLAB_ALIGNMENT * SYSPAR_SLAB_ALIGNMENT;
+  auto *slab = (double *) aligned_alloc(SYSPAR_SLAB_ALIGNMENT, n_bytes);
+  CHECK_MALLOC_RET_STATUS(slab, status, nullptr)
+  return slab;
+}
+
 RelSysPar *new_relSysPar(int nr, int ng, int *status) {
   auto *sysPar = (RelSysPar *) malloc(sizeof(RelSysPar));
   CHECK_MALLOC_RET_STATUS(sysPar, status, nullptr)
@@ -86,6 +109,16 @@ RelSysPar *new_relSysPar(int nr, int ng, int *status) {
   sysPar->ng = ng;
   sysPar->nr = nr;
 
+  // all pointers are set first, such that a partially allocated structure can be freed
+  sysPar->re = nullptr;
+  sysPar->gmin = nullptr;
+  sysPar->gmax = nullptr;
+  sysPar->gstar = nullptr;
+  sysPar->d_gstar = nullptr;
+  sysPar->emis = nullptr;
+  sysPar->trff = nullptr;
+  sysPar->cosne = nullptr;
+
   sysPar->re = (double *) malloc(nr * sizeof(double));
   CHECK_MALLOC_RET_STATUS(sysPar->re, status, sysPar)
   sysPar->gmin = (double *) malloc(nr * sizeof(double));
@@ -93,20 +126,17 @@ RelSysPar *new_relSysPar(int nr, int ng, int *status) {
   sysPar->gmax = (double *) malloc(nr * sizeof(double));
   CHECK_MALLOC_RET_STATUS(sysPar->gmax, status, sysPar)
 
-  sysPar->emis = nullptr;
-
   sysPar->gstar = (double *) malloc(ng * sizeof(double));
   CHECK_MALLOC_RET_STATUS(sysPar->gstar, status, sysPar)
 
   // we already set the values as they are fixed
   int ii;
-  int jj;
   for (ii = 0; ii < ng; ii++) {
     sysPar->gstar[ii] = GFAC_H + (1.0 - 2 * GFAC_H) / (ng - 1) * ((float) (ii));
   }
 
   sysPar->d_gstar = (double *) malloc(ng * sizeof(double));
-  CHECK_MALLOC_RET_STATUS(sysPar->gstar, status, sysPar)
+  CHECK_MALLOC_RET_STATUS(sysPar->d_gstar, status, sysPar)
   for (ii = 0; ii < ng; ii++) {
     if ((ii == 0) || (ii == (ng - 1))) {
       sysPar->d_gstar[ii] = 0.5 * (sysPar->gstar[1] - sysPar->gstar[0]) + GFAC_H;
@@ -115,58 +145,62 @@ RelSysPar *new_relSysPar(int nr, int ng, int *status) {
     }
   }
 
-  sysPar->trff = (double ***) malloc(nr * sizeof(double **));
-  CHECK_MALLOC_RET_STATUS(sysPar->trff, status, sysPar)
-  sysPar->cosne = (double ***) malloc(nr * sizeof(double **));
-  CHECK_MALLOC_RET_STATUS(sysPar->cosne, status, sysPar)
-  for (ii = 0; ii < nr; ii++) {
-    sysPar->trff[ii] = (double **) malloc(ng * sizeof(double *));
-    CHECK_MALLOC_RET_STATUS(sysPar->trff[ii], status, sysPar)
-    sysPar->cosne[ii] = (double **) malloc(ng * sizeof(double *));
-    CHECK_MALLOC_RET_STATUS(sysPar->cosne[ii], status, sysPar)
-    for (jj = 0; jj < ng; jj++) {
-      sysPar->trff[ii][jj] = (double *) malloc(2 * sizeof(double));
-      CHECK_MALLOC_RET_STATUS(sysPar->trff[ii][jj], status, sysPar)
-      sysPar->cosne[ii][jj] = (double *) malloc(2 * sizeof(double));
-      CHECK_MALLOC_RET_STATUS(sysPar->cosne[ii][jj], status, sysPar)
-    }
-  }
+  // the transfer function and cosne are stored contiguously as [k][r][g] (see get_syspar_trff)
+  sysPar->trff = new_aligned_slab(2 * (size_t) nr * ng, status);
+  CHECK_STATUS_RET(*status, sysPar);
+  sysPar->cosne = new_aligned_slab(2 * (size_t) nr * ng, status);
+  CHECK_STATUS_RET(*status, sysPar);
 
   sysPar->limb_law = 0;
 
   return sysPar;
 }
 
-/* function interpolating the rel table values for rin,rout,mu0,incl   */
-static RelSysPar *interpol_relTable(double a, double incl, double rin, double rout,
-                                    int *status) {
+/** the rel table (loaded once and then shared read-only by all contexts) **/
+static relTable *get_relline_table(int *status) {
+  CHECK_STATUS_RET(*status, nullptr);
 
-  // load tables
+  std::lock_guard<std::mutex> lock(shared_table_mutex());
   if (ptr_rellineTable == nullptr) {
     print_version_number();
     read_relline_table(RELTABLE_FILENAME, &ptr_rellineTable, status);
     CHECK_STATUS_RET(*status, nullptr);
   }
-  relTable *tab = ptr_rellineTable;
-  assert(tab != nullptr);
+  return ptr_rellineTable;
+}
 
-  double rms = kerr_rms(a);
+/** interpolate all radii of the rel table in the A-MU0 plane (stored in cached_tab_sysPar of the context)
+ *  - the plane only depends on (a, incl), so it is re-used as long as those do not change and
+ *    a change of rin or rout only needs the rebinning to the fine grid */
+static RelSysPar *get_a_mu0_plane(double a, double incl, int *status) {
 
-  // make sure the desired rmin is within bounds and order correctly
-  assert(rout > rin);
-  assert(rin >= rms);
+  CHECK_STATUS_RET(*status, nullptr);
 
-  double mu0 = cos(incl);
+  // load tables
+  relTable *tab = get_relline_table(status);
+  CHECK_STATUS_RET(*status, nullptr);
+  assert(tab != nullptr);
 
-  /**************************************/
-  /** 1 **  Interpolate in A-MU0 plane **/
-  /**************************************/
+  RelxillContext *context = RelxillContext::current();
 
   // get a structure to store the values from the interpolation in the A-MU0-plane
-  if (cached_tab_sysPar == nullptr) {
-    cached_tab_sysPar = new_relSysPar(tab->n_r, tab->n_g, status);
+  if (context->cached_tab_sysPar == nullptr) {
+    context->cached_tab_sysPar = new_relSysPar(tab->n_r, tab->n_g, status);
     CHECK_STATUS_RET(*status, nullptr);
+    context->cached_tab_plane_valid = 0;
+  }
+  RelSysPar *cached_tab_sysPar = context->cached_tab_sysPar;
+
+  // exact comparison, such that the result is identical to a new interpolation
+  if (context->cached_tab_plane_valid && context->cached_tab_plane_a == a && context->cached_tab_plane_incl == incl) {
+    if (is_debug_run()) {
+      printf(" DEBUG:  re-using the A-MU0 plane of the rel table (a=%.4f, incl=%.4f) \n", a, incl);
+    }
+    return cached_tab_sysPar;
   }
+  context->cached_tab_plane_valid = 0;
+
+  double mu0 = cos(incl);
 
   int ind_a = binary_search_float(tab->a, tab->n_a, (float) a);
   int ind_mu0 = binary_search_float(tab->mu0, tab->n_mu0, (float) mu0);
@@ -194,63 +228,104 @@ static RelSysPar *interpol_relTable(double a, double incl, double rin, double ro
   // we have problems for the intermost radius due to linear interpolation (-> set to RISCO)
   if ((cached_tab_sysPar->re[tab->n_r - 1] > kerr_rms(a)) &&
       ((cached_tab_sysPar->re[tab->n_r - 1] - kerr_rms(a)) / cached_tab_sysPar->re[tab->n_r - 1] < 1e-3)) {
-    //		printf(" re-setting RIN from %.3f to %.3f (dr = %.2e)\n",cached_tab_sysPar->re[tab->n_r-1],kerr_rms(a),
-    //		(cached_tab_sysPar->re[tab->n_r-1]-kerr_rms(a))/cached_tab_sysPar->re[tab->n_r-1]);
     cached_tab_sysPar->re[tab->n_r - 1] = kerr_rms(a);
   }
 
-  // get the extent of the disk (indices are defined such that tab->r[ind+1] <= r < tab->r[ind]
-  int ind_rmin = inv_binary_search(cached_tab_sysPar->re, tab->n_r, rin);
-  int ind_rmax = inv_binary_search(cached_tab_sysPar->re, tab->n_r, rout);
-
-  int jj;
-  int kk;
+  /** we do not have rmax=1000.0 in the table, but just values close to it so let's do this trick**/
+  double rmax = 1000.0;
   for (ii = 0; ii < tab->n_r; ii++) {
-    // TODO: SHOULD WE ONLY INTERPOLATE ONLY THE VALUES WE NEED??? //
-    // only interpolate values where we need them (radius is defined invers!)
-    if (ii <= ind_rmin || ii >= ind_rmax + 1) {
-      interpol_a_mu0(ii, ifac_a, ifac_mu0, ind_a, ind_mu0, cached_tab_sysPar, tab);
-    } else {  // set everything we won't need to 0 (just to be sure)
-      cached_tab_sysPar->gmin[ii] = 0.0;
-      cached_tab_sysPar->gmax[ii] = 0.0;
-      for (jj = 0; jj < tab->n_g; jj++) {
-        for (kk = 0; kk < 2; kk++) {
-          cached_tab_sysPar->trff[ii][jj][kk] = 0.0;
-          cached_tab_sysPar->cosne[ii][jj][kk] = 0.0;
-        }
-      }
+    if (cached_tab_sysPar->re[ii] < rmax && cached_tab_sysPar->re[ii] * 1.01 > rmax) {
+      cached_tab_sysPar->re[ii] = rmax;
     }
   }
 
+  // all radii are interpolated, as any of them might be needed for the next rin and rout
+  for (ii = 0; ii < tab->n_r; ii++) {
+    interpol_a_mu0(ii, ifac_a, ifac_mu0, ind_a, ind_mu0, cached_tab_sysPar, tab);
+  }
+
+  context->cached_tab_plane_a = a;
+  context->cached_tab_plane_incl = incl;
+  context->cached_tab_plane_valid = 1;
+
+  return cached_tab_sysPar;
+}
+
+#ifdef RELXILL_SIMD
+/** SIMD lanes of interp_lin_1d_array, returns the number of values which are interpolated **/
+RELXILL_SIMD_TARGET static int interp_lin_1d_array_simd(double ifac, const double *lo, const double *hi,
+                                                        double *res, int n) {
+  const simd_double v_ifac = simd_set1(ifac);
+  const simd_double v_ifac1 = simd_set1(1.0 - ifac);
+  int jj = 0;
+  for (; jj + SIMD_DOUBLE_LANES <= n; jj += SIMD_DOUBLE_LANES) {
+    simd_store(res + jj, simd_add(simd_mul(v_ifac, simd_load(hi + jj)), simd_mul(v_ifac1, simd_load(lo + jj))));
+  }
+  return jj;
+}
+#endif
+
+/** linear interpolation of n values between the arrays lo and hi, exactly as interp_lin_1d
+ *  (the values of the g-grid are contiguous, so they are interpolated in SIMD lanes) */
+static void interp_lin_1d_array(double ifac, const double *lo, const double *hi, double *res, int n) {
+  int jj = 0;
+#ifdef RELXILL_SIMD
+  if (use_simd_lanes()) {
+    jj = interp_lin_1d_array_simd(ifac, lo, hi, res, n);
+  }
+#endif
+  for (; jj < n; jj++) {
+    res[jj] = interp_lin_1d(ifac, lo[jj], hi[jj]);
+  }
+}
+
+/* function interpolating the rel table values for rin,rout,mu0,incl   */
+static RelSysPar *interpol_relTable(double a, double incl, double rin, double rout,
+                                    int *status) {
+
+  double rms = kerr_rms(a);
+
+  // make sure the desired rmin is within bounds and order correctly
+  assert(rout > rin);
+  assert(rin >= rms);
+
+  /**************************************/
+  /** 1 **  Interpolate in A-MU0 plane **/
+  /**************************************/
+
+  RelSysPar *tab_sysPar = get_a_mu0_plane(a, incl, status);
+  CHECK_STATUS_RET(*status, nullptr);
+  int n_tab_r = tab_sysPar->nr;
+
+  // get the extent of the disk (indices are defined such that tab->r[ind+1] <= r < tab->r[ind]
+  int ind_rmin = inv_binary_search(tab_sysPar->re, n_tab_r, rin);
+  int ind_rmax = inv_binary_search(tab_sysPar->re, n_tab_r, rout);
+
   /****************************/
   /** 2 **  Bin to Fine Grid **/
   /****************************/
 
   //  need to initialize and allocate memory
-  RelSysPar *sysPar = new_relSysPar(N_FRAD, tab->n_g, status);
+  RelSysPar *sysPar = new_relSysPar(N_FRAD, tab_sysPar->ng, status);
   CHECK_STATUS_RET(*status, nullptr);
   get_fine_radial_grid(rin, rout, sysPar->re, sysPar->nr);
 
-  /** we do not have rmax=1000.0 in the table, but just values close to it so let's do this trick**/
-  double rmax = 1000.0;
-  if (cached_tab_sysPar->re[ind_rmax] < rmax && cached_tab_sysPar->re[ind_rmax] * 1.01 > rmax) {
-    cached_tab_sysPar->re[ind_rmax] = rmax;
-  }
-
   // let's try to be as efficient as possible here (note that "r" DEcreases)
   assert(ind_rmin > 0); // as defined inverse, re[ind_rmin+1] is the lowest value
-  assert((cached_tab_sysPar->re[ind_rmin + 1] <= rin));
-  assert((cached_tab_sysPar->re[ind_rmin] >= rin));
-  assert((cached_tab_sysPar->re[ind_rmax + 1] <= rout));
-  assert((cached_tab_sysPar->re[ind_rmax] >= rout));
+  assert((tab_sysPar->re[ind_rmin + 1] <= rin));
+  assert((tab_sysPar->re[ind_rmin] >= rin));
+  assert((tab_sysPar->re[ind_rmax + 1] <= rout));
+  assert((tab_sysPar->re[ind_rmax] >= rout));
   assert(ind_rmax <= ind_rmin);
   assert(rout <= 1000.0);
 
-  double ifac_r;
+  // first find the interpolation index and factor of every radius of the fine grid ...
+  std::vector<int> ind_r(sysPar->nr);
+  std::vector<double> ifac_r(sysPar->nr);
   int ind_tabr = ind_rmin;
-
+  int ii;
   for (ii = sysPar->nr - 1; ii >= 0; ii--) {
-    while ((sysPar->re[ii] >= cached_tab_sysPar->re[ind_tabr])) {
+    while ((sysPar->re[ii] >= tab_sysPar->re[ind_tabr])) {
       ind_tabr--;
       if (ind_tabr < 0) { //TODO: construct table such that we don't need this?
         if (sysPar->re[ii] - RELTABLE_MAX_R <= 1e-6) {
@@ -260,100 +335,114 @@ static RelSysPar *interpol_relTable(double a, double incl, double rin, double ro
           RELXILL_ERROR("interpolation of rel_table on fine radial grid failed due to corrupted grid", status);
           printf("   --> radius %.4e ABOVE the maximal possible radius of %.4e \n",
                  sysPar->re[ii], RELTABLE_MAX_R);
-          CHECK_STATUS_RET(*status, nullptr);
+          free_relSysPar(sysPar);
+          return nullptr;
         }
       }
     }
 
-    ifac_r = (sysPar->re[ii] - cached_tab_sysPar->re[ind_tabr + 1])
-        / (cached_tab_sysPar->re[ind_tabr] - cached_tab_sysPar->re[ind_tabr + 1]);
-    // assert(ifac_r>=0.0);
+    ind_r[ii] = ind_tabr;
+    ifac_r[ii] = (sysPar->re[ii] - tab_sysPar->re[ind_tabr + 1])
+        / (tab_sysPar->re[ind_tabr] - tab_sysPar->re[ind_tabr + 1]);
 
     // we only allow extrapolation (i.e. ifac_r < 0) for the last bin
-    if (ifac_r > 1.0 && ind_tabr > 0) {
+    if (ifac_r[ii] > 1.0 && ind_tabr > 0) {
       RELXILL_ERROR("interpolation of rel_table on fine radial grid failed due to corrupted grid", status);
       printf("   --> radius %.4e not found in [%.4e,%.4e]  \n",
-             sysPar->re[ii], cached_tab_sysPar->re[ind_tabr + 1], cached_tab_sysPar->re[ind_tabr]);
-      CHECK_STATUS_RET(*status, nullptr);
+             sysPar->re[ii], tab_sysPar->re[ind_tabr + 1], tab_sysPar->re[ind_tabr]);
+      free_relSysPar(sysPar);
+      return nullptr;
     }
 
-    for (jj = 0; jj < sysPar->ng; jj++) {
-      for (kk = 0; kk < 2; kk++) {
-        sysPar->trff[ii][jj][kk] =
-            interp_lin_1d(ifac_r,
-                          cached_tab_sysPar->trff[ind_tabr + 1][jj][kk],
-                          cached_tab_sysPar->trff[ind_tabr][jj][kk]);
-
-        sysPar->cosne[ii][jj][kk] =
-            interp_lin_1d(ifac_r,
-                          cached_tab_sysPar->cosne[ind_tabr + 1][jj][kk],
-                          cached_tab_sysPar->cosne[ind_tabr][jj][kk]);
+    sysPar->gmin[ii] = interp_lin_1d(ifac_r[ii], tab_sysPar->gmin[ind_tabr + 1], tab_sysPar->gmin[ind_tabr]);
+    sysPar->gmax[ii] = interp_lin_1d(ifac_r[ii], tab_sysPar->gmax[ind_tabr + 1], tab_sysPar->gmax[ind_tabr]);
+  }
 
-      }
+  // ... and then resample the transfer function and cosne, which are contiguous in g
+  for (int kk = 0; kk < 2; kk++) {
+    for (ii = 0; ii < sysPar->nr; ii++) {
+      interp_lin_1d_array(ifac_r[ii],
+                          get_syspar_trff(tab_sysPar, kk, ind_r[ii] + 1), get_syspar_trff(tab_sysPar, kk, ind_r[ii]),
+                          get_syspar_trff(sysPar, kk, ii), sysPar->ng);
+      interp_lin_1d_array(ifac_r[ii],
+                          get_syspar_cosne(tab_sysPar, kk, ind_r[ii] + 1), get_syspar_cosne(tab_sysPar, kk, ind_r[ii]),
+                          get_syspar_cosne(sysPar, kk, ii), sysPar->ng);
     }
-    sysPar->gmin[ii] =
-        interp_lin_1d(ifac_r, cached_tab_sysPar->gmin[ind_tabr + 1], cached_tab_sysPar->gmin[ind_tabr]);
+  }
+
+  return sysPar;
+}
 
-    sysPar->gmax[ii] =
-        interp_lin_1d(ifac_r, cached_tab_sysPar->gmax[ind_tabr + 1], cached_tab_sysPar->gmax[ind_tabr]);
 
+/** memory of the system parameters, as needed for the budget of the cache **/
+static size_t size_of_relSysPar(const RelSysPar *sysPar) {
+  size_t n_values = 3 * sysPar->nr + 2 * sysPar->ng + 4 * (size_t) sysPar->nr * sysPar->ng;
+  if (sysPar->emis != nullptr) {
+    n_values += 4 * sysPar->emis->nr;
+  }
+  return sizeof(RelSysPar) + n_values * sizeof(double);
+}
+
+/** calculate all relativistic system parameters, including the interpolation of the rel-table and the
+ *  emissivity (not cached, the caller owns the values) **/
+RelSysPar *calc_system_parameters(const relParam *param, int *status) {
+
+  CHECK_STATUS_RET(*status, nullptr);
+
+  RelSysPar *sysPar = interpol_relTable(param->a, param->incl, param->rin, param->rout, status);
+  CHECK_STATUS_RET(*status, nullptr);
+
+  sysPar->limb_law = param->limb;
+
+  // get emissivity profile
+  sysPar->emis = calc_emis_profile(sysPar->re, sysPar->nr, param, status);
+  if (*status != EXIT_SUCCESS) {
+    free_relSysPar(sysPar);
+    return nullptr;
   }
 
   return sysPar;
 }
 
-
 /**  calculate all relativistic system parameters, including interpolation
  *   of the rel-table, and the emissivity; caching is implemented
+ *   (the values are owned by the cache, see LruCache for how long they stay valid; parameters with
+ *   correction factors of the returning radiation can not be cached, see calc_system_parameters)
  *   Input: relParam* param   Output: relSysPar* system_parameter_struct
  */
 RelSysPar *get_system_parameters(const relParam *param, int *status) {
 
   CHECK_STATUS_RET(*status, nullptr);
+  assert(param->rrad_corr_factors == nullptr);
 
-  inpar *sysinp = set_input_syspar(param, status);
-  CHECK_STATUS_RET(*status, nullptr);
+  RelxillContext *context = RelxillContext::current();
+  if (context->cache_syspar == nullptr) {
+    context->cache_syspar = new LruCache<RelSysPar>(get_cache_max_bytes(), size_of_relSysPar, free_relSysPar);
+  }
+  LruCache<RelSysPar> *cache_syspar = context->cache_syspar;
 
-  cache_info *ca_info = cli_check_cache(cache_syspar, sysinp, check_cache_syspar, status);
-  CHECK_STATUS_RET(*status, nullptr);
+  CacheKey key = get_syspar_cache_key(param);
+  RelSysPar *sysPar = cache_syspar->find(key);
 
-  RelSysPar *sysPar = nullptr;
-  if (ca_info->syscache == 1 ) {
+  if (sysPar != nullptr) {
     // system parameter values are cached, so we can take it from there
-    sysPar = ca_info->store->data->relSysPar;
     if (is_debug_run()) {
       printf(" DEBUG:  SYSPAR-Cache: re-using calculated values\n");
     }
   } else {
     // NOT CACHED, so we need to calculate the system parameters
-    sysPar = interpol_relTable(param->a, param->incl, param->rin, param->rout, status);
-    CHECK_STATUS_RET(*status, nullptr);
-
-    sysPar->limb_law = param->limb;
-
-    // get emissivity profile
-    sysPar->emis = calc_emis_profile(sysPar->re, sysPar->nr, param, status);
+    sysPar = calc_system_parameters(param, status);
     CHECK_STATUS_RET(*status, nullptr);
 
-    // now add (i.e., prepend) the current calculation to the cache
-    set_cache_syspar(&cache_syspar, param, sysPar, status);
+    // now add the current calculation to the cache (which owns the values from now on)
+    cache_syspar->insert(key, sysPar);
 
-    if (is_debug_run() && *status == EXIT_SUCCESS) {
-      printf(" DEBUG:  Adding new SYSPAR values to cache; the count is  %i \n", cli_count_elements(cache_syspar));
+    if (is_debug_run()) {
+      printf(" DEBUG:  Adding new SYSPAR values to cache; the count is %zu (%zu hits, %zu misses) \n",
+             cache_syspar->size(), cache_syspar->hits(), cache_syspar->misses());
     }
   }
 
-  free(ca_info);
-  free(sysinp);
-
-  CHECK_RELXILL_DEFAULT_ERROR(status);
-
-  // make a sanity check for now
-  if (*status == EXIT_SUCCESS) {
-    assert(cache_syspar != nullptr);
-    assert(sysPar != nullptr);
-  }
-
   return sysPar;
 }
 
@@ -485,6 +574,16 @@ static str_relb_func *new_str_relb_func(RelSysPar *sysPar, int *status) {
   return str;
 }
 
+/** limb darkening law for the given cosine of the emission angle **/
+static double limb_darkening_factor(int limb_law, double fmu0) {
+  if (limb_law == 1) { //   !Laor(1991)
+    return 1.0 + 2.06 * fmu0;
+  } else if (limb_law == 2) {  //  !Haardt (1993)
+    return log(1.0 + 1.0 / fmu0);
+  }
+  return 1.0;
+}
+
 /** relat. function which we want to integrate **/
 static double relb_func(double eg, int k, str_relb_func *str) {
 
@@ -501,7 +600,7 @@ static double relb_func(double eg, int k, str_relb_func *str) {
 
   double inte = (egstar - str->gstar[ind]) / (str->gstar[ind + 1] - str->gstar[ind]);
   double inte1 = 1.0 - inte;
-  double ftrf = inte * str->trff[ind][k] + inte1 * str->trff[ind + 1][k];
+  double ftrf = inte * str->trff[k][ind] + inte1 * str->trff[k][ind + 1];
 
   double val = pow(eg, 3) / ((str->gmax - str->gmin) * sqrt(egstar - egstar * egstar)) * ftrf * str->emis;
 
@@ -509,14 +608,8 @@ static double relb_func(double eg, int k, str_relb_func *str) {
   if (str->limb_law == 0) {
     return val;
   } else {
-    double fmu0 = inte * str->cosne[ind][k] + inte1 * str->cosne[ind + 1][k];
-    double limb = 1.0;
-    if (str->limb_law == 1) { //   !Laor(1991)
-      limb = (1.0 + 2.06 * fmu0);
-    } else if (str->limb_law == 2) {  //  !Haardt (1993)
-      limb = log(1.0 + 1.0 / fmu0);
-    }
-    return val * limb;
+    double fmu0 = inte * str->cosne[k][ind] + inte1 * str->cosne[k][ind + 1];
+    return val * limb_darkening_factor(str->limb_law, fmu0);
   }
 }
 
@@ -725,22 +818,267 @@ static double integ_relline_bin(str_relb_func *str, double rlo0, double rhi0) {
   return flu;
 }
 
-static void set_str_relbf(str_relb_func *str, double re, double gmin, double gmax, double **trff,
-                          double **cosne, double emis, int limb_law) {
-  str->re = re;
-  str->gmin = gmin;
-  str->gmax = gmax;
-  str->del_g = 1. / (gmax - gmin);
+/** grid of the cumulative integral of the relat. function over theta, with g* = sin^2(theta)
+ *  - as dg* = 2*sqrt(g*(1-g*)) dtheta, the 1/sqrt(g*(1-g*)) singularities at g*=0 and g*=1
+ *    cancel and the function is finite for all theta in [0,pi/2]
+ *  - every bin of the g* grid (plus the edges [0,GFAC_H] and [1-GFAC_H,1]) is a segment, which is
+ *    split into N_THETA_CDF intervals in theta, in which the function is assumed to be linear
+ *  - the grid is the same for all radii, so the function is tabulated for all radii at once **/
+struct RellineCdfGrid {
+  int n_seg = 0;
+  std::vector<int> ind_g;        // [n_seg] bin of the g* grid in which the transfer function is interpolated
+  std::vector<double> gs;        // [n_seg*(N_THETA_CDF+1)] g* of the nodes of each segment
+  std::vector<double> theta;     // [n_seg*N_THETA_CDF+1] boundaries of all intervals
+  int nr = 0;
+  std::vector<double> func;      // [n_seg*(N_THETA_CDF+1)][nr] function at the nodes for all radii
+};
+
+/** cumulative integral for one radius (see RellineCdfGrid), arrays are [n_seg*N_THETA_CDF(+1)] **/
+struct RellineCdf {
+  std::vector<double> cdf;
+  std::vector<double> func_lo;   // function at the lower and upper boundary of each interval
+  std::vector<double> func_hi;
+};
+
+static int get_n_cdf_nodes(const RellineCdfGrid *grid) {
+  return grid->n_seg * (N_THETA_CDF + 1);
+}
+
+static void init_relline_cdf_grid(RellineCdfGrid *grid, const double *gstar, int ng, int nr) {
+
+  grid->n_seg = ng + 1;
+  grid->ind_g.resize(grid->n_seg);
+  grid->gs.resize(get_n_cdf_nodes(grid));
+  grid->theta.resize(grid->n_seg * N_THETA_CDF + 1);
+
+  for (int iseg = 0; iseg < grid->n_seg; iseg++) {
+    double gs_lo = (iseg == 0) ? 0.0 : gstar[iseg - 1];
+    double gs_hi = (iseg == ng) ? 1.0 : gstar[iseg];
+    // the transfer function is kept constant outside of [GFAC_H,1-GFAC_H] (as in int_edge)
+    grid->ind_g[iseg] = std::min(std::max(iseg - 1, 0), ng - 2);
+
+    double theta_lo = asin(sqrt(gs_lo));
+    double dtheta = (asin(sqrt(gs_hi)) - theta_lo) / N_THETA_CDF;
+    for (int ii = 0; ii <= N_THETA_CDF; ii++) {
+      double sin_theta = sin(theta_lo + ii * dtheta);
+      grid->gs[iseg * (N_THETA_CDF + 1) + ii] = (ii == 0) ? gs_lo : sin_theta * sin_theta;
+      grid->theta[iseg * N_THETA_CDF + ii] = theta_lo + ii * dtheta;
+    }
+  }
+  grid->theta.back() = 0.5 * M_PI;
+
+  grid->nr = nr;
+  grid->func.resize(static_cast<size_t>(get_n_cdf_nodes(grid)) * nr);
+}
+
+/** transfer function of all radii in a structure-of-arrays layout, i.e., the values of bin "ind"
+ *  of the g* grid and branch "k" are stored contiguously for all radii at [(ind*2+k)*nr]
+ *  (transposed with respect to the system parameters, where the g* values are contiguous) **/
+struct RellineTrffSoa {
+  int nr = 0;
+  std::vector<double> trff;
+  std::vector<double> cosne;
+};
+
+static void init_relline_trff_soa(RellineTrffSoa *soa, const RelSysPar *sysPar) {
+  soa->nr = sysPar->nr;
+  soa->trff.resize(static_cast<size_t>(sysPar->ng) * 2 * sysPar->nr);
+  soa->cosne.resize(soa->trff.size());
+  for (int kk = 0; kk < 2; kk++) {
+    for (int ii = 0; ii < sysPar->nr; ii++) {
+      const double *trff = get_syspar_trff(sysPar, kk, ii);
+      const double *cosne = get_syspar_cosne(sysPar, kk, ii);
+      for (int jj = 0; jj < sysPar->ng; jj++) {
+        soa->trff[(jj * 2 + kk) * sysPar->nr + ii] = trff[jj];
+        soa->cosne[(jj * 2 + kk) * sysPar->nr + ii] = cosne[jj];
+      }
+    }
+  }
+}
+
+#ifdef RELXILL_SIMD
+/** SIMD lanes of relb_func_theta_radii for LimbLaw 0 and 1, returns the first radius which is not
+ *  evaluated **/
+template<int LimbLaw>
+RELXILL_SIMD_TARGET static int relb_func_theta_radii_simd(double gs, double inte, int ir_lo, int ir_hi,
+                                                          const double *gmin, const double *gmax,
+                                                          const double *trff_lo[2], const double *trff_hi[2],
+                                                          const double *cosne_lo[2], const double *cosne_hi[2],
+                                                          double *func) {
+  const simd_double v_gs = simd_set1(gs);
+  const simd_double v_inte = simd_set1(inte);
+  const simd_double v_inte1 = simd_set1(1.0 - inte);
+  const simd_double v_two = simd_set1(2.0);
+  const simd_double v_one = simd_set1(1.0);
+  const simd_double v_laor = simd_set1(2.06);
+  int ii = ir_lo;
+  for (; ii + SIMD_DOUBLE_LANES <= ir_hi; ii += SIMD_DOUBLE_LANES) {
+    simd_double v_gmin = simd_load(gmin + ii);
+    simd_double v_eg = simd_add(v_gmin, simd_mul(v_gs, simd_sub(simd_load(gmax + ii), v_gmin)));
+    simd_double v_val = simd_set1(0.0);
+    for (int k = 0; k < 2; k++) {
+      simd_double v_trff = simd_add(simd_mul(v_inte, simd_load(trff_lo[k] + ii)),
+                                    simd_mul(v_inte1, simd_load(trff_hi[k] + ii)));
+      if (LimbLaw == 1) {
+        simd_double v_mu = simd_add(simd_mul(v_inte, simd_load(cosne_lo[k] + ii)),
+                                    simd_mul(v_inte1, simd_load(cosne_hi[k] + ii)));
+        v_trff = simd_mul(v_trff, simd_add(v_one, simd_mul(v_laor, v_mu)));
+      }
+      v_val = simd_add(v_val, v_trff);
+    }
+    simd_double v_eg3 = simd_mul(simd_mul(v_eg, v_eg), v_eg);
+    simd_store(func + ii, simd_mul(simd_mul(v_two, v_eg3), v_val));
+  }
+  return ii;
+}
+#endif
+
+/** relat. function for a unit emissivity, 2*E^3*sum_k(trff_k*limb(cosne_k)), at one g* node for the
+ *  radii [ir_lo,ir_hi), where the transfer function is interpolated exactly as in relb_func between
+ *  its values "lo" (weight inte) and "hi" (weight 1-inte) for both branches k
+ *  - for LimbLaw 0 and 1 the radii are evaluated in SIMD lanes (see Relsimd.h), the remaining
+ *    ones and the logarithmic law (LimbLaw 2) are evaluated one by one
+ *  - all operations are done in the same order, so the result does not depend on the lanes **/
+template<int LimbLaw>
+static void relb_func_theta_radii(double gs, double inte, int ir_lo, int ir_hi,
+                                  const double *gmin, const double *gmax,
+                                  const double *trff_lo[2], const double *trff_hi[2],
+                                  const double *cosne_lo[2], const double *cosne_hi[2], double *func) {
+
+  const double inte1 = 1.0 - inte;
+  int ii = ir_lo;
+
+#ifdef RELXILL_SIMD
+  if (LimbLaw != 2 && use_simd_lanes()) {
+    ii = relb_func_theta_radii_simd<LimbLaw>(gs, inte, ir_lo, ir_hi, gmin, gmax, trff_lo, trff_hi,
+                                             cosne_lo, cosne_hi, func);
+  }
+#endif
+
+  for (; ii < ir_hi; ii++) {
+    double eg = gmin[ii] + gs * (gmax[ii] - gmin[ii]);
+    double val = 0.0;
+    for (int k = 0; k < 2; k++) {
+      double ftrf = inte * trff_lo[k][ii] + inte1 * trff_hi[k][ii];
+      if (LimbLaw != 0) {
+        double fmu0 = inte * cosne_lo[k][ii] + inte1 * cosne_hi[k][ii];
+        ftrf = ftrf * limb_darkening_factor(LimbLaw, fmu0);
+      }
+      val = val + ftrf;
+    }
+    func[ii] = (2.0 * (eg * eg * eg)) * val;
+  }
+}
+
+/** tabulate the relat. function on all nodes of the grid for the radii [ir_lo,ir_hi) **/
+template<int LimbLaw>
+static void tabulate_relb_func_theta(RellineCdfGrid *grid, const RellineTrffSoa *soa, const RelSysPar *sysPar,
+                                     int ir_lo, int ir_hi) {
+
+  const int nr = grid->nr;
+  for (int iseg = 0; iseg < grid->n_seg; iseg++) {
+    int ind = grid->ind_g[iseg];
+    const double *trff_lo[2] = {&soa->trff[(ind * 2) * nr], &soa->trff[(ind * 2 + 1) * nr]};
+    const double *trff_hi[2] = {&soa->trff[((ind + 1) * 2) * nr], &soa->trff[((ind + 1) * 2 + 1) * nr]};
+    const double *cosne_lo[2] = {&soa->cosne[(ind * 2) * nr], &soa->cosne[(ind * 2 + 1) * nr]};
+    const double *cosne_hi[2] = {&soa->cosne[((ind + 1) * 2) * nr], &soa->cosne[((ind + 1) * 2 + 1) * nr]};
+
+    for (int ii = 0; ii <= N_THETA_CDF; ii++) {
+      int inode = iseg * (N_THETA_CDF + 1) + ii;
+      double gs = grid->gs[inode];
+      double gs_tab = fmin(fmax(gs, sysPar->gstar[0]), sysPar->gstar[sysPar->ng - 1]);
+      double inte = (gs_tab - sysPar->gstar[ind]) / (sysPar->gstar[ind + 1] - sysPar->gstar[ind]);
+
+      relb_func_theta_radii<LimbLaw>(gs, inte, ir_lo, ir_hi, sysPar->gmin, sysPar->gmax,
+                                     trff_lo, trff_hi, cosne_lo, cosne_hi, &grid->func[static_cast<size_t>(inode) * nr]);
+    }
+  }
+}
+
+static void tabulate_relb_func_theta(RellineCdfGrid *grid, const RellineTrffSoa *soa, const RelSysPar *sysPar,
+                                     int ir_lo, int ir_hi) {
+  // resolve the limb law outside of the loops
+  if (sysPar->limb_law == 1) {
+    tabulate_relb_func_theta<1>(grid, soa, sysPar, ir_lo, ir_hi);
+  } else if (sysPar->limb_law == 2) {
+    tabulate_relb_func_theta<2>(grid, soa, sysPar, ir_lo, ir_hi);
+  } else {
+    tabulate_relb_func_theta<0>(grid, soa, sysPar, ir_lo, ir_hi);
+  }
+}
+
+/** cumulative integral of the tabulated function of radius ir **/
+static void calc_relline_cdf(RellineCdf *cdf, const RellineCdfGrid *grid, int ir) {
+
+  const int n_int = grid->n_seg * N_THETA_CDF;
+  cdf->cdf.resize(n_int + 1);
+  cdf->func_lo.resize(n_int);
+  cdf->func_hi.resize(n_int);
+
+  cdf->cdf[0] = 0.0;
+  for (int iseg = 0; iseg < grid->n_seg; iseg++) {
+    for (int ii = 0; ii < N_THETA_CDF; ii++) {
+      int inode = iseg * (N_THETA_CDF + 1) + ii;
+      int kk = iseg * N_THETA_CDF + ii;
+      cdf->func_lo[kk] = grid->func[static_cast<size_t>(inode) * grid->nr + ir];
+      cdf->func_hi[kk] = grid->func[static_cast<size_t>(inode + 1) * grid->nr + ir];
+      cdf->cdf[kk + 1] = cdf->cdf[kk] + 0.5 * (cdf->func_lo[kk] + cdf->func_hi[kk]) * (grid->theta[kk + 1] - grid->theta[kk]);
+    }
+  }
+}
+
+/** evaluate the cumulative integral at g*, starting the search for the interval at "ind"
+ *  (as the energies are increasing, the interval of the previous evaluation is a good guess) **/
+static double eval_relline_cdf(const RellineCdfGrid *grid, const RellineCdf *cdf, double gs, int *ind) {
+
+  double theta = asin(sqrt(gs));
+
+  int n = static_cast<int>(cdf->func_lo.size());
+  while (*ind < n - 1 && theta >= grid->theta[*ind + 1]) {
+    (*ind)++;
+  }
+  int kk = *ind;
+
+  double dtheta = grid->theta[kk + 1] - grid->theta[kk];
+  double dt = theta - grid->theta[kk];
+
+  return cdf->cdf[kk] + cdf->func_lo[kk] * dt + (cdf->func_hi[kk] - cdf->func_lo[kk]) * dt * dt / (2 * dtheta);
+}
+
+/** integrate the flux bins [ielo,iehi] from the cumulative integral (see calc_relline_cdf), i.e.,
+ *  in contrast to integ_relline_bin the bins have to be calculated together, in increasing order **/
+static void integ_relline_bins_cdf(const str_relb_func *str, const RellineCdfGrid *grid, const RellineCdf *cdf,
+                                   const double *ener, int ielo, int iehi, double *flux) {
+
+  int ind = 0;
+  double gs_lo = fmin(fmax((ener[ielo] - str->gmin) * str->del_g, 0.0), 1.0);
+  double cdf_lo = eval_relline_cdf(grid, cdf, gs_lo, &ind);
+
+  for (int jj = ielo; jj <= iehi; jj++) {
+    double gs_hi = fmin(fmax((ener[jj + 1] - str->gmin) * str->del_g, 0.0), 1.0);
+    double cdf_hi = eval_relline_cdf(grid, cdf, gs_hi, &ind);
+    flux[jj - ielo] = cdf_hi - cdf_lo;
+    cdf_lo = cdf_hi;
+  }
+}
+
+static void set_str_relbf(str_relb_func *str, const RelSysPar *sysPar, int ii, double emis) {
+  str->re = sysPar->re[ii];
+  str->gmin = sysPar->gmin[ii];
+  str->gmax = sysPar->gmax[ii];
+  str->del_g = 1. / (str->gmax - str->gmin);
   str->emis = emis;
 
-  str->trff = trff;
-  str->cosne = cosne;
+  for (int k = 0; k < 2; k++) {
+    str->trff[k] = get_syspar_trff(sysPar, k, ii);
+    str->cosne[k] = get_syspar_cosne(sysPar, k, ii);
+  }
 
   str->cache_bin_ener = -1.0;
   str->cache_rad_relb_fun = -1.0;
   str->cached_relbf = 0;
 
-  str->limb_law = limb_law;
+  str->limb_law = sysPar->limb_law;
 
   str->save_g_ind = 0;
 }
@@ -800,22 +1138,6 @@ int static get_cosne_bin(double mu, RelCosne *dat) {
   return ((int) (dat->n_cosne * (1 - mu) + 1)) - 1;
 }
 
-/** calculate the relline profile(s) for all given zones **/
-str_relb_func *cached_str_relb_func = nullptr;
-
-static double calculate_radiallyResolvedFluxObs(str_relb_func *relb_func, relline_spec_multizone *spec, double weight) {
-
-  double integRadialFlux = 0.0;
-  for (int jj = 0; jj <= spec->n_ener; jj++) {
-    integRadialFlux += integ_relline_bin(cached_str_relb_func, spec->ener[jj], spec->ener[jj + 1]);
-  }
-
-  integRadialFlux *= weight;
-
-  return integRadialFlux;
-
-}
-
 static void free_str_relb_func(str_relb_func **str) {
   if (*str != nullptr) {
     free(*str);
@@ -832,119 +1154,286 @@ bool write_outfile_radial_flux(int n_zones) {
   return shouldOutfilesBeWritten() && n_zones == 1;
 }
 
-void calc_relline_profile(relline_spec_multizone *spec, RelSysPar *sysPar, int *status) {
+/** relline profile of every radius of the fine radial grid for a unit emissivity
+ *  - the profile is linear in the emissivity, so for a change of only the emissivity the
+ *    profile is given by the sum over all radii, weighted with the emissivity
+ *  - it depends on a, incl, rin, rout, the limb law and the energy grid (the radial zones are
+ *    only applied when summing up the radii, as they can depend on the emissivity parameters) **/
+struct RellineRadialBasis {
+  double a;
+  double incl;
+  double rin;
+  double rout;
+  int limb_law;
+  int n_cosne;
+  int cdf_engine;                  // integrated with the cumulative integral (see calc_relline_cdf)
+  std::vector<double> ener;        // [n_ener+1]
+  std::vector<int> ind_lo;         // [nr] first energy bin the radius contributes to
+  std::vector<size_t> ind_flux;    // [nr+1] the flux of radius ii is stored in [ind_flux[ii], ind_flux[ii+1])
+  std::vector<double> flux;        // including the area of the radial bin
+  std::vector<double> cosne_dist;  // [nr*n_cosne]
+};
+
+static int get_n_cosne(const relline_spec_multizone *spec) {
+  return (spec->rel_cosne == nullptr) ? 0 : spec->rel_cosne->n_cosne;
+}
 
-  CHECK_STATUS_VOID(*status);
+static int is_relline_basis_cached(const RellineRadialBasis *basis, const relline_spec_multizone *spec,
+                                   const RelSysPar *sysPar, const relParam *param) {
+  if (basis == nullptr) {
+    return 0;
+  }
+
+  if (are_values_different(basis->a, param->a) || are_values_different(basis->incl, param->incl)
+      || are_values_different(basis->rin, param->rin) || are_values_different(basis->rout, param->rout)
+      || basis->limb_law != sysPar->limb_law || basis->n_cosne != get_n_cosne(spec)
+      || basis->cdf_engine != use_relline_cdf_engine()) {
+    return 0;
+  }
+
+  if (static_cast<int>(basis->ener.size()) != spec->n_ener + 1) {
+    return 0;
+  }
+  for (int ii = 0; ii <= spec->n_ener; ii++) {
+    if (basis->ener[ii] != spec->ener[ii]) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/** working structures of every thread for the integration of the radial profiles **/
+struct RellineThreadData {
+  str_relb_func *str = nullptr;
+  RellineCdf cdf;
+  int status = EXIT_SUCCESS;
+};
+
+/** integrate the relline profile of radius ii for a unit emissivity (see Dauser+2010, MNRAS)
+ *  - the flux of the energy bins [ind_lo, ind_lo+flux.size()) is returned in "flux"
+ *  - the cosne distribution is written to cosne_dist (with n_cosne elements) **/
+static void calc_relline_radial_profile(int ii, const relline_spec_multizone *spec, RelSysPar *sysPar,
+                                        const RellineCdfGrid *cdf_grid, RellineThreadData *dat, int *ind_lo,
+                                        std::vector<double> &flux, double *cosne_dist) {
 
   double line_ener = 1.0;
 
+  // gstar in [0,1] + corresponding energies (see gstar2ener for full formula)
+  double egmin = sysPar->gmin[ii] * line_ener;
+  double egmax = sysPar->gmax[ii] * line_ener;
+
+  // check if the expected energy-bins are needed
+  if (!((egmax > spec->ener[0]) && (egmin < spec->ener[spec->n_ener]))) {
+    return;
+  }
+
+  /**  make sure that integration is only done inside the
+       given energy range **/
+  if (egmin < spec->ener[0]) {
+    egmin = spec->ener[0];
+  }
+  if (egmax > spec->ener[spec->n_ener]) {
+    egmax = spec->ener[spec->n_ener];
+  }
+
+  /** search for the indices in the ener-array
+      index is such that: ener[k]<=e<ener[k+1] **/
+  int ielo = binary_search(spec->ener, spec->n_ener + 1, egmin);
+  int iehi = binary_search(spec->ener, spec->n_ener + 1, egmax);
+
+  // set the current parameters in a cached structure (and reset some values) [optimizes speed]
+  str_relb_func *str = dat->str;
+  set_str_relbf(str, sysPar, ii, 1.0);
+
+  /** INTEGRATION
+   *   [remember: defintion of Xillver/Relxill is 1/2 * Speith Code]
+   *   [remember: trapez integration returns just r*dr*PI (full integral is over dA/2)]
+   *   [ -> in the end it's weigth=PI*r*dr/2 ]
+   */
+  double weight = trapez_integ_single(sysPar->re, ii, sysPar->nr) / 2;
+
+  // lastly, loop over the energies
+  *ind_lo = ielo;
+  flux.resize(iehi - ielo + 1);
+  if (cdf_grid != nullptr) {
+    calc_relline_cdf(&dat->cdf, cdf_grid, ii);
+    integ_relline_bins_cdf(str, cdf_grid, &dat->cdf, spec->ener, ielo, iehi, flux.data());
+    for (auto &val: flux) {
+      val *= weight;
+    }
+  } else {
+    for (int jj = ielo; jj <= iehi; jj++) {
+      flux[jj - ielo] = integ_relline_bin(str, spec->ener[jj], spec->ener[jj + 1]) * weight;
+    }
+  }
+
+  /** only calculate the distribution if we need it here  **/
+  if (spec->rel_cosne != nullptr) {
+    str_relb_func *da = str; // define a shortcut
+    for (int jj = 0; jj < sysPar->ng; jj++) {
+      double g = da->gstar[jj] * (da->gmax - da->gmin) + da->gmin;
+      for (int kk = 0; kk < 2; kk++) {
+        int imu = get_cosne_bin(da->cosne[kk][jj], spec->rel_cosne);
+
+        double tmp =
+            da->re * pow(2 * M_PI * g * da->re, 2) /
+                sqrt(da->gstar[jj] - da->gstar[jj] * da->gstar[jj]) *
+                da->trff[kk][jj] * da->emis
+                * weight * sysPar->d_gstar[jj];
+
+        // this catches if "tmp" is NaN
+        if (tmp != tmp) {
+          printf(" *** error in function calc_relline_profile (NaN) *** \n");
+          printf(" *** backtrace %e %e %e %e %e\n",
+                 da->re, g, da->gstar[jj], da->trff[kk][jj], weight);
+          dat->status = EXIT_FAILURE;
+        }
+
+        cosne_dist[imu] += tmp;
+      }
+    }
+  } /** end calculating angular distribution **/
+
+}
+
+/** integrate the relline profile of each radius for a unit emissivity
+ *  - the radii are distributed over RELXILL_NUM_THREADS threads, each with its own working structures
+ *  - the profiles are stored per radius, so the result does not depend on the number of threads **/
+static void calc_relline_radial_basis(RellineRadialBasis *basis, const relline_spec_multizone *spec,
+                                      RelSysPar *sysPar, const relParam *param, int *status) {
+
+  CHECK_STATUS_VOID(*status);
+
+  basis->a = param->a;
+  basis->incl = param->incl;
+  basis->rin = param->rin;
+  basis->rout = param->rout;
+  basis->limb_law = sysPar->limb_law;
+  basis->n_cosne = get_n_cosne(spec);
+  basis->cdf_engine = use_relline_cdf_engine();
+  basis->ener.assign(spec->ener, spec->ener + spec->n_ener + 1);
+
+  basis->ind_lo.assign(sysPar->nr, 0);
+  basis->cosne_dist.assign(sysPar->nr * basis->n_cosne, 0.0);
+
+  int num_threads = std::min(get_num_threads(), sysPar->nr);
+  std::vector<RellineThreadData> thread_data(num_threads);
+  for (auto &dat: thread_data) {
+    dat.str = new_str_relb_func(sysPar, status);
+  }
+
+  // for the CDF engine, the relat. function is tabulated for blocks of radii at the same g* nodes
+  RellineCdfGrid *cdf_grid = nullptr;
+  if (basis->cdf_engine && *status == EXIT_SUCCESS) {
+    cdf_grid = new RellineCdfGrid;
+    init_relline_cdf_grid(cdf_grid, sysPar->gstar, sysPar->ng, sysPar->nr);
+    RellineTrffSoa soa;
+    init_relline_trff_soa(&soa, sysPar);
+
+    int n_blocks = (sysPar->nr + N_RADII_BLOCK_CDF - 1) / N_RADII_BLOCK_CDF;
+    parallel_for(n_blocks, num_threads, [&](int iblock, int) {
+      tabulate_relb_func_theta(cdf_grid, &soa, sysPar, iblock * N_RADII_BLOCK_CDF,
+                               std::min((iblock + 1) * N_RADII_BLOCK_CDF, sysPar->nr));
+    });
+  }
+
+  std::vector<std::vector<double>> radial_flux(sysPar->nr);
+  if (*status == EXIT_SUCCESS) {
+    parallel_for(sysPar->nr, num_threads, [&](int ii, int ithread) {
+      calc_relline_radial_profile(ii, spec, sysPar, cdf_grid, &thread_data[ithread],
+                                  &basis->ind_lo[ii], radial_flux[ii], &basis->cosne_dist[ii * basis->n_cosne]);
+    });
+  }
+  delete cdf_grid;
+
+  // the str_relb_func structures point to the sysPar structure, which can be freed by the cache
+  for (auto &dat: thread_data) {
+    if (dat.status != EXIT_SUCCESS) {
+      *status = dat.status;
+    }
+    free_str_relb_func(&dat.str);
+  }
+
+  // store the profiles contiguously, in the order of the radii
+  basis->ind_flux.assign(sysPar->nr + 1, 0);
+  basis->flux.clear();
+  for (int ii = 0; ii < sysPar->nr; ii++) {
+    basis->flux.insert(basis->flux.end(), radial_flux[ii].begin(), radial_flux[ii].end());
+    basis->ind_flux[ii + 1] = basis->flux.size();
+  }
+
+}
+
+static void free_relline_radial_basis() {
+  RelxillContext *context = RelxillContext::current();
+  delete context->cached_relline_basis;
+  context->cached_relline_basis = nullptr;
+}
+
+/** calculate the relline profile(s) for all given zones
+ *  - the profile for a unit emissivity of each radius is cached, such that a change of only the
+ *    emissivity (e.g., index1/2, rbr, h, beta) does not need to integrate the profile again **/
+void calc_relline_profile(relline_spec_multizone *spec, RelSysPar *sysPar, const relParam *param, int *status) {
+
+  CHECK_STATUS_VOID(*status);
+
   // very important: set all fluxes to zero
   zero_rel_spec_flux(spec);
 
-  if (cached_str_relb_func == nullptr) {
-    cached_str_relb_func = new_str_relb_func(sysPar, status);
+  RelxillContext *context = RelxillContext::current();
+  if (is_relline_basis_cached(context->cached_relline_basis, spec, sysPar, param)) {
+    if (is_debug_run()) {
+      printf(" DEBUG:  RELLINE-Basis: re-using the profiles of the radial grid\n");
+    }
+  } else {
+    if (context->cached_relline_basis == nullptr) {
+      context->cached_relline_basis = new RellineRadialBasis;
+    }
+    calc_relline_radial_basis(context->cached_relline_basis, spec, sysPar, param, status);
+    if (*status != EXIT_SUCCESS) {
+      free_relline_radial_basis();
+      return;
+    }
   }
+  const RellineRadialBasis *basis = context->cached_relline_basis;
 
   // store the (energy)-integrated flux in an array for debugging
   double *radialFlux = nullptr;
   if (write_outfile_radial_flux(spec->n_zones)) {
-    radialFlux = (double *) malloc(sizeof(double) * sysPar->nr);
+    radialFlux = (double *) calloc(sysPar->nr, sizeof(double));
     CHECK_MALLOC_VOID_STATUS(radialFlux, status)
   }
 
-  int ii;
-  int jj;
-  for (ii = 0; ii < sysPar->nr; ii++) {
-    // gstar in [0,1] + corresponding energies (see gstar2ener for full formula)
-    double egmin = sysPar->gmin[ii] * line_ener;
-    double egmax = sysPar->gmax[ii] * line_ener;
-
-    // check if the expected energy-bins are needed
-    if ((egmax > spec->ener[0]) && (egmin < spec->ener[spec->n_ener])) {
+  for (int ii = 0; ii < sysPar->nr; ii++) {
+    if (basis->ind_flux[ii + 1] == basis->ind_flux[ii]) {
+      continue;
+    }
 
+    // in which ionization bin are we?
+    int izone = binary_search(spec->rgrid, spec->n_zones + 1, sysPar->re[ii]);
+    double emis = sysPar->emis->emis[ii];
 
-      /**  make sure that integration is only done inside the
-           given energy range **/
-      if (egmin < spec->ener[0]) {
-        egmin = spec->ener[0];
-      }
-      if (egmax > spec->ener[spec->n_ener]) {
-        egmax = spec->ener[spec->n_ener];
-      }
+    const double *flux_radius = basis->flux.data() + basis->ind_flux[ii];
+    double *flux_zone = spec->flux[izone] + basis->ind_lo[ii];
+    int n_bins = static_cast<int>(basis->ind_flux[ii + 1] - basis->ind_flux[ii]);
+    for (int jj = 0; jj < n_bins; jj++) {
+      flux_zone[jj] += emis * flux_radius[jj];
+    }
 
-      /** search for the indices in the ener-array
-          index is such that: ener[k]<=e<ener[k+1] **/
-      int ielo = binary_search(spec->ener, spec->n_ener + 1, egmin);
-      int iehi = binary_search(spec->ener, spec->n_ener + 1, egmax);
-
-      // in which ionization bin are we?
-      int izone = binary_search(spec->rgrid, spec->n_zones + 1, sysPar->re[ii]);
-
-      // set the current parameters in a cached structure (and reset some values) [optimizes speed]
-      set_str_relbf(cached_str_relb_func,
-                    sysPar->re[ii], sysPar->gmin[ii], sysPar->gmax[ii],
-                    sysPar->trff[ii], sysPar->cosne[ii],
-                    sysPar->emis->emis[ii], sysPar->limb_law);
-
-      /** INTEGRATION
-       *   [remember: defintion of Xillver/Relxill is 1/2 * Speith Code]
-       *   [remember: trapez integration returns just r*dr*PI (full integral is over dA/2)]
-       *   [ -> in the end it's weigth=PI*r*dr/2 ]
-       */
-      double weight = trapez_integ_single(sysPar->re, ii, sysPar->nr) / 2;
-
-      // lastly, loop over the energies
-      for (jj = ielo; jj <= iehi; jj++) {
-        double tmp_var = integ_relline_bin(cached_str_relb_func, spec->ener[jj], spec->ener[jj + 1]);
-        spec->flux[izone][jj] += tmp_var * weight;
+    if (radialFlux != nullptr) {
+      for (int jj = 0; jj < n_bins; jj++) {
+        radialFlux[ii] += emis * flux_radius[jj];
       }
+    }
 
-      if (write_outfile_radial_flux(spec->n_zones)) {
-        assert(radialFlux != nullptr);
-        radialFlux[ii] = calculate_radiallyResolvedFluxObs(cached_str_relb_func, spec, weight);
+    if (spec->rel_cosne != nullptr) {
+      for (int jj = 0; jj < basis->n_cosne; jj++) {
+        spec->rel_cosne->dist[izone][jj] += emis * basis->cosne_dist[ii * basis->n_cosne + jj];
       }
-
-      /** only calculate the distribution if we need it here  **/
-      if (spec->rel_cosne != nullptr) {
-        int kk;
-        int imu;
-        str_relb_func *da = cached_str_relb_func; // define a shortcut
-        for (jj = 0; jj < sysPar->ng; jj++) {
-          double g = da->gstar[jj] * (da->gmax - da->gmin) + da->gmin;
-          for (kk = 0; kk < 2; kk++) {
-            imu = get_cosne_bin(da->cosne[jj][kk], spec->rel_cosne);
-
-            double tmp =
-                da->re * pow(2 * M_PI * g * da->re, 2) /
-                    sqrt(da->gstar[jj] - da->gstar[jj] * da->gstar[jj]) *
-                    da->trff[jj][kk] * da->emis
-                    * weight * sysPar->d_gstar[jj];
-
-            // this catches if "tmp" is NaN
-            if (tmp != tmp) {
-              printf(" *** error in function calc_relline_profile (NaN) *** \n");
-              printf(" *** backtrace %e %e %e %e %e\n",
-                     da->re, g, da->gstar[jj], da->trff[jj][kk], weight);
-              *status = EXIT_FAILURE;
-            }
-
-            spec->rel_cosne->dist[izone][imu] +=
-                da->re * pow(2 * M_PI * g * da->re, 2) /
-                    sqrt(da->gstar[jj] - da->gstar[jj] * da->gstar[jj]) *
-                    da->trff[jj][kk] * da->emis
-                    * weight * sysPar->d_gstar[jj];
-          }
-        }
-      } /** end calculating angular distribution **/
-
-
     }
   }
 
-  /** we need to free the structure as it points to the currently cached sysPar structure
-       which is freed if the cache is full and therefore causes "invalid reads" **/
-  free_str_relb_func(&cached_str_relb_func);
-
   if (write_outfile_radial_flux(spec->n_zones)) {
     save_relline_radial_flux_profile(sysPar->re, radialFlux, sysPar->nr);
   }
@@ -959,6 +1448,8 @@ void calc_relline_profile(relline_spec_multizone *spec, RelSysPar *sysPar, int *
 
 void free_cached_relTable() {
   free_relTable(ptr_rellineTable);
+  ptr_rellineTable = nullptr;
+  RelxillContext::current()->cached_tab_plane_valid = 0;
 }
 
 // should not be called manually as it is automatically freed in the cache
@@ -972,42 +1463,22 @@ void free_relSysPar(RelSysPar *sysPar) {
 
     free_emisProfile(sysPar->emis);
 
-    if (sysPar->trff != nullptr) {
-      int ii;
-      for (ii = 0; ii < sysPar->nr; ii++) {
-        if (sysPar->trff[ii] != nullptr) {
-          int jj;
-          for (jj = 0; jj < sysPar->ng; jj++) {
-            free(sysPar->trff[ii][jj]);
-          }
-          free(sysPar->trff[ii]);
-        }
-      }
-      free(sysPar->trff);
-    }
-
-    if (sysPar->cosne != nullptr) {
-      int ii;
-      for (ii = 0; ii < sysPar->nr; ii++) {
-        if (sysPar->cosne[ii] != nullptr) {
-          int jj;
-          for (jj = 0; jj < sysPar->ng; jj++) {
-            free(sysPar->cosne[ii][jj]);
-          }
-          free(sysPar->cosne[ii]);
-        }
-      }
-      free(sysPar->cosne);
-    }
+    free(sysPar->trff);
+    free(sysPar->cosne);
     free(sysPar);
   }
 }
 
 void free_relprofile_cache() {
-  free_relSysPar(cached_tab_sysPar);
-  free_str_relb_func(&cached_str_relb_func);
+  RelxillContext *context = RelxillContext::current();
+  free_relSysPar(context->cached_tab_sysPar);
+  context->cached_tab_sysPar = nullptr;
+  context->cached_tab_plane_valid = 0;
+  free_relline_radial_basis();
 }
 
 void free_cache_syspar() {
-  cli_delete_list(&cache_syspar);
+  RelxillContext *context = RelxillContext::current();
+  delete context->cache_syspar;
+  context->cache_syspar = nullptr;
 }
@@ -22,10 +22,25 @@ extern "C" {
 #include "common.h"
 }
 
-void calc_relline_profile(relline_spec_multizone *spec, RelSysPar *sysPar, int *status);
+/** views of the transfer function and cosne of the system parameters, which are stored in one
+ *  contiguous slab each as [k][r][g]; returns the ng values of branch k at radius ir **/
+inline double *get_syspar_trff(const RelSysPar *sysPar, int k, int ir) {
+  return sysPar->trff + ((size_t) k * sysPar->nr + ir) * sysPar->ng;
+}
+
+inline double *get_syspar_cosne(const RelSysPar *sysPar, int k, int ir) {
+  return sysPar->cosne + ((size_t) k * sysPar->nr + ir) * sysPar->ng;
+}
 
+void calc_relline_profile(relline_spec_multizone *spec, RelSysPar *sysPar, const relParam *param, int *status);
+
+/** system parameters owned by the cache (see LruCache for how long they stay valid), which can not be
+ *  used for parameters with correction factors of the returning radiation (see calc_system_parameters) **/
 RelSysPar *get_system_parameters(const relParam *param, int *status);
 
+/** system parameters which are not cached (the caller has to free them with free_relSysPar) **/
+RelSysPar *calc_system_parameters(const relParam *param, int *status);
+
 void renorm_relline_profile(relline_spec_multizone *spec, relParam *rel_param, const int *status);
 
 void init_relline_spec_multizone(relline_spec_multizone **spec,
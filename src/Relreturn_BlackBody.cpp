@@ -21,6 +21,7 @@
 #include "Relbase.h"
 #include "Relphysics.h"
 #include "Relreturn_Datastruct.h"
+#include "Relcontext.h"
 
 extern "C" {
 #include "xilltable.h"
@@ -528,7 +529,10 @@ void relxill_bb_kernel(double *ener_inp, double *spec_inp, int n_ener_inp, xillP
   get_relxill_conv_energy_grid(&n_ener, &ener, status);
 
   xillTable *xill_tab = nullptr;
-  get_init_xillver_table(&xill_tab, xill_param->model_type, xill_param->prim_type, status);
+  {
+    std::lock_guard<std::mutex> lock(shared_table_mutex());
+    get_init_xillver_table(&xill_tab, xill_param->model_type, xill_param->prim_type, status);
+  }
 
   returnSpec2D *returnSpec = spec_returnrad_blackbody(ener, nullptr, nullptr, n_ener, xill_param->kTbb, rel_param->rin,
                                                       rel_param->rout, rel_param->a, status);
@@ -18,6 +18,7 @@
 
 #include "Relreturn_Datastruct.h"
 #include "Relreturn_Table.h"
+#include "Relcontext.h"
 
 extern "C" {
 #include "common.h"
@@ -60,6 +61,7 @@ void get_gfac_grid(double* gfac, double gmin, double gmax, int ng) {
 
 void get_std_bbody_energy_grid(int *n_ener, double **ener, int *status) {
   CHECK_STATUS_VOID(*status);
+  std::lock_guard<std::mutex> lock(shared_table_mutex());
   if (global_bbody_ener_std == NULL) {
     global_bbody_ener_std = (double *) malloc((N_BBODY_ENER + 1) * sizeof(double));
     CHECK_MALLOC_VOID_STATUS(global_bbody_ener_std, status)
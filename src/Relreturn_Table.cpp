@@ -18,10 +18,12 @@
 
 #include "Relphysics.h"
 #include "Relreturn_Table.h"
+#include "Relcontext.h"
 
 extern "C" {
 #include "relutility.h"
 #include "xilltable.h"
+#include "relshm.h"
 }
 
 returnTable *cached_retTable = nullptr;
@@ -35,6 +37,7 @@ static returnTable *new_returnTable(int *status) {
 
   auto tab = (returnTable *) malloc(sizeof(returnTable));
   CHECK_MALLOC_RET_STATUS(tab, status, tab)
+  tab->shm = nullptr;
 
   return tab;
 }
@@ -88,9 +91,39 @@ static void free_returnFracData(tabulatedReturnFractions *dat) {
   }
 }
 
+// the data is in shared memory, only the arrays of pointers to it are freed
+static void free_returnFracData_shm(tabulatedReturnFractions *dat) {
+
+  if (dat != NULL) {
+    free(dat->frac_e);
+    free(dat->tf_r);
+    free(dat->gmin);
+    free(dat->gmax);
+
+    if (dat->frac_g != NULL) {
+      for (int ii = 0; ii < dat->nrad; ii++) {
+        free(dat->frac_g[ii]);
+      }
+      free(dat->frac_g);
+    }
+
+    free(dat);
+  }
+}
+
 static void free_returnTable(returnTable **tab) {
 
-  if (*tab != NULL) {
+  if (*tab != NULL && (*tab)->shm != nullptr) {
+    if ((*tab)->retFrac != NULL) {
+      for (int ii = 0; ii < (*tab)->nspin; ii++) {
+        free_returnFracData_shm((*tab)->retFrac[ii]);
+      }
+      free((*tab)->retFrac);
+    }
+    close_shm_table((*tab)->shm);
+    free(*tab);
+
+  } else if (*tab != NULL) {
 
     if ((*tab)->spin != NULL) {
       for (int ii = 0; ii < (*tab)->nspin; ii++) {
@@ -383,10 +416,154 @@ static void fits_read_returnRadTable(char *filename, returnTable **inp_tab, int
 
 }
 
+/* return table in shared memory (as doubles): nspin, spin, and for each spin nrad, ng, a, rlo, rhi, f_ret,
+ * f_inf, f_bh, frac_e, tf_r, gmin, gmax, frac_g */
+static size_t get_returnTable_shm_size(const returnTable *tab) {
+  size_t size = 1 + tab->nspin;
+  for (int ii = 0; ii < tab->nspin; ii++) {
+    const size_t nrad = tab->retFrac[ii]->nrad;
+    size += 3 + 5 * nrad + 4 * nrad * nrad + nrad * nrad * tab->retFrac[ii]->ng;
+  }
+  return size * sizeof(double);
+}
+
+static double *copy_to_shm(double *dest, const double *src, size_t n) {
+  memcpy(dest, src, sizeof(double) * n);
+  return dest + n;
+}
+
+static double *copy_2d_to_shm(double *dest, double *const *src, int n1, int n2) {
+  for (int ii = 0; ii < n1; ii++) {
+    dest = copy_to_shm(dest, src[ii], n2);
+  }
+  return dest;
+}
+
+static void write_returnTable_shm(const returnTable *tab, double *data) {
+  *data++ = tab->nspin;
+  data = copy_to_shm(data, tab->spin, tab->nspin);
+
+  for (int ii = 0; ii < tab->nspin; ii++) {
+    const tabulatedReturnFractions *dat = tab->retFrac[ii];
+    *data++ = dat->nrad;
+    *data++ = dat->ng;
+    *data++ = dat->a;
+    data = copy_to_shm(data, dat->rlo, dat->nrad);
+    data = copy_to_shm(data, dat->rhi, dat->nrad);
+    data = copy_to_shm(data, dat->f_ret, dat->nrad);
+    data = copy_to_shm(data, dat->f_inf, dat->nrad);
+    data = copy_to_shm(data, dat->f_bh, dat->nrad);
+    data = copy_2d_to_shm(data, dat->frac_e, dat->nrad, dat->nrad);
+    data = copy_2d_to_shm(data, dat->tf_r, dat->nrad, dat->nrad);
+    data = copy_2d_to_shm(data, dat->gmin, dat->nrad, dat->nrad);
+    data = copy_2d_to_shm(data, dat->gmax, dat->nrad, dat->nrad);
+    for (int jj = 0; jj < dat->nrad; jj++) {
+      data = copy_2d_to_shm(data, dat->frac_g[jj], dat->nrad, dat->ng);
+    }
+  }
+}
+
+// array of pointers to the rows of a 2d array in shared memory
+static double **new_2d_from_shm(double **data, int n1, int n2, int *status) {
+  auto arr = (double **) malloc(n1 * sizeof(double *));
+  CHECK_MALLOC_RET_STATUS(arr, status, NULL)
+  for (int ii = 0; ii < n1; ii++) {
+    arr[ii] = *data + ((size_t) ii) * n2;
+  }
+  *data += ((size_t) n1) * n2;
+  return arr;
+}
+
+static returnTable *new_returnTable_shm(relShm *shm, int *status) {
+
+  CHECK_STATUS_RET(*status, NULL);
+
+  size_t size;
+  auto data = (double *) get_shm_table_data(shm, &size);
+
+  returnTable *tab = new_returnTable(status);
+  CHECK_STATUS_RET(*status, NULL);
+  init_returnTable(tab, (int) *data++, status);
+  tab->shm = shm;
+  CHECK_STATUS_RET(*status, tab);
+  tab->spin = data;
+  data += tab->nspin;
+
+  for (int ii = 0; ii < tab->nspin; ii++) {
+    tab->retFrac[ii] = nullptr;
+  }
+
+  for (int ii = 0; ii < tab->nspin; ii++) {
+    int nrad = (int) *data++;
+    int ng = (int) *data++;
+    tabulatedReturnFractions *dat = new_returnFracData(nrad, ng, status);
+    CHECK_STATUS_RET(*status, tab);
+    tab->retFrac[ii] = dat;
+
+    dat->a = *data++;
+    dat->rlo = data;
+    dat->rhi = data + nrad;
+    dat->f_ret = data + 2 * nrad;
+    dat->f_inf = data + 3 * nrad;
+    dat->f_bh = data + 4 * nrad;
+    data += 5 * nrad;
+
+    dat->frac_e = new_2d_from_shm(&data, nrad, nrad, status);
+    dat->tf_r = new_2d_from_shm(&data, nrad, nrad, status);
+    dat->gmin = new_2d_from_shm(&data, nrad, nrad, status);
+    dat->gmax = new_2d_from_shm(&data, nrad, nrad, status);
+
+    dat->frac_g = (double ***) malloc(nrad * sizeof(double **));
+    CHECK_MALLOC_RET_STATUS(dat->frac_g, status, tab)
+    for (int jj = 0; jj < nrad; jj++) {
+      dat->frac_g[jj] = new_2d_from_shm(&data, nrad, ng, status);
+    }
+  }
+
+  return tab;
+}
+
+/** the table is published in shared memory by the first process (if RELXILL_SHARED_TABLES is set) **/
+static void read_returnRadTable(char *filename, returnTable **inp_tab, int *status) {
+
+  CHECK_STATUS_VOID(*status);
+
+  relShm *shm = nullptr;
+  if (use_shared_tables()) {
+    shm = open_shm_table("rrad", get_shm_table_checksum(filename, "rrad", nullptr, 0, status));
+  }
+  if (shm == nullptr) {
+    fits_read_returnRadTable(filename, inp_tab, status);
+    return;
+  }
+
+  if (!is_shm_table_published(shm)) {
+    returnTable *tab = nullptr;
+    fits_read_returnRadTable(filename, &tab, status);
+
+    size_t size = (*status == EXIT_SUCCESS) ? get_returnTable_shm_size(tab) : 0;
+    auto data = (*status == EXIT_SUCCESS) ? (double *) alloc_shm_table(shm, size) : nullptr;
+    if (data == nullptr) {
+      close_shm_table(shm);
+      (*inp_tab) = tab;
+      return;
+    }
+    write_returnTable_shm(tab, data);
+    publish_shm_table(shm);
+    free_returnTable(&tab);
+  }
+
+  (*inp_tab) = new_returnTable_shm(shm, status);
+  if (*status != EXIT_SUCCESS) {
+    free_returnTable(inp_tab);
+  }
+}
+
 returnTable *get_returnrad_table(int *status) {
 
+  std::lock_guard<std::mutex> lock(shared_table_mutex());
   if (cached_retTable==NULL) {
-    fits_read_returnRadTable((char *) RETURNRAD_TABLE_FILENAME, &cached_retTable, status);
+    read_returnRadTable((char *) RETURNRAD_TABLE_FILENAME, &cached_retTable, status);
   }
 
   return cached_retTable;
@@ -53,6 +53,8 @@ typedef struct {
 
   tabulatedReturnFractions **retFrac;
 
+  struct relShm *shm;  // shared memory of the data (NULL if not shared, see relshm.h)
+
 } returnTable;
 
 
@@ -0,0 +1,74 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+#ifndef RELSIMD_H_
+#define RELSIMD_H_
+
+/** minimal wrappers of the SIMD instructions for doubles
+ *  - AVX-512 if enabled by the compiler flags (e.g., -march=native), otherwise AVX2 on x86 with gcc or
+ *    clang, which is compiled for the functions marked RELXILL_SIMD_TARGET only and used if the CPU
+ *    supports it (checked at runtime, such that the default build runs on all machines)
+ *  - code using them has to check use_simd_lanes() first, else the scalar loops are used
+ *  - only loads/stores (unaligned), add, sub and mul are wrapped, such that a loop written with
+ *    them gives exactly the same result as the same scalar loop (no fused operations) **/
+
+/** ENV variable to switch off the SIMD loops (RELXILL_SIMD=0), e.g., to compare with the scalar ones **/
+#define ENV_RELXILL_SIMD "RELXILL_SIMD"
+
+#if defined(__AVX512F__) || ((defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)))
+#define RELXILL_SIMD
+#include <immintrin.h>
+#include <cstdlib>
+
+#if defined(__AVX512F__)
+#define RELXILL_SIMD_TARGET
+typedef __m512d simd_double;
+const int SIMD_DOUBLE_LANES = 8;
+inline simd_double simd_load(const double *ptr) { return _mm512_loadu_pd(ptr); }
+inline void simd_store(double *ptr, simd_double val) { _mm512_storeu_pd(ptr, val); }
+inline simd_double simd_set1(double val) { return _mm512_set1_pd(val); }
+inline simd_double simd_add(simd_double a, simd_double b) { return _mm512_add_pd(a, b); }
+inline simd_double simd_sub(simd_double a, simd_double b) { return _mm512_sub_pd(a, b); }
+inline simd_double simd_mul(simd_double a, simd_double b) { return _mm512_mul_pd(a, b); }
+inline int is_simd_supported() { return 1; }
+#else
+#define RELXILL_SIMD_TARGET __attribute__((target("avx2")))
+typedef __m256d simd_double;
+const int SIMD_DOUBLE_LANES = 4;
+RELXILL_SIMD_TARGET inline simd_double simd_load(const double *ptr) { return _mm256_loadu_pd(ptr); }
+RELXILL_SIMD_TARGET inline void simd_store(double *ptr, simd_double val) { _mm256_storeu_pd(ptr, val); }
+RELXILL_SIMD_TARGET inline simd_double simd_set1(double val) { return _mm256_set1_pd(val); }
+RELXILL_SIMD_TARGET inline simd_double simd_add(simd_double a, simd_double b) { return _mm256_add_pd(a, b); }
+RELXILL_SIMD_TARGET inline simd_double simd_sub(simd_double a, simd_double b) { return _mm256_sub_pd(a, b); }
+RELXILL_SIMD_TARGET inline simd_double simd_mul(simd_double a, simd_double b) { return _mm256_mul_pd(a, b); }
+inline int is_simd_supported() {
+  static const int supported = (__builtin_cpu_supports("avx2") != 0);
+  return supported;
+}
+#endif
+
+inline int use_simd_lanes() {
+  const char *env = getenv(ENV_RELXILL_SIMD);
+  if (env != nullptr && strtod(env, nullptr) == 0) {
+    return 0;
+  }
+  return is_simd_supported();
+}
+
+#endif
+
+#endif //RELSIMD_H_
@@ -0,0 +1,172 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+#ifndef RELTHREADS_H_
+#define RELTHREADS_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** persistent worker threads for parallel_for, such that no threads need to be started for every call
+ *  - the threads are started on first use (and more are added if more are requested later)
+ *  - only one parallel_for can use the pool at a time; if it is busy (by another thread, or by a
+ *    nested call from a task) try_run returns false and the caller does the work on its own **/
+class WorkerPool {
+
+ public:
+  static WorkerPool &instance() {
+    static WorkerPool pool;
+    return pool;
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cond_start.notify_all();
+    for (auto &thread: m_threads) {
+      thread.join();
+    }
+  }
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  /** call work(ithread) for all ithread in [0,num_threads), where ithread=0 is the calling thread
+   *  (work must not throw); returns false, without calling work, if the pool is busy **/
+  bool try_run(int num_threads, const std::function<void(int)> &work) {
+    if (is_in_pool()) {
+      return false;
+    }
+    std::unique_lock<std::mutex> busy_lock(m_busy_mutex, std::try_to_lock);
+    if (!busy_lock.owns_lock()) {
+      return false;
+    }
+
+    is_in_pool() = true;
+    start_threads(num_threads - 1);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_work = &work;
+      m_num_workers = num_threads - 1;
+      m_num_running = num_threads - 1;
+      m_generation++;
+    }
+    m_cond_start.notify_all();
+
+    work(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond_done.wait(lock, [this] { return m_num_running == 0; });
+    m_work = nullptr;
+    is_in_pool() = false;
+    return true;
+  }
+
+ private:
+  WorkerPool() = default;
+
+  /** set for the worker threads and for the thread calling try_run, while it is running **/
+  static bool &is_in_pool() {
+    static thread_local bool in_pool = false;
+    return in_pool;
+  }
+
+  void start_threads(int num_workers) {
+    for (int ithread = static_cast<int>(m_threads.size()) + 1; ithread <= num_workers; ithread++) {
+      m_threads.emplace_back(&WorkerPool::worker_loop, this, ithread);
+    }
+  }
+
+  void worker_loop(int ithread) {
+    is_in_pool() = true;
+    size_t generation = 0;
+    while (true) {
+      const std::function<void(int)> *work;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond_start.wait(lock, [&] { return m_stop || m_generation != generation; });
+        if (m_stop) {
+          return;
+        }
+        generation = m_generation;
+        if (ithread > m_num_workers) {  // not needed for this call
+          continue;
+        }
+        work = m_work;
+      }
+
+      (*work)(ithread);
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (--m_num_running == 0) {
+        m_cond_done.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> m_threads;      // worker ithread is m_threads[ithread-1]
+  std::mutex m_busy_mutex;                 // held while the pool is used by a parallel_for
+  std::mutex m_mutex;
+  std::condition_variable m_cond_start;
+  std::condition_variable m_cond_done;
+  const std::function<void(int)> *m_work = nullptr;
+  int m_num_workers = 0;
+  int m_num_running = 0;
+  size_t m_generation = 0;
+  bool m_stop = false;
+};
+
+/** call func(ii, ithread) for all ii in [0,n) on num_threads threads
+ *  - the indices are handed out one by one to the next free thread, such that different costs
+ *    per index are balanced; ithread in [0,num_threads) can be used for working structures of
+ *    the thread, which must not be shared
+ *  - results should be stored per index and combined in a fixed order afterwards, to be
+ *    independent of the number of threads
+ *  - the threads are taken from the WorkerPool; if it is busy, or for num_threads<=1, everything
+ *    is done in the calling thread (with ithread=0)
+ *  - func must not throw, errors have to be returned per index **/
+template<typename Func>
+void parallel_for(int n, int num_threads, Func func) {
+
+  if (num_threads > n) {
+    num_threads = n;
+  }
+
+  if (num_threads > 1) {
+    std::atomic<int> next_index{0};
+    std::function<void(int)> work = [&](int ithread) {
+      for (int ii = next_index++; ii < n; ii = next_index++) {
+        func(ii, ithread);
+      }
+    };
+    if (WorkerPool::instance().try_run(num_threads, work)) {
+      return;
+    }
+  }
+
+  for (int ii = 0; ii < n; ii++) {
+    func(ii, 0);
+  }
+}
+
+#endif //RELTHREADS_H_
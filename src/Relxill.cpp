@@ -21,22 +21,19 @@
 #include "XspecSpectrum.h"
 #include "Relreturn_Corona.h"
 #include "PrimarySource.h"
+#include "Relcontext.h"
+#include "Relthreads.h"
 
 extern "C" {
 #include "xilltable.h"
 }
 
-/** caching parameters **/
-relParam *cached_rel_param = nullptr;
-xillParam *cached_xill_param = nullptr;
-
 ///////////////////////////////////////
 // Forward Definitions of Functions  //
 ///////////////////////////////////////
 
 void free_arrays_relxill_kernel(int n_zones,
                                 const double *conv_out,
-                                const double *single_spec_inp,
                                 double *const *xill_angledep_spec);
 
 
@@ -49,8 +46,8 @@ void relxill_convolution_multizone(const XspecSpectrum &spectrum,
                                    const relline_spec_multizone *rel_profile,
                                    const SpectrumZones &xill_spec_zones,
                                    specCache *spec_cache,
-                                   const relParam *rel_param,
                                    const CachingStatus &caching_status,
+                                   int recompute_xill_fft,
                                    int *status);
 /**
  * check if the complete spectrum is cached and if the energy grid did not change
@@ -85,11 +82,12 @@ static void check_caching_energy_grid(CachingStatus &caching_status, specCache *
 }
 
 /**
- * @brief test if the m_rel_param number of zones is different from the global cache
+ * @brief test if the m_rel_param number of zones is different from the cached parameters
  * @param rel_param
+ * @param cached_rel_param
  * @return bool
  */
-static int did_number_of_zones_change(const relParam *rel_param) {
+static int did_number_of_zones_change(const relParam *rel_param, const relParam *cached_rel_param) {
 
   if (cached_rel_param == nullptr) {
     return 1;
@@ -108,10 +106,14 @@ static int did_number_of_zones_change(const relParam *rel_param) {
 
 static void check_caching_parameters(CachingStatus &caching_status,
                                      const relParam *rel_param,
-                                     const xillParam *xill_param) {
+                                     const xillParam *xill_param,
+                                     const ModelCacheContext *context) {
+
+  const relParam *cached_rel_param = context->cached_rel_param;
+  const xillParam *cached_xill_param = context->cached_xill_param;
 
   // special case: no caching if output files are to be written
-  if (shouldOutfilesBeWritten() || did_number_of_zones_change(rel_param)) {
+  if (shouldOutfilesBeWritten() || did_number_of_zones_change(rel_param, cached_rel_param)) {
     caching_status.relat = cached::no;
     caching_status.xill = cached::no;
   } else {
@@ -227,37 +229,126 @@ xillSpec **get_xillver_reflection_spectra(specCache *spec_cache,
                                           cached caching_status_xill) {
   auto xill_spec = spec_cache->xill_spec;
 
-  int status = EXIT_SUCCESS;
-  // --- 3 --- calculate xillver reflection spectra  (for every zone)
-  for (int ii = 0; ii < nzones; ii++) {
-    if (caching_status_xill
-        == cached::no) { // (always need to re-compute for an ionization gradient, TODO: can we do better caching?)
-      if (xill_spec[ii]
-          != nullptr) { // as the spectrum is not cached, free the memory to be able to load a new spectrum
-        free_xill_spec(xill_spec[ii]);
-      }
-      xill_spec[ii] = get_xillver_spectra_table(xill_param_zone[ii], &status);
-    }
+  // (always need to re-compute for an ionization gradient, TODO: can we do better caching?)
+  if (caching_status_xill != cached::no) {
+    return xill_spec;
   }
+  spec_cache->xill_incl_fft_valid = 0;
 
-  if (status != EXIT_SUCCESS) {
-    throw std::exception();
+  // --- 3 --- calculate xillver reflection spectra  (for every zone, in parallel)
+  std::vector<int> status_zone(nzones, EXIT_SUCCESS);
+  parallel_for(nzones, get_num_threads(), [&](int ii, int) {
+    if (xill_spec[ii] != nullptr) { // as the spectrum is not cached, free the memory to be able to load a new spectrum
+      free_xill_spec(xill_spec[ii]);
+    }
+    xill_spec[ii] = get_xillver_spectra_table(xill_param_zone[ii], &status_zone[ii]);
+  });
+
+  for (int status: status_zone) {
+    if (status != EXIT_SUCCESS) {
+      throw std::exception();
+    }
   }
 
   return xill_spec;
 }
 
 
+static size_t size_of_spectrum(const spectrum *spec) {
+  return sizeof(spectrum) + 2 * (size_t) spec->n_ener * sizeof(double);
+}
+
+/** key of the final spectrum: the model, all parameter values (exactly), the energy grid and the ENV
+ *  switches changing how the spectrum is calculated (which can differ in the last digits) **/
+static CacheKey get_output_spec_cache_key(const XspecSpectrum &spectrum, const ModelParams &params) {
+  CacheKey key;
+  key.add(static_cast<int>(params.get_model_name()));
+  for (const auto &name: params.get_parnames()) {
+    key.add(static_cast<int>(name));
+    key.add_exact(params[name]);
+  }
+  key.add_fingerprint(spectrum.energy, static_cast<int>(spectrum.n_energy()), CACHE_LIMIT_ENER);
+  key.add(use_adaptive_conv_energy_grid());
+  key.add(do_fftw_float_convolution());
+  key.add(use_relline_cdf_engine());
+  key.add(do_fft_sum_zones());
+  key.add(do_fft_mix_xillver_inclinations());
+  return key;
+}
+
+static int use_output_spec_cache() {
+  return !shouldOutfilesBeWritten() && get_output_cache_size() > 0;
+}
+
+/** copy the final spectrum from the cache, if it was calculated before (returns 1 if found) **/
+static int copy_spectrum_from_output_cache(const CacheKey &key, const XspecSpectrum &xspec_spectrum) {
+  LruCache<spectrum> *cache_output_spec = RelxillContext::current()->cache_output_spec;
+  if (cache_output_spec == nullptr || !use_output_spec_cache()) {
+    return 0;
+  }
+
+  spectrum *cached_spec = cache_output_spec->find(key);
+  if (cached_spec == nullptr) {
+    return 0;
+  }
+
+  if (is_debug_run()) {
+    printf(" DEBUG:  OUTPUT-Cache: re-using the calculated spectrum (%zu hits, %zu misses) \n",
+           cache_output_spec->hits(), cache_output_spec->misses());
+  }
+  memcpy(xspec_spectrum.flux, cached_spec->flux, xspec_spectrum.num_flux_bins() * sizeof(double));
+  return 1;
+}
+
+static void add_spectrum_to_output_cache(const CacheKey &key, const XspecSpectrum &xspec_spectrum, int *status) {
+  CHECK_STATUS_VOID(*status);
+  if (!use_output_spec_cache()) {
+    return;
+  }
+
+  // the last final spectra of relxill_kernel (keyed by all model parameters and the energy grid)
+  RelxillContext *context = RelxillContext::current();
+  if (context->cache_output_spec == nullptr) {
+    context->cache_output_spec = new LruCache<spectrum>(get_cache_max_bytes(), size_of_spectrum, free_spectrum,
+                                                        static_cast<size_t>(get_output_cache_size()));
+  }
+
+  spectrum *spec = new_spectrum(xspec_spectrum.num_flux_bins(), xspec_spectrum.energy, status);
+  memcpy(spec->flux, xspec_spectrum.flux, xspec_spectrum.num_flux_bins() * sizeof(double));
+  context->cache_output_spec->insert(key, spec);
+}
+
+const LruCache<spectrum> *get_relxill_output_cache() {
+  return RelxillContext::current()->cache_output_spec;
+}
+
+void free_relxill_output_cache() {
+  RelxillContext *context = RelxillContext::current();
+  delete context->cache_output_spec;
+  context->cache_output_spec = nullptr;
+}
+
 ///////////////////////////////////////
 // MAIN: Relxill Kernel Function     //
 ///////////////////////////////////////
 
 /** @brief convolve a xillver spectrum with the relbase kernel
+ *  (the cached values of the last evaluation are stored in the cache context of the model component,
+ *  all other caches are taken from the RelxillContext owning it)
  */
 void relxill_kernel(const XspecSpectrum &spectrum,
                     const ModelParams &params,
+                    ModelCacheContext *context,
                     int *status) {
 
+  RelxillContextGuard context_guard(context->relxill_context);
+
+  // evaluating the same parameters again (as done by the fit and error routines) only needs a copy
+  CacheKey output_key = get_output_spec_cache_key(spectrum, params);
+  if (copy_spectrum_from_output_cache(output_key, spectrum)) {
+    return;
+  }
+
   relParam *rel_param = nullptr;
   xillParam *xill_param = nullptr;
   get_relxill_params(params, rel_param, xill_param);
@@ -267,25 +358,27 @@ void relxill_kernel(const XspecSpectrum &spectrum,
   // in case of an ionization gradient, we need to update the number of zones, make sure they are set correctly
   assert(rel_param->num_zones == get_num_zones(rel_param->model_type, rel_param->emis_type, rel_param->ion_grad_type));
 
-  specCache *spec_cache = init_global_specCache(status);
+  specCache *spec_cache = get_context_spec_cache(context, N_ZONES_MAX, status);
   assert(spec_cache != nullptr);
 
   auto caching_status = CachingStatus();
-  check_caching_parameters(caching_status, rel_param, xill_param);
+  check_caching_parameters(caching_status, rel_param, xill_param, context);
   check_caching_energy_grid(caching_status, spec_cache, spectrum);
 
   RelSysPar *sys_par = get_system_parameters(rel_param, status);
   auto primary_source = PrimarySource(params, sys_par, spectrum);
 
   if (caching_status.is_all_cached()) { // if already cached, simply use the cached output flux value
+    context->hits++;
     for (int ii = 0; ii < spectrum.num_flux_bins(); ii++) {
       spectrum.flux[ii] = spec_cache->out_spec->flux[ii];
     }
 
   } else {
+    context->misses++;
     // store the parameters for which we are calculating
-    set_cached_xill_param(xill_param, &cached_xill_param, status);
-    set_cached_rel_param(rel_param, &cached_rel_param, status);
+    set_cached_xill_param(xill_param, &context->cached_xill_param, status);
+    set_cached_rel_param(rel_param, &context->cached_rel_param, status);
     CHECK_STATUS_VOID(*status);
 
     // --- 1 --- calculate the accretion disk zones and set their parameters
@@ -308,29 +401,45 @@ void relxill_kernel(const XspecSpectrum &spectrum,
         nullptr;
 
     //  calculate the emissivity including the rrad correction factors (for those the disk parameters need to be known)
-    sys_par = get_system_parameters(rel_param, status); // no need to free this, is automatically done by the cache
+    //  -> these values depend on the xillver spectra and are therefore not cached, so we own them
+    RelSysPar *sys_par_rrad = nullptr;
+    if (rel_param->rrad_corr_factors != nullptr) {
+      sys_par_rrad = calc_system_parameters(rel_param, status);
+      sys_par = sys_par_rrad;
+    }
 
     // --- 4 --- calculate multi-zone relline profile
     xillTable *xill_tab = nullptr; // needed for the relbase_profile call
-    get_init_xillver_table(&xill_tab, xill_param->model_type, xill_param->prim_type, status);
+    {
+      std::lock_guard<std::mutex> lock(shared_table_mutex());
+      get_init_xillver_table(&xill_tab, xill_param->model_type, xill_param->prim_type, status);
+    }
 
     // calculate the relline profile
     int n_ener_conv; // energy grid for the convolution, only created
     double *ener_conv = nullptr;
-    get_relxill_conv_energy_grid(&n_ener_conv, &ener_conv, status);
-    relline_spec_multizone *rel_profile =
+    get_relxill_conv_energy_grid_adaptive(spectrum.energy[0], spectrum.energy[spectrum.num_flux_bins()], sys_par,
+                                          &n_ener_conv, &ener_conv, status);
+    relline_spec_multizone *rel_profile = (sys_par_rrad != nullptr) ?
+        calc_relbase_profile(ener_conv, n_ener_conv, rel_param, sys_par, xill_tab,
+                             ion_gradient.radial_grid.radius, ion_gradient.nzones(), status) :
         relbase_profile(ener_conv, n_ener_conv, rel_param, sys_par, xill_tab,
                         ion_gradient.radial_grid.radius, ion_gradient.nzones(), status);
 
     // --- 5 --- calculate the xillver spectra depending on the angular distribution (stored in the rel_profile)
     auto xillver_spectra_zones =
         SpectrumZones(xill_refl_spectra_zone[0]->ener, xill_refl_spectra_zone[0]->n_ener, ion_gradient.nzones());
-    for (int ii = 0; ii < ion_gradient.nzones(); ii++) {
+    std::vector<int> status_zone(ion_gradient.nzones(), EXIT_SUCCESS);
+    parallel_for(ion_gradient.nzones(), get_num_threads(), [&](int ii, int) {
       calc_xillver_angdep(xillver_spectra_zones.flux[ii],
                           xill_refl_spectra_zone[ii],
                           rel_profile->rel_cosne->dist[ii],
-                          status);
-
+                          &status_zone[ii]);
+    });
+    for (int zone_status: status_zone) {
+      if (zone_status != EXIT_SUCCESS) {
+        *status = zone_status;
+      }
     }
 
     // need to re-normalize the spectra due to the energy shift from the source to the disk
@@ -345,11 +454,18 @@ void relxill_kernel(const XspecSpectrum &spectrum,
     auto norm_change_factors = calc_xillver_normalization_change_source_to_disk(
         ion_gradient.m_energy_shift_source_disk, ion_gradient.nzones(), primary_source.source_parameters.xilltab_param()
     );
-    for (int ii = 0; ii < ion_gradient.nzones(); ii++) {
+    parallel_for(ion_gradient.nzones(), get_num_threads(), [&](int ii, int) {
       for (int jj = 0; jj < xillver_spectra_zones.num_flux_bins; jj++) {
         xillver_spectra_zones.flux[ii][jj] /= norm_change_factors[ii];
       }
-
+    });
+
+    // if set, calculate the transforms of these spectra by combining the cached transforms of all inclinations
+    int recompute_xill_fft = 1;
+    if (do_fft_mix_xillver_inclinations()) {
+      fftw_mix_xillver_inclinations(ener_conv, n_ener_conv, xill_refl_spectra_zone, rel_profile->rel_cosne->dist,
+                                    norm_change_factors, ion_gradient.nzones(), spec_cache, status);
+      recompute_xill_fft = 0;
     }
     delete[] norm_change_factors;
 
@@ -360,16 +476,22 @@ void relxill_kernel(const XspecSpectrum &spectrum,
                                   rel_profile,
                                   xillver_spectra_zones,
                                   spec_cache,
-                                  rel_param,
                                   caching_status,
+                                  recompute_xill_fft,
                                   status);
 
     copy_spectrum_to_cache(spectrum, spec_cache, status);
+    if (sys_par_rrad != nullptr) {
+      free_rel_spec(rel_profile);
+      free_relSysPar(sys_par_rrad);
+    }
     free_rrad_corr_factors(&(rel_param->rrad_corr_factors));
   }
 
   primary_source.add_primary_spectrum(spectrum);
 
+  add_spectrum_to_output_cache(output_key, spectrum, status);
+
   delete rel_param;
   delete xill_param;
 
@@ -380,68 +502,98 @@ void relxill_convolution_multizone(const XspecSpectrum &spectrum,
                                    const relline_spec_multizone *rel_profile,
                                    const SpectrumZones &xill_spec_zones,
                                    specCache *spec_cache,
-                                   const relParam *rel_param,
                                    const CachingStatus &caching_status,
+                                   int recompute_xill_fft,
                                    int *status) {
 
   CHECK_STATUS_VOID(*status);
 
   const int n_ener_conv = rel_profile->n_ener;
   double* ener_conv = rel_profile->ener;
+  const int n_zones = rel_profile->n_zones;
 
-  auto conv_out = new double[n_ener_conv];
-  auto single_spec_inp = new double[spectrum.num_flux_bins()];
-  auto xill_rebinned_spec = new double *[rel_param->num_zones];
+  auto conv_out = new double[n_zones * n_ener_conv];
+  auto xill_rebinned_spec = new double *[n_zones];
 
   // make sure the output array is set to 0
   for (int ie = 0; ie < spectrum.num_flux_bins(); ie++) {
     spectrum.flux[ie] = 0.0;
   }
 
-  for (int ii = 0; ii < rel_profile->n_zones; ii++) { /***** loop over ionization zones   ******/
+  // --1-- rebin the xillver spectra to the energy grid "ener_conv"
+  parallel_for(n_zones, get_num_threads(), [&](int ii, int) {
+    xill_rebinned_spec[ii] = nullptr;
 
     /** avoid problems where no relxill bin falls into an ionization bin **/
     if (calcSum(rel_profile->flux[ii], rel_profile->n_ener) < 1e-12) {
-      continue;
+      return;
     }
 
     xill_rebinned_spec[ii] = new double[n_ener_conv];
     rebin_spectrum(ener_conv, xill_rebinned_spec[ii], n_ener_conv,
                    xill_spec_zones.energy() , xill_spec_zones.flux[ii], xill_spec_zones.num_flux_bins);
-
-    // --2-- convolve the spectrum on the energy grid "ener_conv" **
-    int recompute_xill = 1; // always recompute fft for xillver, as relat changes the angular distribution
-    convolveSpectrumFFTNormalized(ener_conv, xill_rebinned_spec[ii], rel_profile->flux[ii], conv_out, n_ener_conv,
-                                  caching_status.recomput_relat(), recompute_xill, ii, spec_cache, status);
+  });
+
+  // --2-- convolve the spectra of all zones at once (the fft for xillver always needs to be recomputed, as
+  //       relat changes the angular distribution, except it was already combined in Fourier space)
+  // if set, already sum the zones in Fourier space (not possible if the spectra of the zones are written out)
+  if (do_fft_sum_zones() && !(is_debug_run() && n_zones <= 10)) {
+    fftw_conv_spectrum_zones_summed(ener_conv, xill_rebinned_spec, rel_profile->flux, conv_out, n_ener_conv, n_zones,
+                                    caching_status.recomput_relat(), recompute_xill_fft, spec_cache, status);
     CHECK_STATUS_VOID(*status);
-    rebin_spectrum(spectrum.energy, single_spec_inp, spectrum.num_flux_bins(), ener_conv, conv_out, n_ener_conv);
+    rebin_spectrum(spectrum.energy, spectrum.flux, spectrum.num_flux_bins(), ener_conv, conv_out, n_ener_conv);
+
+    free_arrays_relxill_kernel(n_zones, conv_out, xill_rebinned_spec);
+    return;
+  }
+
+  fftw_conv_spectrum_zones(ener_conv, xill_rebinned_spec, rel_profile->flux, conv_out, n_ener_conv, n_zones,
+                           caching_status.recomput_relat(), recompute_xill_fft, spec_cache, status);
+  CHECK_STATUS_VOID(*status);
+
+  // normalize the zones and rebin them to the output grid (in parallel)
+  const int n_flux = spectrum.num_flux_bins();
+  std::vector<double> zone_spec_out(static_cast<size_t>(n_zones) * n_flux);
+  parallel_for(n_zones, get_num_threads(), [&](int ii, int) {
+    if (xill_rebinned_spec[ii] == nullptr) {
+      return;
+    }
+    double *conv_out_zone = conv_out + ii * n_ener_conv;
+    normalizeFFTOutput(ener_conv, xill_rebinned_spec[ii], rel_profile->flux[ii], conv_out_zone, n_ener_conv);
+    rebin_spectrum(spectrum.energy, zone_spec_out.data() + ii * n_flux, n_flux, ener_conv, conv_out_zone,
+                   n_ener_conv);
+  });
+
+  for (int ii = 0; ii < n_zones; ii++) { /***** loop over ionization zones   ******/
+
+    if (xill_rebinned_spec[ii] == nullptr) {
+      continue;
+    }
 
-    // --3-- add it to the final output spectrum
-    for (int jj = 0; jj < spectrum.num_flux_bins(); jj++) {
-      spectrum.flux[jj] += single_spec_inp[jj];
+    // --3-- add it to the final output spectrum (always in the same order of the zones)
+    double *zone_spec = zone_spec_out.data() + ii * n_flux;
+    for (int jj = 0; jj < n_flux; jj++) {
+      spectrum.flux[jj] += zone_spec[jj];
     }
 
     if (is_debug_run() && rel_profile->n_zones <= 10) {
-      write_output_spec_zones(spectrum, single_spec_inp, ii, status);
+      write_output_spec_zones(spectrum, zone_spec, ii, status);
     }
 
   } /**** END OF LOOP OVER RADIAL ZONES *****/
 
-  free_arrays_relxill_kernel(rel_profile->n_zones, conv_out, single_spec_inp, xill_rebinned_spec);
+  free_arrays_relxill_kernel(rel_profile->n_zones, conv_out, xill_rebinned_spec);
 }
 
 /**
  * @brief free arrays allocated and needed by relxill_kernel
  * @param n_zones
  * @param conv_out
- * @param single_spec_inp
  * @param xill_angledep_spec
  */
 void free_arrays_relxill_kernel(int n_zones,
                                 const double *conv_out,
-                                const double *single_spec_inp,
                                 double *const *xill_angledep_spec) {
-  delete[] single_spec_inp;
   delete[] conv_out;
   for (int ii = 0; ii < n_zones; ii++) {
     delete[] xill_angledep_spec[ii];
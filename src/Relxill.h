@@ -108,8 +108,13 @@ class CachingStatus {
 
 void relxill_kernel(const XspecSpectrum &spectrum,
                     const ModelParams &params,
+                    ModelCacheContext *context,
                     int *status);
 
+/** cache of the final spectra of relxill_kernel (its size is set by RELXILL_OUTPUT_CACHE_SIZE) **/
+const LruCache<spectrum> *get_relxill_output_cache();
+void free_relxill_output_cache();
+
 rradCorrFactors* calc_rrad_corr_factors(xillSpec **xill_spec, const RadialGrid &rgrid,
                                         xillTableParam *const *xill_table_param, int *status);
 
@@ -0,0 +1,151 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+
+#include "Xillprefetch.h"
+#include "Relcontext.h"
+
+#include <algorithm>
+
+extern "C" {
+#include "xilltable.h"
+}
+
+XillverPrefetcher::~XillverPrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+    m_requests.clear();
+  }
+  m_cond_request.notify_all();
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+void XillverPrefetcher::request(const xillTableParam *param, const xillTable *tab, const int *ind) {
+
+  if (tab->store_spectra != nullptr) {  // all spectra are available already
+    return;
+  }
+
+  int status = EXIT_SUCCESS;
+  float *param_vals = get_xilltab_paramvals(param, &status);
+  if (status != EXIT_SUCCESS) {
+    return;
+  }
+
+  std::vector<Request> cells;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  const int table_id = get_xilltable_id(param->model_type, param->prim_type);
+  auto last = m_last_param_vals.find(table_id);
+  if (last != m_last_param_vals.end()) {
+
+    // neighbouring cell in the direction of each parameter which changed (inclination is the last
+    // parameter of the table, all of them are loaded for every cell anyway)
+    Request diagonal{*param, std::vector<int>(ind, ind + tab->num_param)};
+    int num_moved = 0;
+    for (int ii = 0; ii < tab->num_param - 1; ii++) {
+      const float delta = param_vals[tab->param_index[ii]] - last->second[tab->param_index[ii]];
+      const int ind_next = ind[ii] + ((delta > 0) ? 1 : -1);
+      if (delta == 0 || ind_next < 0 || ind_next > tab->num_param_vals[ii] - 2) {
+        continue;
+      }
+      Request cell{*param, std::vector<int>(ind, ind + tab->num_param)};
+      cell.ind[ii] = ind_next;
+      cells.push_back(cell);
+
+      diagonal.ind[ii] = ind_next;
+      num_moved++;
+    }
+    if (num_moved > 1) {
+      cells.push_back(diagonal);
+    }
+  }
+
+  std::array<float, N_PARAM_MAX> vals{};
+  std::copy(param_vals, param_vals + N_PARAM_MAX, vals.begin());
+  m_last_param_vals[table_id] = vals;
+  free(param_vals);
+
+  if (cells.empty()) {
+    return;
+  }
+
+  // older requests are not needed any more, if the parameters moved on already
+  m_requests.assign(cells.begin(), cells.end());
+  if (!m_thread.joinable()) {
+    m_thread = std::thread(&XillverPrefetcher::loader_loop, this);
+  }
+  m_cond_request.notify_one();
+}
+
+void XillverPrefetcher::wait() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_cond_idle.wait(lock, [this] { return m_requests.empty() && !m_loading; });
+}
+
+void XillverPrefetcher::cancel() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_requests.clear();
+  m_last_param_vals.clear();
+  m_cond_idle.wait(lock, [this] { return !m_loading; });
+}
+
+void XillverPrefetcher::loader_loop() {
+  while (true) {
+    Request req;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond_request.wait(lock, [this] { return m_stop || !m_requests.empty(); });
+      if (m_stop) {
+        return;
+      }
+      req = m_requests.front();
+      m_requests.pop_front();
+      m_loading = true;
+    }
+
+    load_cell(req);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_loading = false;
+    m_cond_idle.notify_all();
+  }
+}
+
+void XillverPrefetcher::load_cell(const Request &req) {
+
+  std::lock_guard<std::mutex> lock(shared_table_mutex());
+
+  // the table is not stored in the request, as it might have been freed in the meantime
+  int status = EXIT_SUCCESS;
+  xillTable *tab = nullptr;
+  const char *fname = get_init_xillver_table(&tab, req.param.model_type, req.param.prim_type, &status);
+  if (status != EXIT_SUCCESS || tab->num_param != static_cast<int>(req.ind.size())) {
+    return;
+  }
+
+  prefetch_xilltab_cell(fname, &req.param, tab, req.ind.data(), &status);
+
+  // errors are not reported here, the evaluation will load the cell again if it is needed
+  if (status != EXIT_SUCCESS && is_debug_run()) {
+    printf(" DEBUG:  prefetching spectra of the xillver table %s failed \n", fname);
+  }
+}
@@ -0,0 +1,90 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+#ifndef XILLPREFETCH_H_
+#define XILLPREFETCH_H_
+
+extern "C" {
+#include "common.h"
+}
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** loads the spectra of the xillver table in the background, which are likely needed next
+ *  - after each evaluation the cells next to the current one, in the direction the parameters moved
+ *    since the last evaluation of this table, are requested (see request)
+ *  - a single thread loads them with prefetch_xilltab_cell, holding shared_table_mutex, such that it
+ *    never writes the storage while it is checked by an evaluation; the cell of an evaluation is pinned
+ *    while it is interpolated, so it is never freed by loading other spectra (see xillresidency.h)
+ *  - prefetched spectra are not marked as used, so with RELXILL_XILLVER_MAX_MB they are freed before the
+ *    spectra the evaluations actually used
+ *  - only older requests, which are not started yet, are dropped by a new request
+ *  - switched on by the ENV variable RELXILL_XILLVER_PREFETCH=1 **/
+class XillverPrefetcher {
+
+ public:
+  static XillverPrefetcher &instance() {
+    static XillverPrefetcher prefetcher;
+    return prefetcher;
+  }
+
+  ~XillverPrefetcher();
+
+  XillverPrefetcher(const XillverPrefetcher &) = delete;
+  XillverPrefetcher &operator=(const XillverPrefetcher &) = delete;
+
+  /** request the cells next to the cell ind (of length tab->num_param) of the evaluation with
+   *  param; needs to be called holding shared_table_mutex **/
+  void request(const xillTableParam *param, const xillTable *tab, const int *ind);
+
+  /** wait until all requested cells are loaded **/
+  void wait();
+
+  /** drop all requests and wait for the cell which is loaded at the moment (needs to be called
+   *  before the tables are freed) **/
+  void cancel();
+
+ private:
+  XillverPrefetcher() = default;
+
+  struct Request {
+    xillTableParam param;
+    std::vector<int> ind;
+  };
+
+  void loader_loop();
+  static void load_cell(const Request &req);
+
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_cond_request;
+  std::condition_variable m_cond_idle;
+  std::deque<Request> m_requests;
+  bool m_loading = false;
+  bool m_stop = false;
+
+  // parameter values (see get_xilltab_paramvals) of the last evaluation of each table
+  std::map<int, std::array<float, N_PARAM_MAX>> m_last_param_vals;
+};
+
+#endif /* XILLPREFETCH_H_ */
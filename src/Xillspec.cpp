@@ -18,6 +18,8 @@
 
 #include "Xillspec.h"
 #include "Relphysics.h"
+#include "Relcontext.h"
+#include "Xillprefetch.h"
 
 extern "C" {
 #include "xilltable.h"
@@ -40,6 +42,9 @@ xillSpec *get_xillver_spectra_table(const xillTableParam *param, int *status) {
 
   CHECK_STATUS_RET(*status, nullptr);
 
+  // the table is shared by all contexts, so loading the table and its spectra is serialized
+  std::unique_lock<std::mutex> lock(shared_table_mutex());
+
   xillTable *tab = nullptr;
   const char *fname = get_init_xillver_table(&tab, param->model_type, param->prim_type, status);
 
@@ -51,10 +56,25 @@ xillSpec *get_xillver_spectra_table(const xillTableParam *param, int *status) {
 
   // =2=  check if the necessary spectra for interpolation are loaded
   check_xilltab_cache(fname, param, tab, indparam, status);
+  const bool is_loaded = (*status == EXIT_SUCCESS);
+  if (is_loaded) {
+    if (do_xillver_prefetch()) {
+      XillverPrefetcher::instance().request(param, tab, indparam);
+    }
+    // the spectra must not be freed by other evaluations during the interpolation (see xillresidency.h)
+    pin_xilltab_cell(tab, indparam);
+  }
+  lock.unlock();
 
   // =3= interpolate values
   xillSpec *spec = interp_xill_table(tab, param, indparam, status);
 
+  if (is_loaded) {
+    lock.lock();
+    unpin_xilltab_cell(tab, indparam);
+    lock.unlock();
+  }
+
   CHECK_RELXILL_DEFAULT_ERROR(status);
 
   free(indparam);
@@ -62,6 +82,21 @@ xillSpec *get_xillver_spectra_table(const xillTableParam *param, int *status) {
 }
 
 
+/** preload the spectra of the xillver table of the model for all parameters from param_lo to param_hi, such
+ *  that later evaluations within these ranges do not need to read from the table (see preload_xilltab_spectra) **/
+void preload_xillver_spectra_table(const xillTableParam *param_lo, const xillTableParam *param_hi, int *status) {
+
+  CHECK_STATUS_VOID(*status);
+
+  std::lock_guard<std::mutex> lock(shared_table_mutex());
+
+  xillTable *tab = nullptr;
+  const char *fname = get_init_xillver_table(&tab, param_lo->model_type, param_lo->prim_type, status);
+  CHECK_STATUS_VOID(*status);
+
+  preload_xilltab_spectra(fname, param_lo, param_hi, tab, status);
+}
+
 /** @brief similar to get_xillver_spectra_table, but uses the full xill_param input (from xpsecc)
  *  @details see get_xillver_spectra_table for more details, this function is just a wrapper
  * @param param
@@ -145,6 +180,7 @@ static double get_photon_flux_band(const double *ener,
 EnerGrid *get_coarse_xillver_energrid(int *status) {
   CHECK_STATUS_RET(*status, nullptr);
 
+  std::lock_guard<std::mutex> lock(shared_table_mutex());
   if (global_xill_egrid_coarse == nullptr) {
     global_xill_egrid_coarse = new_EnerGrid(status);
     global_xill_egrid_coarse->nbins = N_ENER_COARSE;
@@ -230,6 +266,10 @@ void spec_nthcomp(double *pl_flux_xill,
   double kTe = xill_param->ect; // Important: kTe is given in the frame of the source
   double z = 1 / ener_shift - 1; // convert energy shift to redshift
   get_nthcomp_param(nthcomp_param, xill_param->gam, kTe, z);
+
+  // donthcomp keeps its state in static variables, so it can only be called by one thread at a time
+  static std::mutex donthcomp_mutex;
+  std::lock_guard<std::mutex> lock(donthcomp_mutex);
   c_donthcomp(ener, n_ener, nthcomp_param, pl_flux_xill);
 }
 
@@ -40,6 +40,8 @@ void norm_xillver_spec(xillSpec *spec, double incl);
 
 xillSpec *get_xillver_spectra_table(const xillTableParam *param, int *status);
 
+void preload_xillver_spectra_table(const xillTableParam *param_lo, const xillTableParam *param_hi, int *status);
+
 xillSpec *get_xillver_spectra(xillParam *param, int *status);
 
 
@@ -245,6 +245,15 @@ typedef struct {
 
 
 
+/** binary store of the spectra of a xillver table (see xillstore.h) */
+typedef struct xillStore xillStore;
+
+/** table shared between processes in shared memory (see relshm.h) */
+typedef struct relShm relShm;
+
+/** memory budget of the spectra loaded from a xillver table (see xillresidency.h) */
+typedef struct xillResidency xillResidency;
+
 /** the XILLVER table structure */
 typedef struct {
 
@@ -269,6 +278,16 @@ typedef struct {
   float **data_storage;   // storage of a n-dim table (n_elements spectra with n_ener bins each)
   int num_elements;
 
+  xillStore *store;       // binary store of the table (NULL if not available)
+  float *store_spectra;   // all spectra from the store (if set, they are used instead of data_storage)
+
+  int preload_checked;    // if the preload given by RELXILL_XILLVER_PRELOAD was already done
+
+  xillResidency *residency;  // order of use of the loaded spectra, to free them if the memory budget is exceeded
+
+  relShm *shm;            // shared memory of store_spectra (NULL if not shared, see relshm.h)
+  int shm_checked;        // if the shared memory was already tried
+
 } xillTable;
 
 typedef struct {
@@ -304,8 +323,8 @@ typedef struct {
   double *gstar;
   double *d_gstar;  // bin width for each gstar value
 
-  double ***trff;
-  double ***cosne;
+  double *trff;    // [2][nr][ng] in one slab, i.e., all g* values of a radius are contiguous
+  double *cosne;   // [2][nr][ng]
 
   emisProfile *emis;
 
@@ -346,21 +365,48 @@ typedef struct {
   double *flux;
 } spectrum;
 
+/** single precision arrays of the convolution (see RELXILL_FFTW_FLOAT), all zones stored contiguously **/
+typedef struct {
+  int n_ener;
+  float *fft_xill;   // [n_cache*n_ener]
+  float *fft_rel;    // [n_cache*n_ener]
+  fftwf_complex *fftw_xill;   // [n_cache*n_freq]
+  fftwf_complex *fftw_rel;    // [n_cache*n_freq]
+  int fft_rel_valid;          // 0 if the relat. transforms need to be re-calculated
+
+  fftwf_complex *fftw_backwards_input;  // [n_cache*n_freq]
+  float *fftw_output;  // [n_cache*n_ener]
+} specCacheFloat;
+
 typedef struct {
   int nzones;   // number of zones actually stored there
   int n_cache;  // number of array (nzones <= n_cache !!)
   int n_ener;
+  double* ener;     // [n_ener+1], energy grid of the convolution for which all arrays are set up
+  int ind_1keV;     // bin of the energy grid containing 1keV
   double* conversion_factor_energyflux; // conversion from photons/bin to keV/keV
-  double ***fft_xill;  // dimensions [n_cache,2,n_ener]
-  double ***fft_rel;   // dimensions [n_cache,2,n_ener]
+  fftw_complex* fftw_norm_band_weights; // [n_freq], to calculate the FFT normalization in Fourier space
 
-  fftw_complex** fftw_xill;  // dimensions [n_cache,n_ener]
-  fftw_complex** fftw_rel;   // dimensions [n_cache,n_ener]
+  // all zones are stored contiguously (i.e., fft_xill[ii] = fft_xill[0] + ii*n_ener), such
+  // that they can be transformed at once, the complex arrays have n_freq = n_ener/2+1 elements
+  double **fft_xill;  // dimensions [n_cache,n_ener]
+  double **fft_rel;   // dimensions [n_cache,n_ener]
 
-  fftw_complex* fftw_backwards_input;  // [nener]
-  double* fftw_output;  // [nener]
+  fftw_complex** fftw_xill;  // dimensions [n_cache,n_freq]
+  fftw_complex** fftw_rel;   // dimensions [n_cache,n_freq]
+  int fft_rel_valid;         // 0 if the relat. transforms need to be re-calculated (as the energy grid changed)
+  long n_rel_transforms;     // number of calls which transformed the relat. spectra (to check their caching)
+
+  // transforms of the xillver spectra of all inclinations, to combine them in Fourier space
+  int xill_incl_fft_valid;        // needs to be set to 0 if the xill_spec change
+  fftw_complex** fftw_xill_incl;  // dimensions [n_cache,n_incl*n_freq]
+
+  fftw_complex* fftw_backwards_input;  // [n_cache*n_freq]
+  double* fftw_output;  // [n_cache*n_ener]
   fftw_plan plan_c2r;
 
+  specCacheFloat *float_cache;  // only allocated if the single precision convolution is used
+
 
   xillSpec **xill_spec;
   spectrum *out_spec;
@@ -0,0 +1,55 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+
+extern "C" {
+#include "xillstore.h"
+#include "relutility.h"
+}
+
+#include <cstdio>
+#include <cstdlib>
+
+/** convert a xillver table (found in RELXILL_TABLE_PATH) into its binary store (see xillstore.h) **/
+int main(int argc, char *argv[]) {
+
+  if (argc != 2 && argc != 4) {
+    printf(" Usage: ./convert_xillstore <xillver table> [<logxi> <logN>] \n");
+    printf("  - the store is written next to the table, or to the directory given by %s \n", ENV_XILLVER_STORE);
+    printf("  - logxi and logN are used to normalize the spectra, if they are not a parameter of the table \n");
+    printf("    (default: logxi=0, logN=15) \n");
+    return EXIT_FAILURE;
+  }
+
+  double def_logxi = (argc == 4) ? atof(argv[2]) : 0.0;
+  double def_density = (argc == 4) ? atof(argv[3]) : 15.0;
+
+  int status = EXIT_SUCCESS;
+  char *store_filename = get_xillstore_filename(argv[1], &status);
+  if (store_filename == nullptr) {
+    printf(" *** error: the xillver store is switched off by %s \n", ENV_XILLVER_STORE);
+    return EXIT_FAILURE;
+  }
+
+  convert_xillver_table_to_store(argv[1], store_filename, def_logxi, def_density, &status);
+  if (status == EXIT_SUCCESS) {
+    printf(" written the xillver store %s \n", store_filename);
+  }
+
+  free(store_filename);
+  return status;
+}
@@ -152,7 +152,10 @@ def get_model_names(lmodeldat_file):
 
 def get_wrapper_lmod(local_model_name, function_name):
     parameter_list = "const double *energy, int Nflux, const double *parameter, int spectrum, double *flux, double *fluxError, const char *init"
-    function_call = "xspec_C_wrapper_eval_model(ModelName::" + local_model_name + ", parameter, flux, Nflux, energy);"
+    # the number of the spectrum identifies the model component, such that every dataset has its own cache
+    # (Xspec does not identify the components of the same model in one dataset, they share the cache)
+    function_call = "xspec_C_wrapper_eval_model(ModelName::" + local_model_name + \
+                    ", parameter, flux, Nflux, energy, spectrum);"
 
     return f"""
 extern "C" void {function_name}({parameter_list}) 
@@ -0,0 +1,379 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // necessary for mmap and shm_open with -std=c99
+#endif
+
+#include "relshm.h"
+#include "relutility.h"
+#include "xilltable.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define RELSHM_MAGIC "RXSHM"
+#define RELSHM_VERSION 1
+
+#define RELSHM_NAME_PREFIX "/relxill_"
+
+// start of the data in the segment (a page, such that the data can be mapped read-only on its own)
+#define RELSHM_DATA_OFFSET 4096
+
+#define RELSHM_STATE_LOADING 0
+#define RELSHM_STATE_PUBLISHED 1
+#define RELSHM_STATE_FAILED 2
+
+// time to wait (in ms) until the creator of a segment has set its size
+#define RELSHM_MAX_WAIT_INIT 10000
+
+// time to wait (in ms) until the creator of a segment has published it (afterwards it is considered stale)
+#define RELSHM_MAX_WAIT_LOAD 600000
+
+/** header at the beginning of the segment **/
+typedef struct {
+  char magic[8];
+  int32_t version;
+  int32_t state;        // RELSHM_STATE_*, only changed atomically
+  int64_t creator_pid;  // process filling the segment
+  uint64_t checksum;
+  uint64_t size;        // size of the data in bytes
+} relShmHeader;
+
+struct relShm {
+  char name[64];
+  int fd;  // kept by the creator until the data is allocated (the name might be removed as stale meanwhile)
+  void *map;
+  size_t map_size;
+  int is_creator;
+  int is_published;
+};
+
+int use_shared_tables(void) {
+  const char *env = getenv(ENV_SHARED_TABLES);
+  if (env != NULL) {
+    int envval = (int) strtod(env, NULL);
+    if (envval == 1) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static uint64_t fnv1a_update(uint64_t hash, const void *data, size_t n) {
+  const unsigned char *bytes = (const unsigned char *) data;
+  size_t ii;
+  for (ii = 0; ii < n; ii++) {
+    hash ^= bytes[ii];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+uint64_t get_shm_table_checksum(const char *table_filename, const char *kind, const double *values, int n_values,
+                                int *status) {
+
+  CHECK_STATUS_RET(*status, 0);
+
+  uint64_t hash = 14695981039346656037ULL;
+
+  int32_t version = RELSHM_VERSION;
+  hash = fnv1a_update(hash, &version, sizeof(version));
+  hash = fnv1a_update(hash, kind, strlen(kind));
+
+  char *full_filename = getFullPathTableName(table_filename, status);
+  CHECK_STATUS_RET(*status, 0);
+  hash = fnv1a_update(hash, full_filename, strlen(full_filename));
+
+  struct stat table_stat;
+  if (stat(full_filename, &table_stat) == 0) {
+    int64_t size = (int64_t) table_stat.st_size;
+    int64_t mtime = (int64_t) table_stat.st_mtime;
+    hash = fnv1a_update(hash, &size, sizeof(size));
+    hash = fnv1a_update(hash, &mtime, sizeof(mtime));
+  }
+  free(full_filename);
+
+  if (n_values > 0) {
+    hash = fnv1a_update(hash, values, sizeof(double) * n_values);
+  }
+
+  return hash;
+}
+
+static void sleep_ms(long ms) {
+  struct timespec ts;
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (ms % 1000) * 1000000;
+  nanosleep(&ts, NULL);
+}
+
+static relShmHeader *get_header(const relShm *shm) {
+  return (relShmHeader *) shm->map;
+}
+
+static relShm *create_shm_table(const char *name, uint64_t checksum, int fd) {
+
+  void *map = MAP_FAILED;
+  if (ftruncate(fd, RELSHM_DATA_OFFSET) == 0) {
+    map = mmap(NULL, RELSHM_DATA_OFFSET, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+
+  relShm *shm = (relShm *) malloc(sizeof(relShm));
+  if (map == MAP_FAILED || shm == NULL) {
+    if (map != MAP_FAILED) {
+      munmap(map, RELSHM_DATA_OFFSET);
+    }
+    close(fd);
+    free(shm);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  strcpy(shm->name, name);
+  shm->fd = fd;
+  shm->map = map;
+  shm->map_size = RELSHM_DATA_OFFSET;
+  shm->is_creator = 1;
+  shm->is_published = 0;
+
+  relShmHeader *header = get_header(shm);
+  memcpy(header->magic, RELSHM_MAGIC, sizeof(RELSHM_MAGIC));
+  header->version = RELSHM_VERSION;
+  header->creator_pid = (int64_t) getpid();
+  header->checksum = checksum;
+  header->size = 0;
+  __atomic_store_n(&header->state, RELSHM_STATE_LOADING, __ATOMIC_RELEASE);
+
+  return shm;
+}
+
+// wait until the segment is published by its creator and return its state, which is still
+// RELSHM_STATE_LOADING if the creator died or did not publish it within RELSHM_MAX_WAIT_LOAD
+static int wait_for_shm_table(const relShmHeader *header) {
+  long waited_ms;
+  for (waited_ms = 0; waited_ms < RELSHM_MAX_WAIT_LOAD; waited_ms += 10) {
+    int state = __atomic_load_n(&header->state, __ATOMIC_ACQUIRE);
+    if (state != RELSHM_STATE_LOADING) {
+      return state;
+    }
+    // the creator might have been terminated while loading the table (EPERM means it exists)
+    if (kill((pid_t) header->creator_pid, 0) != 0 && errno == ESRCH) {
+      break;
+    }
+    sleep_ms(10);
+  }
+  return __atomic_load_n(&header->state, __ATOMIC_ACQUIRE);
+}
+
+// mark a segment, which is not published (anymore), as failed and remove it, such that it can be created
+// again; the state is changed atomically, so only a single process removes it (returns 1 for this one)
+static int remove_unpublished_shm_table(relShmHeader *header, const char *name) {
+  int expected = RELSHM_STATE_LOADING;
+  if (__atomic_compare_exchange_n(&header->state, &expected, RELSHM_STATE_FAILED, 0, __ATOMIC_ACQ_REL,
+                                  __ATOMIC_ACQUIRE)) {
+    shm_unlink(name);
+    return 1;
+  }
+  return 0;
+}
+
+// attach to the segment of another process; is_stale is set if its creator died while loading it, in
+// which case the segment is removed
+static relShm *attach_shm_table(const char *name, uint64_t checksum, int *is_stale) {
+
+  // writable, such that a stale segment can be marked as failed (not possible for another user)
+  int prot_header = PROT_READ | PROT_WRITE;
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0) {
+    prot_header = PROT_READ;
+    fd = shm_open(name, O_RDONLY, 0);
+  }
+  if (fd < 0) {
+    return NULL;
+  }
+
+  // the size of the header is set by the creator right after the segment is created
+  struct stat shm_stat;
+  shm_stat.st_size = 0;
+  int ii;
+  for (ii = 0; ii < RELSHM_MAX_WAIT_INIT; ii++) {
+    if (fstat(fd, &shm_stat) != 0 || shm_stat.st_size >= RELSHM_DATA_OFFSET) {
+      break;
+    }
+    sleep_ms(1);
+  }
+
+  void *map = MAP_FAILED;
+  if (shm_stat.st_size >= RELSHM_DATA_OFFSET) {
+    map = mmap(NULL, RELSHM_DATA_OFFSET, prot_header, MAP_SHARED, fd, 0);
+  }
+  if (map == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+
+  relShmHeader *header = (relShmHeader *) map;
+  int is_valid = (memcmp(header->magic, RELSHM_MAGIC, sizeof(RELSHM_MAGIC)) == 0
+      && header->version == RELSHM_VERSION && header->checksum == checksum);
+  if (is_valid) {
+    int state = wait_for_shm_table(header);
+    if (state == RELSHM_STATE_LOADING && (prot_header & PROT_WRITE)) {
+      *is_stale = remove_unpublished_shm_table(header, name);
+    }
+    is_valid = (state == RELSHM_STATE_PUBLISHED);
+  }
+  size_t map_size = RELSHM_DATA_OFFSET + (size_t) header->size;
+  munmap(map, RELSHM_DATA_OFFSET);
+
+  // now map the header together with the data
+  map = MAP_FAILED;
+  if (is_valid && fstat(fd, &shm_stat) == 0 && (size_t) shm_stat.st_size >= map_size) {
+    map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+
+  relShm *shm = (map != MAP_FAILED) ? (relShm *) malloc(sizeof(relShm)) : NULL;
+  if (shm == NULL) {
+    if (map != MAP_FAILED) {
+      munmap(map, map_size);
+    }
+    if (is_debug_run()) {
+      printf(" DEBUG:  the shared table %s can not be used, loading the table instead \n", name);
+    }
+    return NULL;
+  }
+
+  strcpy(shm->name, name);
+  shm->fd = -1;
+  shm->map = map;
+  shm->map_size = map_size;
+  shm->is_creator = 0;
+  shm->is_published = 1;
+  return shm;
+}
+
+relShm *open_shm_table(const char *kind, uint64_t checksum) {
+
+  char name[64];
+  snprintf(name, sizeof(name), "%s%s_%016llx", RELSHM_NAME_PREFIX, kind, (unsigned long long) checksum);
+
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd >= 0) {
+    return create_shm_table(name, checksum, fd);
+  } else if (errno == EEXIST) {
+    int is_stale = 0;
+    relShm *shm = attach_shm_table(name, checksum, &is_stale);
+    if (!is_stale) {
+      return shm;
+    }
+
+    // the creator died while loading the table, so this process creates the segment again
+    if (is_debug_run()) {
+      printf(" DEBUG:  removed the shared table %s, as its creator did not publish it \n", name);
+    }
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd >= 0) {
+      return create_shm_table(name, checksum, fd);
+    }
+    return NULL;
+  }
+
+  if (is_debug_run()) {
+    printf(" DEBUG:  creating the shared table %s failed (%s), loading the table instead \n", name, strerror(errno));
+  }
+  return NULL;
+}
+
+int is_shm_table_published(const relShm *shm) {
+  return shm->is_published;
+}
+
+void *alloc_shm_table(relShm *shm, size_t size) {
+
+  assert(shm->is_creator && !shm->is_published && shm->fd >= 0);
+
+  // reserve the memory (ftruncate does not for tmpfs), such that a full /dev/shm fails here instead of
+  // with SIGBUS when the data is written
+  size_t map_size = RELSHM_DATA_OFFSET + size;
+  void *map = MAP_FAILED;
+  if (posix_fallocate(shm->fd, 0, (off_t) map_size) == 0) {
+    map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+  } else if (is_debug_run()) {
+    printf(" DEBUG:  could not reserve %.1f MB for the shared table %s, loading the table instead \n",
+           (double) map_size / 1024 / 1024, shm->name);
+  }
+  close(shm->fd);
+  shm->fd = -1;
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+
+  munmap(shm->map, shm->map_size);
+  shm->map = map;
+  shm->map_size = map_size;
+  get_header(shm)->size = size;
+
+  return (char *) map + RELSHM_DATA_OFFSET;
+}
+
+void publish_shm_table(relShm *shm) {
+
+  assert(shm->is_creator && !shm->is_published);
+
+  __atomic_store_n(&get_header(shm)->state, RELSHM_STATE_PUBLISHED, __ATOMIC_RELEASE);
+  mprotect(shm->map, shm->map_size, PROT_READ);
+  shm->is_published = 1;
+
+  if (is_debug_run()) {
+    printf(" DEBUG:  published the shared table %s (%.1f MB) \n", shm->name,
+           (double) get_header(shm)->size / 1024 / 1024);
+  }
+}
+
+const void *get_shm_table_data(const relShm *shm, size_t *size) {
+  assert(shm->is_published);
+  if (size != NULL) {
+    *size = (size_t) get_header(shm)->size;
+  }
+  return (const char *) shm->map + RELSHM_DATA_OFFSET;
+}
+
+void remove_shm_table(const relShm *shm) {
+  if (shm != NULL) {
+    shm_unlink(shm->name);
+  }
+}
+
+void close_shm_table(relShm *shm) {
+  if (shm != NULL) {
+    if (!shm->is_published) {
+      // unless another process already removed it as stale (and possibly created it again)
+      remove_unpublished_shm_table(get_header(shm), shm->name);
+    }
+    if (shm->fd >= 0) {
+      close(shm->fd);
+    }
+    munmap(shm->map, shm->map_size);
+    free(shm);
+  }
+}
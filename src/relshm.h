@@ -0,0 +1,69 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+#ifndef RELSHM_H_
+#define RELSHM_H_
+
+#include "common.h"
+
+#include <stdint.h>
+
+/** tables shared by all processes on a machine in POSIX shared memory
+ *  - the first process loading a table publishes its data (parsed and normalized as it is used) in
+ *    a named segment "/relxill_<kind>_<checksum>", all later processes only map it read-only
+ *  - the checksum is calculated from the table file (full path, size and modification time), the
+ *    layout of the data and all further values the data depends on, such that a changed table is
+ *    published in a new segment
+ *  - the segments are kept after the processes ended (they can be removed from /dev/shm)
+ *
+ *  environment variable to switch on the shared tables
+ *  - RELXILL_SHARED_TABLES=1: use shared memory for the relline, lamp post, xillver and returning
+ *                             radiation tables (the full xillver table is loaded by the first process)
+ */
+#define ENV_SHARED_TABLES "RELXILL_SHARED_TABLES"
+
+int use_shared_tables(void);
+
+/** checksum of the data of a table of the given kind (see above), which depends on the additional
+ *  values (n_values can be 0) **/
+uint64_t get_shm_table_checksum(const char *table_filename, const char *kind, const double *values, int n_values,
+                                int *status);
+
+/** open the shared segment of the table, returns NULL if it can not be used
+ *  - if is_shm_table_published is false afterwards, this process created the segment and has to fill it
+ *    (alloc_shm_table, publish_shm_table); otherwise the data can be used (get_shm_table_data)
+ *  - a process opening a segment which is still filled by another process waits until it is published (at
+ *    most 10 minutes); if its creator died before, the segment is removed and this process creates it again **/
+relShm *open_shm_table(const char *kind, uint64_t checksum);
+
+int is_shm_table_published(const relShm *shm);
+
+/** writable memory of size bytes for the data (NULL if it can not be allocated) **/
+void *alloc_shm_table(relShm *shm, size_t size);
+
+/** make the data available to all processes (afterwards it is mapped read-only) **/
+void publish_shm_table(relShm *shm);
+
+const void *get_shm_table_data(const relShm *shm, size_t *size);
+
+/** unmap the segment; if it was not published, it is removed (such that it can be created again) **/
+void close_shm_table(relShm *shm);
+
+/** remove the segment from the system (processes which mapped it can still use it) **/
+void remove_shm_table(const relShm *shm);
+
+#endif /* RELSHM_H_ */
@@ -18,6 +18,7 @@
 
 #include "reltable.h"
 #include "xilltable.h"
+#include "relshm.h"
 #include "time.h"
 
 static relDat *new_relDat(int nr, int ng, int *status) {
@@ -98,6 +99,7 @@ relTable *new_relTable(int n_a, int n_mu0, int n_r, int n_g, int *status) {
   tab->mu0 = NULL;
 
   tab->arr = NULL;
+  tab->shm = NULL;
 
   tab->arr = (relDat ***) malloc(sizeof(relDat **) * tab->n_a);
   CHECK_MALLOC_RET_STATUS(tab->arr, status, tab);
@@ -233,7 +235,7 @@ static relDat *load_single_relDat(fitsfile *fptr, char *extname, int nhdu, int *
 }
 
 /** load the complete relline table */
-void read_relline_table(const char *filename, relTable **inp_tab, int *status) {
+static void read_relline_table_fits(const char *filename, relTable **inp_tab, int *status) {
 
   relTable *tab = (*inp_tab);
   fitsfile *fptr = NULL;
@@ -382,7 +384,7 @@ lpDat *load_single_lpDat(fitsfile *fptr, int n_h, int n_rad, int rownum, int *st
 }
 
 /** load the complete relline table */
-void read_lp_table(const char *filename, lpTable **inp_tab, int *status) {
+static void read_lp_table_fits(const char *filename, lpTable **inp_tab, int *status) {
 
   lpTable *tab = (*inp_tab);
   fitsfile *fptr = NULL;
@@ -448,8 +450,16 @@ void read_lp_table(const char *filename, lpTable **inp_tab, int *status) {
 
 }
 
-static void free_relDat(relDat *dat, int nr) {
+// the data is only freed if it is not in shared memory (then only the arrays of pointers to it are freed)
+static void free_relDat(relDat *dat, int nr, int is_shared) {
   if (dat != NULL) {
+    if (is_shared) {
+      free(dat->cosne1);
+      free(dat->cosne2);
+      free(dat->trff1);
+      free(dat->trff2);
+      return;
+    }
     int ii;
     for (ii = 0; ii < nr; ii++) {
       if (dat->cosne1 != NULL) free(dat->cosne1[ii]);
@@ -476,7 +486,7 @@ void free_relTable(relTable *tab) {
         if (tab->arr[ii] != NULL) {
           int jj;
           for (jj = 0; jj < tab->n_mu0; jj++) {
-            free_relDat(tab->arr[ii][jj], tab->n_r);
+            free_relDat(tab->arr[ii][jj], tab->n_r, tab->shm != NULL);
             free(tab->arr[ii][jj]);
           }
           free(tab->arr[ii]);
@@ -484,8 +494,12 @@ void free_relTable(relTable *tab) {
       }
       free(tab->arr);
     }
-    free(tab->a);
-    free(tab->mu0);
+    if (tab->shm != NULL) {
+      close_shm_table(tab->shm);
+    } else {
+      free(tab->a);
+      free(tab->mu0);
+    }
     free(tab);
   }
 }
@@ -499,6 +513,7 @@ lpTable *new_lpTable(int n_a, int n_h, int n_rad, int *status) {
   tab->n_rad = n_rad;
 
   tab->a = NULL;
+  tab->shm = NULL;
 
   tab->dat = (lpDat **) malloc(sizeof(lpDat *) * tab->n_a);
   CHECK_MALLOC_RET_STATUS(tab->dat, status, tab);
@@ -535,13 +550,265 @@ void free_lpTable(lpTable *tab) {
     if (tab->dat != NULL) {
       int ii;
       for (ii = 0; ii < tab->n_a; ii++) {
-        free_lpDat(tab->dat[ii], tab->n_h);
+        if (tab->shm != NULL && tab->dat[ii] != NULL) {  // the data itself is in shared memory
+          free(tab->dat[ii]->intens);
+          free(tab->dat[ii]->del);
+          free(tab->dat[ii]->del_inc);
+        } else {
+          free_lpDat(tab->dat[ii], tab->n_h);
+        }
         free(tab->dat[ii]);
       }
       free(tab->dat);
     }
-    free(tab->a);
+    if (tab->shm != NULL) {
+      close_shm_table(tab->shm);
+    } else {
+      free(tab->a);
+    }
     free(tab);
   }
 }
 
+static float *copy_to_shm(float *dest, const float *src, size_t n) {
+  memcpy(dest, src, sizeof(float) * n);
+  return dest + n;
+}
+
+static float *copy_2d_to_shm(float *dest, float *const *src, int n1, int n2) {
+  int ii;
+  for (ii = 0; ii < n1; ii++) {
+    dest = copy_to_shm(dest, src[ii], n2);
+  }
+  return dest;
+}
+
+// set the rows of a 2d array to the data in shared memory
+static float *set_2d_from_shm(float **arr, float *data, int n1, int n2) {
+  int ii;
+  for (ii = 0; ii < n1; ii++) {
+    arr[ii] = data + ((size_t) ii) * n2;
+  }
+  return data + ((size_t) n1) * n2;
+}
+
+/* relline table in shared memory: a, mu0, and for each relDat r, gmin, gmax, trff1, trff2, cosne1, cosne2 */
+static size_t get_relTable_shm_size(int n_a, int n_mu0, int n_r, int n_g) {
+  return sizeof(float) * (n_a + n_mu0 + ((size_t) n_a) * n_mu0 * (3 * n_r + 4 * ((size_t) n_r) * n_g));
+}
+
+static void write_relTable_shm(const relTable *tab, float *data) {
+  data = copy_to_shm(data, tab->a, tab->n_a);
+  data = copy_to_shm(data, tab->mu0, tab->n_mu0);
+
+  int ii;
+  int jj;
+  for (ii = 0; ii < tab->n_a; ii++) {
+    for (jj = 0; jj < tab->n_mu0; jj++) {
+      const relDat *dat = tab->arr[ii][jj];
+      data = copy_to_shm(data, dat->r, tab->n_r);
+      data = copy_to_shm(data, dat->gmin, tab->n_r);
+      data = copy_to_shm(data, dat->gmax, tab->n_r);
+      data = copy_2d_to_shm(data, dat->trff1, tab->n_r, tab->n_g);
+      data = copy_2d_to_shm(data, dat->trff2, tab->n_r, tab->n_g);
+      data = copy_2d_to_shm(data, dat->cosne1, tab->n_r, tab->n_g);
+      data = copy_2d_to_shm(data, dat->cosne2, tab->n_r, tab->n_g);
+    }
+  }
+}
+
+static relTable *new_relTable_shm(relShm *shm, int *status) {
+
+  size_t size;
+  float *data = (float *) get_shm_table_data(shm, &size);
+  if (size != get_relTable_shm_size(RELTABLE_NA, RELTABLE_NMU0, RELTABLE_NR, RELTABLE_NG)) {
+    return NULL;
+  }
+
+  relTable *tab = new_relTable(RELTABLE_NA, RELTABLE_NMU0, RELTABLE_NR, RELTABLE_NG, status);
+  CHECK_STATUS_RET(*status, NULL);
+  tab->shm = shm;
+
+  tab->a = data;
+  data += tab->n_a;
+  tab->mu0 = data;
+  data += tab->n_mu0;
+
+  int ii;
+  int jj;
+  for (ii = 0; ii < tab->n_a; ii++) {
+    for (jj = 0; jj < tab->n_mu0; jj++) {
+      relDat *dat = (relDat *) malloc(sizeof(relDat));
+      CHECK_MALLOC_RET_STATUS(dat, status, tab)
+      tab->arr[ii][jj] = dat;
+
+      dat->trff1 = (float **) malloc(sizeof(float *) * tab->n_r);
+      dat->trff2 = (float **) malloc(sizeof(float *) * tab->n_r);
+      dat->cosne1 = (float **) malloc(sizeof(float *) * tab->n_r);
+      dat->cosne2 = (float **) malloc(sizeof(float *) * tab->n_r);
+      if (dat->trff1 == NULL || dat->trff2 == NULL || dat->cosne1 == NULL || dat->cosne2 == NULL) {
+        RELXILL_ERROR("memory allocation failed", status);
+        return tab;
+      }
+
+      dat->r = data;
+      data += tab->n_r;
+      dat->gmin = data;
+      data += tab->n_r;
+      dat->gmax = data;
+      data += tab->n_r;
+      data = set_2d_from_shm(dat->trff1, data, tab->n_r, tab->n_g);
+      data = set_2d_from_shm(dat->trff2, data, tab->n_r, tab->n_g);
+      data = set_2d_from_shm(dat->cosne1, data, tab->n_r, tab->n_g);
+      data = set_2d_from_shm(dat->cosne2, data, tab->n_r, tab->n_g);
+    }
+  }
+
+  return tab;
+}
+
+/* lamp post table in shared memory: a, and for each lpDat h, rad, intens, del, del_inc */
+static size_t get_lpTable_shm_size(int n_a, int n_h, int n_rad) {
+  return sizeof(float) * (n_a + ((size_t) n_a) * (n_h + n_rad + 3 * ((size_t) n_h) * n_rad));
+}
+
+static void write_lpTable_shm(const lpTable *tab, float *data) {
+  data = copy_to_shm(data, tab->a, tab->n_a);
+
+  int ii;
+  for (ii = 0; ii < tab->n_a; ii++) {
+    const lpDat *dat = tab->dat[ii];
+    data = copy_to_shm(data, dat->h, tab->n_h);
+    data = copy_to_shm(data, dat->rad, tab->n_rad);
+    data = copy_2d_to_shm(data, dat->intens, tab->n_h, tab->n_rad);
+    data = copy_2d_to_shm(data, dat->del, tab->n_h, tab->n_rad);
+    data = copy_2d_to_shm(data, dat->del_inc, tab->n_h, tab->n_rad);
+  }
+}
+
+static lpTable *new_lpTable_shm(relShm *shm, int *status) {
+
+  size_t size;
+  float *data = (float *) get_shm_table_data(shm, &size);
+  if (size != get_lpTable_shm_size(LPTABLE_NA, LPTABLE_NH, LPTABLE_NR)) {
+    return NULL;
+  }
+
+  lpTable *tab = new_lpTable(LPTABLE_NA, LPTABLE_NH, LPTABLE_NR, status);
+  CHECK_STATUS_RET(*status, NULL);
+  tab->shm = shm;
+
+  tab->a = data;
+  data += tab->n_a;
+
+  int ii;
+  for (ii = 0; ii < tab->n_a; ii++) {
+    lpDat *dat = (lpDat *) malloc(sizeof(lpDat));
+    CHECK_MALLOC_RET_STATUS(dat, status, tab)
+    tab->dat[ii] = dat;
+
+    dat->intens = (float **) malloc(sizeof(float *) * tab->n_h);
+    dat->del = (float **) malloc(sizeof(float *) * tab->n_h);
+    dat->del_inc = (float **) malloc(sizeof(float *) * tab->n_h);
+    if (dat->intens == NULL || dat->del == NULL || dat->del_inc == NULL) {
+      RELXILL_ERROR("memory allocation failed", status);
+      return tab;
+    }
+
+    dat->h = data;
+    data += tab->n_h;
+    dat->rad = data;
+    data += tab->n_rad;
+    data = set_2d_from_shm(dat->intens, data, tab->n_h, tab->n_rad);
+    data = set_2d_from_shm(dat->del, data, tab->n_h, tab->n_rad);
+    data = set_2d_from_shm(dat->del_inc, data, tab->n_h, tab->n_rad);
+  }
+
+  return tab;
+}
+
+void read_relline_table(const char *filename, relTable **inp_tab, int *status) {
+
+  CHECK_STATUS_VOID(*status);
+
+  relShm *shm = NULL;
+  if (use_shared_tables()) {
+    shm = open_shm_table("rel", get_shm_table_checksum(filename, "rel", NULL, 0, status));
+  }
+  if (shm == NULL) {
+    read_relline_table_fits(filename, inp_tab, status);
+    return;
+  }
+
+  // the first process publishes the table, the others only attach to it
+  if (!is_shm_table_published(shm)) {
+    relTable *tab = NULL;
+    read_relline_table_fits(filename, &tab, status);
+
+    size_t size = get_relTable_shm_size(RELTABLE_NA, RELTABLE_NMU0, RELTABLE_NR, RELTABLE_NG);
+    float *data = (*status == EXIT_SUCCESS) ? (float *) alloc_shm_table(shm, size) : NULL;
+    if (data == NULL) {
+      close_shm_table(shm);
+      (*inp_tab) = tab;
+      return;
+    }
+    write_relTable_shm(tab, data);
+    publish_shm_table(shm);
+    free_relTable(tab);
+  }
+
+  relTable *tab = new_relTable_shm(shm, status);
+  if (tab == NULL || *status != EXIT_SUCCESS) {
+    if (tab != NULL) {
+      free_relTable(tab);
+    } else {
+      close_shm_table(shm);
+    }
+    read_relline_table_fits(filename, inp_tab, status);
+    return;
+  }
+  (*inp_tab) = tab;
+}
+
+void read_lp_table(const char *filename, lpTable **inp_tab, int *status) {
+
+  CHECK_STATUS_VOID(*status);
+
+  relShm *shm = NULL;
+  if (use_shared_tables()) {
+    shm = open_shm_table("lp", get_shm_table_checksum(filename, "lp", NULL, 0, status));
+  }
+  if (shm == NULL) {
+    read_lp_table_fits(filename, inp_tab, status);
+    return;
+  }
+
+  // the first process publishes the table, the others only attach to it
+  if (!is_shm_table_published(shm)) {
+    lpTable *tab = NULL;
+    read_lp_table_fits(filename, &tab, status);
+
+    size_t size = get_lpTable_shm_size(LPTABLE_NA, LPTABLE_NH, LPTABLE_NR);
+    float *data = (*status == EXIT_SUCCESS) ? (float *) alloc_shm_table(shm, size) : NULL;
+    if (data == NULL) {
+      close_shm_table(shm);
+      (*inp_tab) = tab;
+      return;
+    }
+    write_lpTable_shm(tab, data);
+    publish_shm_table(shm);
+    free_lpTable(tab);
+  }
+
+  lpTable *tab = new_lpTable_shm(shm, status);
+  if (tab == NULL || *status != EXIT_SUCCESS) {
+    if (tab != NULL) {
+      free_lpTable(tab);
+    } else {
+      close_shm_table(shm);
+    }
+    read_lp_table_fits(filename, inp_tab, status);
+    return;
+  }
+  (*inp_tab) = tab;
+}
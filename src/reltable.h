@@ -45,6 +45,8 @@ typedef struct {
   int n_r;
   int n_g;
 
+  relShm *shm;  // shared memory of the data (NULL if not shared, see relshm.h)
+
 } relTable;
 
 /** the LAMP POST single data structure */
@@ -66,6 +68,7 @@ typedef struct {
   int n_h;
   int n_rad;
   lpDat **dat;
+  relShm *shm;  // shared memory of the data (NULL if not shared, see relshm.h)
 } lpTable;
 
 /* create a new LP table */
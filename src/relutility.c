@@ -359,6 +359,134 @@ int shouldOutfilesBeWritten(void) {
 }
 
 
+/** check if the zones should be summed in Fourier space, such that only a single inverse FFT
+ *  is needed (set by the ENV variable RELXILL_FFT_SUM_ZONES) **/
+int do_fft_sum_zones(void) {
+  char *env = getenv("RELXILL_FFT_SUM_ZONES");
+  if (env != NULL) {
+    int envval = (int) strtod(env, NULL);
+    if (envval == 1) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/** check if the transforms of the xillver spectra should be combined from the cached transforms
+ *  of all inclinations (set by the ENV variable RELXILL_FFT_MIX_INCL) **/
+int do_fft_mix_xillver_inclinations(void) {
+  char *env = getenv("RELXILL_FFT_MIX_INCL");
+  if (env != NULL) {
+    int envval = (int) strtod(env, NULL);
+    if (envval == 1) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/** check if the convolution energy grid should be restricted to the energy band needed for the
+ *  requested spectrum (set by the ENV variable RELXILL_CONV_GRID_ADAPTIVE) **/
+int use_adaptive_conv_energy_grid(void) {
+  char *env = getenv("RELXILL_CONV_GRID_ADAPTIVE");
+  if (env != NULL) {
+    int envval = (int) strtod(env, NULL);
+    if (envval == 1) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/** check if the convolution should be done in single precision (set by the ENV variable RELXILL_FFTW_FLOAT,
+ *  needs relxill to be compiled with the cmake option RELXILL_FFTW_FLOAT) **/
+int do_fftw_float_convolution(void) {
+  char *env = getenv("RELXILL_FFTW_FLOAT");
+  if (env != NULL) {
+    int envval = (int) strtod(env, NULL);
+    if (envval == 1) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/** check if the relline profile should be integrated from the cumulative integral over g* instead
+ *  of a Romberg integration of every energy bin (set by the ENV variable RELXILL_RELLINE_CDF) **/
+int use_relline_cdf_engine(void) {
+  char *env = getenv("RELXILL_RELLINE_CDF");
+  if (env != NULL) {
+    int envval = (int) strtod(env, NULL);
+    if (envval == 1) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/** check if the xillver spectra next to the ones of the last evaluation should be loaded in the
+ *  background (set by the ENV variable RELXILL_XILLVER_PREFETCH) **/
+int do_xillver_prefetch(void) {
+  char *env = getenv("RELXILL_XILLVER_PREFETCH");
+  if (env != NULL) {
+    int envval = (int) strtod(env, NULL);
+    if (envval == 1) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/** number of threads set by set_num_threads (0 if not set) **/
+static int num_threads_set = 0;
+
+void set_num_threads(int num_threads) {
+  num_threads_set = (num_threads > 0) ? num_threads : 0;
+}
+
+/** number of threads used for the calculation of the relline profile and the zones of relxill (set
+ *  by set_num_threads or else by the ENV variable RELXILL_NUM_THREADS, default is 1) **/
+int get_num_threads(void) {
+  if (num_threads_set > 0) {
+    return num_threads_set;
+  }
+  char *env = getenv("RELXILL_NUM_THREADS");
+  if (env != NULL) {
+    int envval = (int) strtod(env, NULL);
+    if (envval > 1) {
+      return envval;
+    }
+  }
+  return 1;
+}
+
+/** memory budget of each of the model caches in bytes (set in MB by the ENV variable
+ *  RELXILL_CACHE_SIZE_MB, default is 64MB) **/
+size_t get_cache_max_bytes(void) {
+  size_t size_mb = 64;
+  char *env = getenv("RELXILL_CACHE_SIZE_MB");
+  if (env != NULL) {
+    double envval = strtod(env, NULL);
+    if (envval > 0) {
+      size_mb = (size_t) envval;
+    }
+  }
+  return size_mb * 1024 * 1024;
+}
+
+/** number of final spectra of the relxill models which are cached (set by the ENV variable
+ *  RELXILL_OUTPUT_CACHE_SIZE, default is 8, 0 switches this cache off) **/
+int get_output_cache_size(void) {
+  char *env = getenv("RELXILL_OUTPUT_CACHE_SIZE");
+  if (env != NULL) {
+    int envval = (int) strtod(env, NULL);
+    if (envval >= 0) {
+      return envval;
+    }
+  }
+  return 8;
+}
+
 /** check if we should return the relline/relconv physical norm from ENV **/
 int do_not_normalize_relline(void) {
   char *env;
@@ -157,6 +157,28 @@ TestSpectrum *getNewSpec(double emin, double emax, int nbins, int *status);
 
 int shouldOutfilesBeWritten(void);
 
+int do_fft_sum_zones(void);
+
+int do_fft_mix_xillver_inclinations(void);
+
+int use_adaptive_conv_energy_grid(void);
+
+int do_fftw_float_convolution(void);
+
+int use_relline_cdf_engine(void);
+
+int do_xillver_prefetch(void);
+
+int get_num_threads(void);
+
+/** set the number of threads, which takes precedence over RELXILL_NUM_THREADS (0 to use the ENV
+ *  variable again); should not be changed while models are evaluated **/
+void set_num_threads(int num_threads);
+
+size_t get_cache_max_bytes(void);
+
+int get_output_cache_size(void);
+
 void invertArray(double *vals, int n);
 
 double get_ipol_factor_radius(double rlo, double rhi, double del_inci, double radius);
@@ -0,0 +1,188 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+
+#include "xillresidency.h"
+#include "relutility.h"
+
+#define XILLRESIDENCY_NOT_LOADED (-2)
+
+/** the loaded spectra are a doubly linked list (of their indices), from the most recently used one
+ *  (head) to the least recently used one (tail) **/
+struct xillResidency {
+  int num_elements;
+  size_t spec_bytes;
+
+  int *prev;   // XILLRESIDENCY_NOT_LOADED if the spectrum is not loaded, -1 for the head
+  int *next;   // -1 for the tail
+  int *pins;
+  int head;
+  int tail;
+  int prefetching;  // add loaded spectra as the least recently used ones (see xillresidency_set_prefetching)
+
+  xillResidencyStats stats;
+};
+
+static size_t get_xillresidency_max_bytes(void) {
+  const char *env = getenv(ENV_XILLVER_MAX_MB);
+  if (env != NULL) {
+    double envval = strtod(env, NULL);
+    if (envval > 0) {
+      return (size_t) (envval * 1024 * 1024);
+    }
+  }
+  return 0;
+}
+
+xillResidency *new_xillresidency(int num_elements, size_t spec_bytes, int *status) {
+
+  CHECK_STATUS_RET(*status, NULL);
+
+  xillResidency *res = (xillResidency *) malloc(sizeof(xillResidency));
+  CHECK_MALLOC_RET_STATUS(res, status, NULL)
+
+  res->num_elements = num_elements;
+  res->spec_bytes = spec_bytes;
+  res->prev = (int *) malloc(sizeof(int) * num_elements);
+  res->next = (int *) malloc(sizeof(int) * num_elements);
+  res->pins = (int *) malloc(sizeof(int) * num_elements);
+  if (res->prev == NULL || res->next == NULL || res->pins == NULL) {
+    free_xillresidency(res);
+    RELXILL_ERROR("memory allocation failed", status);
+    return NULL;
+  }
+
+  int ii;
+  for (ii = 0; ii < num_elements; ii++) {
+    res->prev[ii] = XILLRESIDENCY_NOT_LOADED;
+    res->next[ii] = -1;
+    res->pins[ii] = 0;
+  }
+  res->head = -1;
+  res->tail = -1;
+  res->prefetching = 0;
+
+  memset(&res->stats, 0, sizeof(res->stats));
+  res->stats.max_bytes = get_xillresidency_max_bytes();
+
+  return res;
+}
+
+void free_xillresidency(xillResidency *res) {
+  if (res != NULL) {
+    free(res->prev);
+    free(res->next);
+    free(res->pins);
+    free(res);
+  }
+}
+
+static void unlink_spec(xillResidency *res, int index) {
+  if (res->prev[index] >= 0) {
+    res->next[res->prev[index]] = res->next[index];
+  } else {
+    res->head = res->next[index];
+  }
+  if (res->next[index] >= 0) {
+    res->prev[res->next[index]] = res->prev[index];
+  } else {
+    res->tail = res->prev[index];
+  }
+}
+
+static void link_spec_as_head(xillResidency *res, int index) {
+  res->prev[index] = -1;
+  res->next[index] = res->head;
+  if (res->head >= 0) {
+    res->prev[res->head] = index;
+  } else {
+    res->tail = index;
+  }
+  res->head = index;
+}
+
+static void link_spec_as_tail(xillResidency *res, int index) {
+  res->prev[index] = res->tail;
+  res->next[index] = -1;
+  if (res->tail >= 0) {
+    res->next[res->tail] = index;
+  } else {
+    res->head = index;
+  }
+  res->tail = index;
+}
+
+void xillresidency_add(xillResidency *res, int index) {
+  assert(res->prev[index] == XILLRESIDENCY_NOT_LOADED);
+  if (res->prefetching) {
+    link_spec_as_tail(res, index);
+  } else {
+    link_spec_as_head(res, index);
+  }
+
+  res->stats.resident_bytes += res->spec_bytes;
+  res->stats.num_resident++;
+  res->stats.num_loaded++;
+}
+
+void xillresidency_touch(xillResidency *res, int index) {
+  if (res->prefetching || res->prev[index] == XILLRESIDENCY_NOT_LOADED || res->head == index) {
+    return;
+  }
+  unlink_spec(res, index);
+  link_spec_as_head(res, index);
+}
+
+void xillresidency_set_prefetching(xillResidency *res, int prefetching) {
+  res->prefetching = prefetching;
+}
+
+void xillresidency_pin(xillResidency *res, int index, int delta) {
+  res->pins[index] += delta;
+  assert(res->pins[index] >= 0);
+}
+
+void xillresidency_evict(xillResidency *res, float **data_storage) {
+
+  if (res->stats.max_bytes == 0) {
+    return;
+  }
+
+  int index = res->tail;
+  while (res->stats.resident_bytes > res->stats.max_bytes && index >= 0) {
+    int index_next = res->prev[index];  // the next one used less recently
+
+    if (res->pins[index] == 0) {
+      unlink_spec(res, index);
+      res->prev[index] = XILLRESIDENCY_NOT_LOADED;
+      res->next[index] = -1;
+
+      free(data_storage[index]);
+      data_storage[index] = NULL;
+
+      res->stats.resident_bytes -= res->spec_bytes;
+      res->stats.num_resident--;
+      res->stats.num_evicted++;
+    }
+
+    index = index_next;
+  }
+}
+
+xillResidencyStats get_xillresidency_stats(const xillResidency *res) {
+  return res->stats;
+}
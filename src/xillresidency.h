@@ -0,0 +1,68 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+#ifndef XILLRESIDENCY_H_
+#define XILLRESIDENCY_H_
+
+#include "common.h"
+
+/** memory budget of the spectra loaded from a xillver table
+ *  - the spectra are kept in the order of their last use (by check_xilltab_cache), and if the
+ *    budget is exceeded the ones not used for the longest time are freed (they are loaded again
+ *    from the table if needed)
+ *  - spectra of pinned cells (see pin_xilltab_cell) are never freed, such that the interpolation
+ *    can be done without holding shared_table_mutex (so the budget is exceeded if the pinned
+ *    cells alone need more memory)
+ *  - spectra of the binary store (see xillstore.h) are not part of the budget
+ *
+ *  environment variable to configure the budget
+ *  - RELXILL_XILLVER_MAX_MB: memory for the spectra of each xillver table in MB (not set or 0: unlimited)
+ */
+#define ENV_XILLVER_MAX_MB "RELXILL_XILLVER_MAX_MB"
+
+typedef struct {
+  size_t max_bytes;        // memory budget (0 if unlimited)
+  size_t resident_bytes;   // memory of all loaded spectra
+  int num_resident;        // number of loaded spectra
+  long num_loaded;         // number of spectra loaded from the table in total
+  long num_evicted;        // number of spectra freed to stay within the budget
+} xillResidencyStats;
+
+/** new residency for num_elements spectra of spec_bytes each (budget as given by RELXILL_XILLVER_MAX_MB) **/
+xillResidency *new_xillresidency(int num_elements, size_t spec_bytes, int *status);
+
+void free_xillresidency(xillResidency *res);
+
+/** a spectrum was loaded (it is the most recently used one) **/
+void xillresidency_add(xillResidency *res, int index);
+
+/** mark a loaded spectrum as the most recently used one **/
+void xillresidency_touch(xillResidency *res, int index);
+
+/** while prefetching is set, loaded spectra are added as the least recently used ones and touching a
+ *  spectrum does not change the order, such that prefetched spectra are freed first **/
+void xillresidency_set_prefetching(xillResidency *res, int prefetching);
+
+/** change the number of pins of a spectrum by delta (the spectrum does not need to be loaded) **/
+void xillresidency_pin(xillResidency *res, int index, int delta);
+
+/** free the least recently used spectra of data_storage, which are not pinned, until the budget is met **/
+void xillresidency_evict(xillResidency *res, float **data_storage);
+
+xillResidencyStats get_xillresidency_stats(const xillResidency *res);
+
+#endif /* XILLRESIDENCY_H_ */
@@ -0,0 +1,332 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // necessary for mmap with -std=c99
+#endif
+
+#include "xillstore.h"
+#include "xilltable.h"
+#include "relutility.h"
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define XILLSTORE_MAGIC "RXSTORE"
+#define XILLSTORE_VERSION 1
+
+// number of rows of the FITS table read at once for the conversion
+#define XILLSTORE_ROWS_PER_READ 256
+
+/** header at the beginning of the file (the spectra start at data_offset) **/
+typedef struct {
+  char magic[8];
+  int32_t version;
+  int32_t num_param;
+  int32_t num_param_vals[6];
+  int32_t n_ener;
+  int32_t num_elements;
+  double def_logxi;     // used to normalize the spectra if logxi is not a parameter of the table
+  double def_density;   // used to normalize the spectra if the density is not a parameter of the table
+  int64_t fits_size;    // size and modification time of the FITS table the store was created from
+  int64_t fits_mtime;
+  int64_t data_offset;
+} xillStoreHeader;
+
+struct xillStore {
+  void *map;
+  size_t map_size;
+  const xillStoreHeader *header;
+};
+
+char *get_xillstore_filename(const char *table_filename, int *status) {
+
+  CHECK_STATUS_RET(*status, NULL);
+
+  const char *env = getenv(ENV_XILLVER_STORE);
+  if (env != NULL && strcmp(env, "0") == 0) {
+    return NULL;
+  }
+  const char *path = (env != NULL) ? env : get_relxill_table_path();
+
+  size_t len = strlen(path) + strlen(table_filename) + strlen(XILLSTORE_SUFFIX) + 2;
+  char *store_filename = (char *) malloc(sizeof(char) * len);
+  CHECK_MALLOC_RET_STATUS(store_filename, status, NULL)
+
+  sprintf(store_filename, "%s/%s%s", path, table_filename, XILLSTORE_SUFFIX);
+  return store_filename;
+}
+
+/** size and modification time of the FITS table (returns 0 if it can not be found) **/
+static int get_fits_table_stat(const char *table_filename, int64_t *size, int64_t *mtime, int *status) {
+
+  char *full_filename = getFullPathTableName(table_filename, status);
+  CHECK_STATUS_RET(*status, 0);
+
+  struct stat fits_stat;
+  int found = (stat(full_filename, &fits_stat) == 0);
+  free(full_filename);
+
+  if (found) {
+    *size = (int64_t) fits_stat.st_size;
+    *mtime = (int64_t) fits_stat.st_mtime;
+  }
+  return found;
+}
+
+static int is_xillstore_header_valid(const xillStoreHeader *header, size_t file_size, const char *table_filename,
+                                     const xillTable *tab, int *status) {
+
+  if (file_size < sizeof(xillStoreHeader)
+      || strncmp(header->magic, XILLSTORE_MAGIC, sizeof(header->magic)) != 0
+      || header->version != XILLSTORE_VERSION) {
+    return 0;
+  }
+
+  if (header->num_param != tab->num_param || header->n_ener != tab->n_ener
+      || header->num_elements != tab->num_elements) {
+    return 0;
+  }
+  int ii;
+  for (ii = 0; ii < tab->num_param; ii++) {
+    if (header->num_param_vals[ii] != tab->num_param_vals[ii]) {
+      return 0;
+    }
+  }
+
+  size_t n_bytes_spectra = ((size_t) header->num_elements) * header->n_ener * sizeof(float);
+  if (header->data_offset % XILLSTORE_ALIGNMENT != 0 || file_size < header->data_offset + n_bytes_spectra) {
+    return 0;
+  }
+
+  int64_t fits_size;
+  int64_t fits_mtime;
+  if (!get_fits_table_stat(table_filename, &fits_size, &fits_mtime, status)) {
+    return 0;
+  }
+  return (header->fits_size == fits_size && header->fits_mtime == fits_mtime);
+}
+
+xillStore *open_xillstore(const char *table_filename, const xillTable *tab, int *status) {
+
+  CHECK_STATUS_RET(*status, NULL);
+
+  char *store_filename = get_xillstore_filename(table_filename, status);
+  if (store_filename == NULL) {
+    return NULL;
+  }
+
+  int fd = open(store_filename, O_RDONLY);
+  if (fd < 0) {
+    free(store_filename);
+    return NULL;
+  }
+
+  struct stat store_stat;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &store_stat) == 0 && store_stat.st_size > 0) {
+    map = mmap(NULL, (size_t) store_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);  // the mapping stays valid
+
+  if (map == MAP_FAILED) {
+    printf(" *** warning: could not map the xillver store %s, loading the spectra from the table instead \n",
+           store_filename);
+    free(store_filename);
+    return NULL;
+  }
+
+  size_t map_size = (size_t) store_stat.st_size;
+  xillStore *store = NULL;
+  if (!is_xillstore_header_valid((const xillStoreHeader *) map, map_size, table_filename, tab, status)) {
+    printf(" *** warning: the xillver store %s does not match the table %s (please convert it again), \n",
+           store_filename, table_filename);
+    printf("     loading the spectra from the table instead \n");
+  } else {
+    store = (xillStore *) malloc(sizeof(xillStore));
+    if (store == NULL) {
+      RELXILL_ERROR("memory allocation failed", status);
+    } else {
+      store->map = map;
+      store->map_size = map_size;
+      store->header = (const xillStoreHeader *) map;
+      if (is_debug_run()) {
+        printf(" DEBUG:  using the spectra of the xillver store %s \n", store_filename);
+      }
+    }
+  }
+
+  if (store == NULL) {
+    munmap(map, map_size);
+  }
+  free(store_filename);
+
+  return store;
+}
+
+void close_xillstore(xillStore *store) {
+  if (store != NULL) {
+    munmap(store->map, store->map_size);
+    free(store);
+  }
+}
+
+float *get_xillstore_spectra(xillStore *store, const xillTable *tab, double def_density, double def_logxi) {
+
+  // the default values only matter if they are not a parameter of the table
+  const xillStoreHeader *header = store->header;
+  if ((get_xilltab_param_index((xillTable *) tab, PARAM_LXI) < 0 && fabs(def_logxi - header->def_logxi) > 1e-6)
+      || (get_xilltab_param_index((xillTable *) tab, PARAM_DNS) < 0
+          && fabs(def_density - header->def_density) > 1e-6)) {
+    if (is_debug_run()) {
+      printf(" DEBUG:  xillver store is normalized for logxi=%.2f and logN=%.2f, loading the spectra from the table \n",
+             header->def_logxi, header->def_density);
+    }
+    return NULL;
+  }
+
+  return (float *) ((char *) store->map + header->data_offset);
+}
+
+static void write_xillstore_spectra(fitsfile *fptr, FILE *fp, xillTable *tab, double def_logxi, double def_density,
+                                    int *status) {
+
+  CHECK_STATUS_VOID(*status);
+
+  int extver = 0;
+  fits_movnam_hdu(fptr, BINARY_TBL, "SPECTRA", extver, status);
+  if (*status != EXIT_SUCCESS) {
+    printf(" *** error moving to extension SPECTRA in the xillver table\n");
+    return;
+  }
+
+  float *spec = (float *) malloc(sizeof(float) * XILLSTORE_ROWS_PER_READ * tab->n_ener);
+  CHECK_MALLOC_VOID_STATUS(spec, status)
+
+  int colnum_spec = 2;
+  int anynul = 0;
+  double nullval = 0.0;
+
+  long rownum;
+  for (rownum = 1; rownum <= tab->num_elements; rownum += XILLSTORE_ROWS_PER_READ) {
+    long nrows = tab->num_elements - rownum + 1;
+    if (nrows > XILLSTORE_ROWS_PER_READ) {
+      nrows = XILLSTORE_ROWS_PER_READ;
+    }
+
+    // reading more elements than in a row continues with the next rows
+    fits_read_col(fptr, TFLOAT, colnum_spec, rownum, 1, (LONGLONG) nrows * tab->n_ener, &nullval, spec, &anynul,
+                  status);
+    if (*status != EXIT_SUCCESS) {
+      printf("\n *** ERROR *** failed reading the xillver table (rownum %li) \n", rownum);
+      relxill_check_fits_error(status);
+      break;
+    }
+
+    long ii;
+    for (ii = 0; ii < nrows; ii++) {
+      int ind[6];
+      get_xillspec_indices_of_row(tab, rownum + ii, ind);
+      normalizeXillverSpecLogxiDensity(spec + ii * tab->n_ener, tab, def_density, def_logxi, ind);
+    }
+
+    if (fwrite(spec, sizeof(float), (size_t) nrows * tab->n_ener, fp) != (size_t) nrows * tab->n_ener) {
+      RELXILL_ERROR("writing the xillver store failed", status);
+      break;
+    }
+  }
+
+  free(spec);
+}
+
+void convert_xillver_table_to_store(const char *table_filename, const char *store_filename,
+                                    double def_logxi, double def_density, int *status) {
+
+  CHECK_STATUS_VOID(*status);
+
+  xillTable *tab = NULL;
+  init_xillver_table(table_filename, &tab, status);
+  CHECK_STATUS_VOID(*status);
+
+  xillStoreHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, XILLSTORE_MAGIC, sizeof(XILLSTORE_MAGIC));
+  header.version = XILLSTORE_VERSION;
+  header.num_param = tab->num_param;
+  int ii;
+  for (ii = 0; ii < tab->num_param; ii++) {
+    header.num_param_vals[ii] = tab->num_param_vals[ii];
+  }
+  header.n_ener = tab->n_ener;
+  header.num_elements = tab->num_elements;
+  header.def_logxi = def_logxi;
+  header.def_density = def_density;
+  header.data_offset = XILLSTORE_ALIGNMENT;
+  get_fits_table_stat(table_filename, &header.fits_size, &header.fits_mtime, status);
+
+  // write to a temporary file first, such that other processes never see an incomplete store
+  char *tmp_filename = (char *) malloc(sizeof(char) * (strlen(store_filename) + 5));
+  if (tmp_filename == NULL) {
+    RELXILL_ERROR("memory allocation failed", status);
+    free_xillTable(tab);
+    return;
+  }
+  sprintf(tmp_filename, "%s.tmp", store_filename);
+
+  FILE *fp = fopen(tmp_filename, "wb");
+  if (fp == NULL) {
+    RELXILL_ERROR("opening the xillver store for writing failed", status);
+    printf("    could not write to %s \n", tmp_filename);
+    free(tmp_filename);
+    free_xillTable(tab);
+    return;
+  }
+
+  // on failure, the status makes sure the file is closed and removed below
+  char *padding = (char *) calloc(XILLSTORE_ALIGNMENT - sizeof(header), 1);
+  if (padding == NULL) {
+    RELXILL_ERROR("memory allocation failed", status);
+  } else if (fwrite(&header, sizeof(header), 1, fp) != 1
+      || fwrite(padding, 1, XILLSTORE_ALIGNMENT - sizeof(header), fp) != XILLSTORE_ALIGNMENT - sizeof(header)) {
+    RELXILL_ERROR("writing the xillver store failed", status);
+  }
+  free(padding);
+
+  fitsfile *fptr = open_fits_table_stdpath(table_filename, status);
+  write_xillstore_spectra(fptr, fp, tab, def_logxi, def_density, status);
+  if (fptr != NULL) {
+    fits_close_file(fptr, status);
+  }
+
+  if (fclose(fp) != 0) {
+    RELXILL_ERROR("writing the xillver store failed", status);
+  }
+
+  if (*status == EXIT_SUCCESS) {
+    if (rename(tmp_filename, store_filename) != 0) {
+      RELXILL_ERROR("renaming the xillver store failed", status);
+    }
+  } else {
+    remove(tmp_filename);
+  }
+
+  free(tmp_filename);
+  free_xillTable(tab);
+}
@@ -0,0 +1,61 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+#ifndef XILLSTORE_H_
+#define XILLSTORE_H_
+
+#include "common.h"
+
+/** binary store of a xillver table: all spectra of the FITS table, already normalized as done by
+ *  check_xilltab_cache, in a single page-aligned block of floats (ordered by the row number of the
+ *  table), such that the file can be memory mapped and the spectra are used without any copy
+ *  - created by convert_xillver_table_to_store (or the executable "convert_xillstore")
+ *  - only parts of the table which are used are read from the disk (and cost memory)
+ *  - the store is only used if the size and the modification time of the FITS table did not change
+ *
+ *  environment variable to configure the store
+ *  - RELXILL_XILLVER_STORE: not set: the store is searched next to the table (i.e., RELXILL_TABLE_PATH)
+ *                           "0": the store is not used
+ *                           otherwise: directory of the store
+ */
+#define ENV_XILLVER_STORE "RELXILL_XILLVER_STORE"
+
+// the store of a table "name.fits" is called "name.fits.xillstore"
+#define XILLSTORE_SUFFIX ".xillstore"
+
+// start of the spectra in the file (the largest common page size, such that the spectra can be mapped on all systems)
+#define XILLSTORE_ALIGNMENT 65536
+
+/** full filename of the store of the given xillver table (NULL if the store is switched off) **/
+char *get_xillstore_filename(const char *table_filename, int *status);
+
+/** open the store of the table (which needs to be initialized from the FITS table already), returns
+ *  NULL if there is no (valid) store **/
+xillStore *open_xillstore(const char *table_filename, const xillTable *tab, int *status);
+
+void close_xillstore(xillStore *store);
+
+/** spectra of the store (NULL if they were normalized for other values of logxi or the density, which
+ *  are used if these parameters are not part of the table) **/
+float *get_xillstore_spectra(xillStore *store, const xillTable *tab, double def_density, double def_logxi);
+
+/** convert the xillver table (given as in RELXILL_TABLE_PATH) into the binary store "store_filename",
+ *  the spectra are normalized with def_logxi and def_density for the parameters not in the table **/
+void convert_xillver_table_to_store(const char *table_filename, const char *store_filename,
+                                    double def_logxi, double def_density, int *status);
+
+#endif /* XILLSTORE_H_ */
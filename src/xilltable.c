@@ -17,6 +17,9 @@
 */
 
 #include "xilltable.h"
+#include "xillstore.h"
+#include "xillresidency.h"
+#include "relshm.h"
 #include "common.h"
 
 
@@ -64,6 +67,7 @@ static void init_xilltable_data_struct(xillTable *tab, int *status) {
     tab->data_storage[ii] = NULL;
   }
 
+  tab->residency = new_xillresidency(tab->num_elements, sizeof(float) * tab->n_ener, status);
 }
 
 /** get a new and empty rel table (structure will be allocated)  */
@@ -107,6 +111,16 @@ xillTable *new_xillTable(int num_param, int *status) {
 
   tab->data_storage = NULL;
 
+  tab->store = NULL;
+  tab->store_spectra = NULL;
+
+  tab->preload_checked = 0;
+
+  tab->residency = NULL;
+
+  tab->shm = NULL;
+  tab->shm_checked = 0;
+
   return tab;
 }
 
@@ -336,18 +350,35 @@ get_xillspec_rownum(const int *num_param_vals, int num_param, int nn, int ii, in
   return -1;
 }
 
+void get_xillspec_indices_of_row(const xillTable *tab, long rownum, int *ind) {
+  const int offset = 6 - tab->num_param;  // for 5dim tables, the first index is not used
+  ind[0] = 0;
+
+  long remainder = rownum - 1;
+  int ii;
+  for (ii = tab->num_param - 1; ii >= 0; ii--) {
+    ind[offset + ii] = (int) (remainder % tab->num_param_vals[ii]);
+    remainder /= tab->num_param_vals[ii];
+  }
+}
+
+// the spectra are stored in the order of the rows (which start at 1)
 static void set_dat(float *spec, xillTable *tab, int i0, int i1, int i2, int i3, int i4, int i5) {
   int index = get_xillspec_rownum(tab->num_param_vals, tab->num_param,
-                                  i0, i1, i2, i3, i4, i5);
+                                  i0, i1, i2, i3, i4, i5) - 1;
   tab->data_storage[index] = spec;
+  xillresidency_add(tab->residency, index);
 }
 
 // get one Spectrum from the Data Storage
 float *get_xillspec(xillTable *tab, int i0, int i1, int i2, int i3, int i4, int i5) {
 
   int index = get_xillspec_rownum(tab->num_param_vals, tab->num_param,
-                                  i0, i1, i2, i3, i4, i5);
+                                  i0, i1, i2, i3, i4, i5) - 1;
 
+  if (tab->store_spectra != NULL) {
+    return tab->store_spectra + ((size_t) index) * tab->n_ener;
+  }
   return tab->data_storage[index];
 }
 
@@ -433,6 +464,10 @@ void init_xillver_table(const char *filename, xillTable **inp_tab, int *status)
 
   init_xilltable_data_struct(tab, status);
 
+  if (*status == EXIT_SUCCESS) {
+    tab->store = open_xillstore(filename, tab, status);
+  }
+
   if (*status == EXIT_SUCCESS) {
     // assign the value
     (*inp_tab) = tab;
@@ -486,11 +521,11 @@ void renorm_xill_spec(float *spec, int n, double lxi, double dens) {
 }
 
 
-static void normalizeXillverSpecLogxiDensity(float *spec,
-                                             xillTable *tab,
-                                             double density,
-                                             double logxi,
-                                             const int *indVals) {
+void normalizeXillverSpecLogxiDensity(float *spec,
+                                      xillTable *tab,
+                                      double density,
+                                      double logxi,
+                                      const int *indVals) {
 
   int ind_dens = get_xilltab_param_index(tab, PARAM_DNS);
   int ind_lxi = get_xilltab_param_index(tab, PARAM_LXI);
@@ -573,6 +608,389 @@ static double getDefaultLogxi(const xillTableParam *param) {
   return param->lxi;
 }
 
+// the spectra of the binary store are used directly, if they are normalized for these parameters (this
+// is only checked once, as otherwise the spectra loaded before might have a different normalization)
+static void attach_xillstore_spectra(xillTable *tab, double defDensity, double defLogxi) {
+  if (tab->store != NULL && tab->store_spectra == NULL) {
+    tab->store_spectra = get_xillstore_spectra(tab->store, tab, defDensity, defLogxi);
+    if (tab->store_spectra == NULL) {
+      close_xillstore(tab->store);
+      tab->store = NULL;
+    }
+  }
+}
+
+// read all spectra of the table (normalized as in check_xilltab_cache) into a single array
+static void load_xilltab_all_spectra(const char *fname, xillTable *tab, double defDensity, double defLogxi,
+                                     float *spectra, int *status) {
+
+  CHECK_STATUS_VOID(*status);
+
+  fitsfile *fptr = open_fits_table_stdpath(fname, status);
+  int extver = 0;
+  fits_movnam_hdu(fptr, BINARY_TBL, "SPECTRA", extver, status);
+  if (*status != EXIT_SUCCESS) {
+    printf(" *** error moving to extension SPECTRA in the xillver table\n");
+    return;
+  }
+
+  int colnum_spec = 2;
+  int anynul = 0;
+  double nullval = 0.0;
+
+  long rownum;
+  for (rownum = 1; rownum <= tab->num_elements; rownum += XILLTAB_PRELOAD_ROWS_PER_READ) {
+    long nrows = tab->num_elements - rownum + 1;
+    if (nrows > XILLTAB_PRELOAD_ROWS_PER_READ) {
+      nrows = XILLTAB_PRELOAD_ROWS_PER_READ;
+    }
+
+    float *spec = spectra + ((size_t) (rownum - 1)) * tab->n_ener;
+    fits_read_col(fptr, TFLOAT, colnum_spec, rownum, 1, (LONGLONG) nrows * tab->n_ener, &nullval, spec, &anynul,
+                  status);
+    if (*status != EXIT_SUCCESS) {
+      printf("\n *** ERROR *** failed reading the xillver table (rownum %li) \n", rownum);
+      relxill_check_fits_error(status);
+      break;
+    }
+
+    long ii;
+    for (ii = 0; ii < nrows; ii++) {
+      int ind[6];
+      get_xillspec_indices_of_row(tab, rownum + ii, ind);
+      normalizeXillverSpecLogxiDensity(spec + ii * tab->n_ener, tab, defDensity, defLogxi, ind);
+    }
+  }
+
+  int status_close = EXIT_SUCCESS;
+  fits_close_file(fptr, &status_close);
+}
+
+// with RELXILL_SHARED_TABLES, all spectra of the table are loaded by the first process into shared memory and
+// then used like the spectra of the binary store (this is only tried once, for the same reason as the store)
+static void attach_shared_spectra(const char *fname, xillTable *tab, double defDensity, double defLogxi,
+                                  int *status) {
+
+  if (tab->store_spectra != NULL || tab->shm_checked || !use_shared_tables()) {
+    return;
+  }
+  tab->shm_checked = 1;
+
+  double values[] = {defDensity, defLogxi};
+  relShm *shm = open_shm_table("xill", get_shm_table_checksum(fname, "xill", values, 2, status));
+  if (shm == NULL) {
+    return;
+  }
+
+  const size_t size_spectra = sizeof(float) * ((size_t) tab->num_elements) * tab->n_ener;
+  if (!is_shm_table_published(shm)) {
+    float *spectra = (float *) alloc_shm_table(shm, size_spectra);
+    if (spectra != NULL) {
+      load_xilltab_all_spectra(fname, tab, defDensity, defLogxi, spectra, status);
+    }
+    if (spectra == NULL || *status != EXIT_SUCCESS) {
+      close_shm_table(shm);
+      return;
+    }
+    publish_shm_table(shm);
+  }
+
+  size_t size;
+  const void *spectra = get_shm_table_data(shm, &size);
+  if (size != size_spectra) {
+    close_shm_table(shm);
+    return;
+  }
+  tab->shm = shm;
+  tab->store_spectra = (float *) spectra;
+}
+
+static void attach_xilltab_spectra(const char *fname, xillTable *tab, double defDensity, double defLogxi,
+                                   int *status) {
+  attach_xillstore_spectra(tab, defDensity, defLogxi);
+  attach_shared_spectra(fname, tab, defDensity, defLogxi, status);
+}
+
+static long get_xillspec_rownum_of_indices(const xillTable *tab, const int *ind) {
+  long rownum = 0;
+  int ii;
+  for (ii = 0; ii < tab->num_param; ii++) {
+    rownum = rownum * tab->num_param_vals[ii] + ind[ii];
+  }
+  return rownum + 1;
+}
+
+// next grid point within [ind_lo, ind_hi] in the order of the rows, returns 0 after the last one
+static int next_xilltab_indices(int *ind, const int *ind_lo, const int *ind_hi, int num_param) {
+  int ii;
+  for (ii = num_param - 1; ii >= 0; ii--) {
+    if (ind[ii] < ind_hi[ii]) {
+      ind[ii]++;
+      return 1;
+    }
+    ind[ii] = ind_lo[ii];
+  }
+  return 0;
+}
+
+static void get_xilltab_index_range(const xillTableParam *param_lo, const xillTableParam *param_hi,
+                                    xillTable *tab, int *ind_lo, int *ind_hi, int *status) {
+
+  CHECK_STATUS_VOID(*status);
+
+  int *ind_a = get_xilltab_indices_for_paramvals(param_lo, tab, status);
+  int *ind_b = get_xilltab_indices_for_paramvals(param_hi, tab, status);
+
+  if (*status == EXIT_SUCCESS) {
+    int ii;
+    for (ii = 0; ii < tab->num_param; ii++) {
+      if (ii == tab->num_param - 1) {  // inclination is the last value, all are loaded
+        ind_lo[ii] = 0;
+        ind_hi[ii] = tab->num_param_vals[ii] - 1;
+      } else {  // the indices are the lower grid point for the interpolation, so we need one more
+        ind_lo[ii] = (ind_a[ii] < ind_b[ii]) ? ind_a[ii] : ind_b[ii];
+        ind_hi[ii] = ((ind_a[ii] > ind_b[ii]) ? ind_a[ii] : ind_b[ii]) + 1;
+      }
+    }
+  }
+
+  free(ind_a);
+  free(ind_b);
+}
+
+// read nrows spectra starting at rownum with a single call and store them in the table
+static void xilltable_fits_load_spec_block(fitsfile *fptr, xillTable *tab, double defDensity, double defLogxi,
+                                           long rownum, long nrows, float *buffer, int *status) {
+
+  CHECK_STATUS_VOID(*status);
+
+  int colnum_spec = 2;
+  int anynul = 0;
+  double nullval = 0.0;
+
+  // reading more elements than in a row continues with the next rows
+  fits_read_col(fptr, TFLOAT, colnum_spec, rownum, 1, (LONGLONG) nrows * tab->n_ener, &nullval, buffer, &anynul,
+                status);
+  if (*status != EXIT_SUCCESS) {
+    printf("\n *** ERROR *** failed reading the xillver table (rownum %li) \n", rownum);
+    relxill_check_fits_error(status);
+    return;
+  }
+
+  long ii;
+  for (ii = 0; ii < nrows; ii++) {
+    float *spec = (float *) malloc(tab->n_ener * sizeof(float));
+    CHECK_MALLOC_VOID_STATUS(spec, status)
+    memcpy(spec, buffer + ii * tab->n_ener, tab->n_ener * sizeof(float));
+
+    int ind[6];
+    get_xillspec_indices_of_row(tab, rownum + ii, ind);
+    normalizeXillverSpecLogxiDensity(spec, tab, defDensity, defLogxi, ind);
+
+    tab->data_storage[rownum + ii - 1] = spec;
+    xillresidency_add(tab->residency, (int) (rownum + ii - 1));
+  }
+}
+
+void preload_xilltab_spectra(const char *fname, const xillTableParam *param_lo, const xillTableParam *param_hi,
+                             xillTable *tab, int *status) {
+
+  CHECK_STATUS_VOID(*status);
+
+  double defDensity = getDefaultDensity(param_lo);
+  double defLogxi = getDefaultLogxi(param_lo);
+
+  attach_xilltab_spectra(fname, tab, defDensity, defLogxi, status);
+  if (tab->store_spectra != NULL || *status != EXIT_SUCCESS) {
+    return;
+  }
+
+  int ind_lo[6];
+  int ind_hi[6];
+  get_xilltab_index_range(param_lo, param_hi, tab, ind_lo, ind_hi, status);
+  CHECK_STATUS_VOID(*status);
+
+  float *buffer = (float *) malloc(sizeof(float) * XILLTAB_PRELOAD_ROWS_PER_READ * tab->n_ener);
+  CHECK_MALLOC_VOID_STATUS(buffer, status)
+
+  fitsfile *fptr = NULL;
+  long block_start = 0;
+  long block_nrows = 0;
+
+  // collect the rows which are not loaded yet into blocks of consecutive rows, read by a single call each
+  int ind[6];
+  memcpy(ind, ind_lo, sizeof(ind));
+  int has_next;
+  do {
+    long rownum = get_xillspec_rownum_of_indices(tab, ind);
+    has_next = next_xilltab_indices(ind, ind_lo, ind_hi, tab->num_param);
+
+    int is_needed = (tab->data_storage[rownum - 1] == NULL);
+    if (is_needed) {
+      if (block_nrows == 0) {
+        block_start = rownum;
+      }
+      block_nrows++;
+    }
+
+    if (block_nrows > 0 && (!is_needed || !has_next || block_nrows == XILLTAB_PRELOAD_ROWS_PER_READ)) {
+      if (fptr == NULL) {
+        fptr = open_fits_table_stdpath(fname, status);
+        int extver = 0;
+        fits_movnam_hdu(fptr, BINARY_TBL, "SPECTRA", extver, status);
+        if (*status != EXIT_SUCCESS) {
+          printf(" *** error moving to extension SPECTRA in the xillver table\n");
+          break;
+        }
+      }
+      xilltable_fits_load_spec_block(fptr, tab, defDensity, defLogxi, block_start, block_nrows, buffer, status);
+      block_nrows = 0;
+    }
+  } while (has_next && *status == EXIT_SUCCESS);
+
+  if (fptr != NULL) {
+    int status_close = EXIT_SUCCESS;
+    fits_close_file(fptr, &status_close);
+  }
+  free(buffer);
+
+  xillresidency_evict(tab->residency, tab->data_storage);
+}
+
+static void set_xilltab_paramval(xillTableParam *param, int param_index, double val) {
+  switch (param_index) {
+    case PARAM_GAM: param->gam = val;
+      break;
+    case PARAM_AFE: param->afe = val;
+      break;
+    case PARAM_LXI: param->lxi = val;
+      break;
+    case PARAM_ECT: param->ect = val;
+      break;
+    case PARAM_DNS: param->dens = val;
+      break;
+    case PARAM_KTB: param->kTbb = val;
+      break;
+    case PARAM_FRA: param->frac_pl_bb = val;
+      break;
+    case PARAM_INC: param->incl = val;
+      break;
+    default: break;
+  }
+}
+
+// set the range "name=lo:hi" of a single parameter (ignored if the table does not have it), returns 0 if it
+// could not be read
+static int set_xilltab_preload_range(const char *range, xillTable *tab,
+                                     xillTableParam *param_lo, xillTableParam *param_hi) {
+
+  char name[32];
+  double lo;
+  double hi;
+  if (sscanf(range, "%31[^=]=%lf:%lf", name, &lo, &hi) != 3) {
+    return 0;
+  }
+
+  int ii;
+  for (ii = 0; ii < N_PARAM_MAX; ii++) {
+    if (strcmp(name, global_param_names[ii]) == 0) {
+      if (get_xilltab_param_index(tab, global_param_index[ii]) >= 0) {
+        set_xilltab_paramval(param_lo, global_param_index[ii], lo);
+        set_xilltab_paramval(param_hi, global_param_index[ii], hi);
+      }
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void preload_xilltab_spectra_from_env(const char *fname, const xillTableParam *param, xillTable *tab,
+                                             int *status) {
+
+  CHECK_STATUS_VOID(*status);
+
+  const char *env = getenv(ENV_XILLVER_PRELOAD);
+  if (env == NULL || strlen(env) == 0 || strcmp(env, "0") == 0) {
+    return;
+  }
+
+  // by default, the full range of each parameter of the table is loaded
+  xillTableParam param_lo = *param;
+  xillTableParam param_hi = *param;
+  int ii;
+  for (ii = 0; ii < tab->num_param; ii++) {
+    set_xilltab_paramval(&param_lo, tab->param_index[ii], tab->param_vals[ii][0]);
+    set_xilltab_paramval(&param_hi, tab->param_index[ii], tab->param_vals[ii][tab->num_param_vals[ii] - 1]);
+  }
+
+  if (strcmp(env, "all") != 0) {
+    const char *range = env;
+    while (*range != '\0') {
+      size_t len = strcspn(range, ",");
+      char buf[128];
+      if (len >= sizeof(buf)) {
+        len = sizeof(buf) - 1;
+      }
+      memcpy(buf, range, len);
+      buf[len] = '\0';
+
+      if (!set_xilltab_preload_range(buf, tab, &param_lo, &param_hi)) {
+        printf(" *** warning: could not read the range \"%s\" of %s (expected \"name=lo:hi\"), no preload \n",
+               buf, ENV_XILLVER_PRELOAD);
+        return;
+      }
+
+      range += strcspn(range, ",");
+      if (*range == ',') {
+        range++;
+      }
+    }
+  }
+
+  if (is_debug_run()) {
+    printf(" DEBUG:  preloading the xillver table %s as given by %s=%s \n", fname, ENV_XILLVER_PRELOAD, env);
+  }
+  preload_xilltab_spectra(fname, &param_lo, &param_hi, tab, status);
+}
+
+// change the pins of all spectra of the cell ind (for all inclinations), and mark them as used
+static void change_xilltab_cell_pins(xillTable *tab, const int *ind, int delta) {
+
+  int i0lo = 0;
+  int i0hi = 0;
+  int istart = 0;
+  if (tab->num_param == 6) {
+    i0lo = ind[0];
+    i0hi = ind[0] + 1;
+    istart = 1;
+  }
+
+  int ii, jj, kk, ll, mm, nn;
+  for (nn = i0lo; nn <= i0hi; nn++) {
+    for (ii = ind[istart]; ii <= ind[istart] + 1; ii++) {
+      for (jj = ind[istart + 1]; jj <= ind[istart + 1] + 1; jj++) {
+        for (kk = ind[istart + 2]; kk <= ind[istart + 2] + 1; kk++) {
+          for (ll = ind[istart + 3]; ll <= ind[istart + 3] + 1; ll++) {
+            for (mm = 0; mm < tab->n_incl; mm++) {
+              int index = get_xillspec_rownum(tab->num_param_vals, tab->num_param, nn, ii, jj, kk, ll, mm) - 1;
+              xillresidency_pin(tab->residency, index, delta);
+              xillresidency_touch(tab->residency, index);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void pin_xilltab_cell(xillTable *tab, const int *ind) {
+  change_xilltab_cell_pins(tab, ind, 1);
+}
+
+void unpin_xilltab_cell(xillTable *tab, const int *ind) {
+  change_xilltab_cell_pins(tab, ind, -1);
+}
+
 void check_xilltab_cache(const char *fname, const xillTableParam *param, xillTable *tab, const int *ind, int *status) {
 
   CHECK_STATUS_VOID(*status);
@@ -594,6 +1012,19 @@ void check_xilltab_cache(const char *fname, const xillTableParam *param, xillTab
   double defDensity = getDefaultDensity(param);
   double defLogxi = getDefaultLogxi(param);
 
+  attach_xilltab_spectra(fname, tab, defDensity, defLogxi, status);
+  CHECK_STATUS_VOID(*status);
+
+  // preload the spectra for the parameter ranges given by the ENV variable (once, with the first evaluation)
+  if (!tab->preload_checked) {
+    tab->preload_checked = 1;
+    preload_xilltab_spectra_from_env(fname, param, tab, status);
+    CHECK_STATUS_VOID(*status);
+  }
+
+  // the spectra of this cell must not be freed while the others are loaded
+  pin_xilltab_cell(tab, ind);
+
   int ii, jj, kk, ll, mm, nn;
   for (nn = i0lo; nn <= i0hi; nn++) { // for 5dim this is a dummy loop
     for (ii = ind[istart]; ii <= ind[istart] + 1; ii++) {
@@ -616,7 +1047,10 @@ void check_xilltab_cache(const char *fname, const xillTableParam *param, xillTab
                                                 ll,
                                                 mm,
                                                 status);
-                CHECK_STATUS_VOID(*status);
+                if (*status != EXIT_SUCCESS) {
+                  unpin_xilltab_cell(tab, ind);
+                  return;
+                }
               }
 
             }
@@ -633,6 +1067,15 @@ void check_xilltab_cache(const char *fname, const xillTableParam *param, xillTab
     }
   }
 
+  xillresidency_evict(tab->residency, tab->data_storage);
+  unpin_xilltab_cell(tab, ind);
+}
+
+void prefetch_xilltab_cell(const char *fname, const xillTableParam *param, xillTable *tab, const int *ind,
+                           int *status) {
+  xillresidency_set_prefetching(tab->residency, 1);
+  check_xilltab_cache(fname, param, tab, ind, status);
+  xillresidency_set_prefetching(tab->residency, 0);
 }
 
 xillSpec *new_xill_spec(int n_incl, int n_ener, int *status) {
@@ -800,6 +1243,16 @@ void free_xillTable(xillTable *tab) {
     free(tab->elo);
     free(tab->ehi);
 
+    close_xillstore(tab->store);
+    close_shm_table(tab->shm);
+
+    if (tab->residency != NULL && is_debug_run()) {
+      xillResidencyStats stats = get_xillresidency_stats(tab->residency);
+      printf(" DEBUG:  xillver table: %i spectra (%.1f MB) loaded, %li in total, %li freed \n",
+             stats.num_resident, (double) stats.resident_bytes / 1024 / 1024, stats.num_loaded, stats.num_evicted);
+    }
+    free_xillresidency(tab->residency);
+
     free(tab);
   }
 }
@@ -808,6 +1261,16 @@ void free_cached_xillTable(void) {
   free_xillTable(cached_xill_tab);
   free_xillTable(cached_xill_tab_dens);
   free_xillTable(cached_xill_tab_nthcomp);
+  free_xillTable(cached_xill_tab_dens_nthcomp);
+  free_xillTable(cached_xill_tab_ns);
+  free_xillTable(cached_xill_tab_co);
+
+  cached_xill_tab = NULL;
+  cached_xill_tab_dens = NULL;
+  cached_xill_tab_nthcomp = NULL;
+  cached_xill_tab_dens_nthcomp = NULL;
+  cached_xill_tab_ns = NULL;
+  cached_xill_tab_co = NULL;
 }
 
 static void interp_5d_tab_incl(xillTable *tab, double *flu, int n_ener,
@@ -21,10 +21,24 @@
 #include "relutility.h"
 #include "common.h"
 
+/** preload the spectra of the xillver tables for given parameter ranges with the first evaluation
+ *  - RELXILL_XILLVER_PRELOAD: comma separated list of ranges "name=lo:hi" of the table parameters
+ *                             (Gamma, A_Fe, A_CO, logXi, Ecut, kTe, Dens, kTbb, Frac), parameters not
+ *                             given are loaded for the full range of the table, "all" loads the full table
+ *    example: RELXILL_XILLVER_PRELOAD="Gamma=1.8:2.2,logXi=0:2"
+ */
+#define ENV_XILLVER_PRELOAD "RELXILL_XILLVER_PRELOAD"
 
+// maximal number of rows of the table which are read at once by the preload
+#define XILLTAB_PRELOAD_ROWS_PER_READ 256
 
 void renorm_xill_spec(float *spec, int n, double lxi, double dens);
 
+/** normalize a spectrum of the table by logxi and the density of its grid point (given by the indices
+ *  indVals of the 6dim table), where density and logxi are used if they are not a table parameter **/
+void normalizeXillverSpecLogxiDensity(float *spec, xillTable *tab, double density, double logxi,
+                                      const int *indVals);
+
 enum xillTableIds get_xilltable_id(int model_id, int prim_type);
 
 xillTableParam *get_xilltab_param(xillParam *param, int *status);
@@ -43,6 +57,29 @@ int *get_xilltab_indices_for_paramvals(const xillTableParam *param, xillTable *t
 
 void check_xilltab_cache(const char *fname, const xillTableParam *param, xillTable *tab, const int *ind, int *status);
 
+/** load the spectra of the cell as check_xilltab_cache, but without marking them as used (they are freed
+ *  first if the memory budget is exceeded), for spectra which might only be needed later (see Xillprefetch.h) **/
+void prefetch_xilltab_cell(const char *fname, const xillTableParam *param, xillTable *tab, const int *ind,
+                           int *status);
+
+/** pin the spectra of the cell ind (for all inclinations), such that they are not freed to stay within the
+ *  memory budget (see xillresidency.h) until unpin_xilltab_cell; both need to hold shared_table_mutex **/
+void pin_xilltab_cell(xillTable *tab, const int *ind);
+
+void unpin_xilltab_cell(xillTable *tab, const int *ind);
+
+/** load all spectra of the table, which are needed for parameter values from param_lo to param_hi (always
+ *  for all inclinations, as in check_xilltab_cache), by reading contiguous blocks of rows at once
+ *  - parameters which are not part of the table need to have the value of the model in param_lo (they
+ *    are used for the normalization of the spectra)
+ *  - nothing is loaded if the spectra are available from the binary store (see xillstore.h)
+ *  - the spectra are freed again if they exceed the memory budget (see xillresidency.h) **/
+void preload_xilltab_spectra(const char *fname, const xillTableParam *param_lo, const xillTableParam *param_hi,
+                             xillTable *tab, int *status);
+
+/** indices of the grid point of the given row (as in get_xillspec_rownum, for the 6dim layout) **/
+void get_xillspec_indices_of_row(const xillTable *tab, long rownum, int *ind);
+
 void free_cached_xillTable(void);
 
 void init_xillver_table(const char *filename, xillTable **inp_tab, int *status);
@@ -0,0 +1,465 @@
+/*
+   This file is part of the RELXILL model code.
+
+   RELXILL is free software: you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   any later version.
+
+   RELXILL is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+   For a copy of the GNU General Public License see
+   <http://www.gnu.org/licenses/>.
+
+    Copyright 2022 Thomas Dauser, Remeis Observatory & ECAP
+*/
+
+#include "catch2/catch_amalgamated.hpp"
+
+#include "common-functions.h"
+#include "LocalModel.h"
+#include "XspecSpectrum.h"
+#include "Relbase.h"
+#include "Relfftw.h"
+
+extern "C" {
+#include "relutility.h"
+}
+
+#define LIMIT_PREC_CONV 1e-8
+#define LIMIT_PREC_ADAPTIVE_GRID 1e-3
+
+// a relline profile, which is a delta peak at 1keV, and therefore leaves the spectrum unchanged
+static double *get_delta_line_profile(const double *ener, int n_ener) {
+  auto frel = new double[n_ener];
+  setArrayToZero(frel, n_ener);
+  frel[binary_search(ener, n_ener + 1, 1.0)] = 1.0;
+  return frel;
+}
+
+// maximal difference in the xillver energy band, relative to the maximal value of spec1
+static double get_max_difference_in_xillver_band(const double *ener, const double *spec1, const double *spec2,
+                                                 int n_ener) {
+  double max_diff = 0.0;
+  double max_val = 0.0;
+  for (int ii = 0; ii < n_ener; ii++) {
+    if (ener[ii] >= EMIN_XILLVER && ener[ii + 1] < EMAX_XILLVER) {
+      max_diff = fmax(max_diff, fabs(spec2[ii] - spec1[ii]));
+      max_val = fmax(max_val, fabs(spec1[ii]));
+    }
+  }
+  return max_diff / max_val;
+}
+
+TEST_CASE(" FFTW plans are cached", "[conv]") {
+
+  int status = EXIT_SUCCESS;
+  const int n = 1024;
+
+  double *in = fftw_alloc_real(n);
+  fftw_complex *out = fftw_alloc_complex(n / 2 + 1);
+
+  fftw_plan plan1 = get_fftw_plan_r2c(n, in, out, &status);
+  fftw_plan plan2 = get_fftw_plan_r2c(n, in, out, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+  REQUIRE(plan1 != nullptr);
+  REQUIRE(plan1 == plan2);
+
+  // different size and transform direction need a new plan
+  REQUIRE(get_fftw_plan_r2c(n / 2, in, out, &status) != plan1);
+  REQUIRE(get_fftw_plan_c2r(n, out, in, &status) != plan1);
+
+  fftw_free(in);
+  fftw_free(out);
+}
+
+TEST_CASE(" Convolution with a delta line profile", "[conv]") {
+
+  int status = EXIT_SUCCESS;
+
+  relline_spec_multizone *rel_profile = nullptr;
+  double *xill_spec = nullptr;
+  init_std_relXill_spec(&rel_profile, &xill_spec, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  int n_ener = rel_profile->n_ener;
+  double *ener = rel_profile->ener;
+  double *frel = get_delta_line_profile(ener, n_ener);
+
+  specCache *spec_cache = init_global_specCache(&status);
+  auto spec_conv_out = new double[n_ener];
+
+  // call it twice to make sure the cached plans deliver the same result
+  for (int ii = 0; ii < 2; ii++) {
+    convolveSpectrumFFTNormalized(ener, xill_spec, frel, spec_conv_out, n_ener, 1, 1, 0, spec_cache, &status);
+    REQUIRE(status == EXIT_SUCCESS);
+    REQUIRE(get_max_difference_in_xillver_band(ener, xill_spec, spec_conv_out, n_ener) < LIMIT_PREC_CONV);
+  }
+
+  delete[] frel;
+  delete[] xill_spec;
+  delete[] spec_conv_out;
+}
+
+TEST_CASE(" Batched convolution of several zones", "[conv]") {
+
+  int status = EXIT_SUCCESS;
+
+  relline_spec_multizone *rel_profile_std = nullptr;
+  double *xill_spec = nullptr;
+  init_std_relXill_spec(&rel_profile_std, &xill_spec, &status);
+
+  const int nzones = 5;
+  relline_spec_multizone *rel_profile = nullptr;
+  relParam *rel_param = nullptr;
+  get_RelProfileConstEmisZones(&rel_profile, &rel_param, nzones, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  const int n_ener = rel_profile->n_ener;
+  double *ener = rel_profile->ener;
+
+  auto xill_spec_zones = new const double *[nzones];
+  for (int ii = 0; ii < nzones; ii++) {
+    xill_spec_zones[ii] = xill_spec;
+  }
+
+  specCache *spec_cache = init_global_specCache(&status);
+  auto conv_out_batched = new double[nzones * n_ener];
+  fftw_conv_spectrum_zones(ener, xill_spec_zones, rel_profile->flux, conv_out_batched, n_ener, nzones, 1, 1,
+                           spec_cache, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  auto conv_out_single = new double[n_ener];
+  for (int ii = 0; ii < nzones; ii++) {
+    normalizeFFTOutput(ener, xill_spec, rel_profile->flux[ii], conv_out_batched + ii * n_ener, n_ener);
+    convolveSpectrumFFTNormalized(ener, xill_spec, rel_profile->flux[ii], conv_out_single, n_ener, 1, 1, ii,
+                                  spec_cache, &status);
+    REQUIRE(get_max_difference_in_xillver_band(ener, conv_out_single, conv_out_batched + ii * n_ener, n_ener)
+                < LIMIT_PREC_CONV);
+  }
+
+  delete[] xill_spec_zones;
+  delete[] xill_spec;
+  delete[] conv_out_batched;
+  delete[] conv_out_single;
+  delete rel_param;
+}
+
+TEST_CASE(" Direct convolution of the narrow outer zones", "[conv]") {
+
+  int status = EXIT_SUCCESS;
+
+  relline_spec_multizone *rel_profile_std = nullptr;
+  double *xill_spec = nullptr;
+  init_std_relXill_spec(&rel_profile_std, &xill_spec, &status);
+
+  // the outermost zones (up to 1000rg) have a very narrow line profile
+  const int nzones = 50;
+  relline_spec_multizone *rel_profile = nullptr;
+  relParam *rel_param = nullptr;
+  get_RelProfileConstEmisZones(&rel_profile, &rel_param, nzones, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  const int n_ener = rel_profile->n_ener;
+  double *ener = rel_profile->ener;
+
+  auto xill_spec_zones = new const double *[nzones];
+  for (int ii = 0; ii < nzones; ii++) {
+    xill_spec_zones[ii] = xill_spec;
+  }
+
+  specCache *spec_cache = init_global_specCache(&status);
+  auto conv_out_zones = new double[nzones * n_ener];
+  fftw_conv_spectrum_zones(ener, xill_spec_zones, rel_profile->flux, conv_out_zones, n_ener, nzones, 1, 1,
+                           spec_cache, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  auto conv_out_single = new double[n_ener];
+  for (int ii = nzones - 5; ii < nzones; ii++) {
+    normalizeFFTOutput(ener, xill_spec, rel_profile->flux[ii], conv_out_zones + ii * n_ener, n_ener);
+    convolveSpectrumFFTNormalized(ener, xill_spec, rel_profile->flux[ii], conv_out_single, n_ener, 1, 1, 0,
+                                  spec_cache, &status);
+    REQUIRE(get_max_difference_in_xillver_band(ener, conv_out_single, conv_out_zones + ii * n_ener, n_ener)
+                < LIMIT_PREC_CONV);
+  }
+
+  delete[] xill_spec_zones;
+  delete[] xill_spec;
+  delete[] conv_out_zones;
+  delete[] conv_out_single;
+  delete rel_param;
+}
+
+TEST_CASE(" Summing the convolved zones in Fourier space", "[conv]") {
+
+  int status = EXIT_SUCCESS;
+
+  relline_spec_multizone *rel_profile_std = nullptr;
+  double *xill_spec = nullptr;
+  init_std_relXill_spec(&rel_profile_std, &xill_spec, &status);
+
+  const int nzones = 5;
+  relline_spec_multizone *rel_profile = nullptr;
+  relParam *rel_param = nullptr;
+  get_RelProfileConstEmisZones(&rel_profile, &rel_param, nzones, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  const int n_ener = rel_profile->n_ener;
+  double *ener = rel_profile->ener;
+
+  auto xill_spec_zones = new const double *[nzones];
+  for (int ii = 0; ii < nzones; ii++) {
+    xill_spec_zones[ii] = xill_spec;
+  }
+  xill_spec_zones[2] = nullptr; // empty zones are skipped
+
+  specCache *spec_cache = init_global_specCache(&status);
+  auto conv_out_zones = new double[nzones * n_ener];
+  fftw_conv_spectrum_zones(ener, xill_spec_zones, rel_profile->flux, conv_out_zones, n_ener, nzones, 1, 1,
+                           spec_cache, &status);
+
+  auto conv_out_ref = new double[n_ener];
+  setArrayToZero(conv_out_ref, n_ener);
+  for (int ii = 0; ii < nzones; ii++) {
+    if (xill_spec_zones[ii] != nullptr) {
+      normalizeFFTOutput(ener, xill_spec, rel_profile->flux[ii], conv_out_zones + ii * n_ener, n_ener);
+      for (int jj = 0; jj < n_ener; jj++) {
+        conv_out_ref[jj] += conv_out_zones[ii * n_ener + jj];
+      }
+    }
+  }
+
+  auto conv_out_summed = new double[n_ener];
+  fftw_conv_spectrum_zones_summed(ener, xill_spec_zones, rel_profile->flux, conv_out_summed, n_ener, nzones, 0, 1,
+                                  spec_cache, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  REQUIRE(get_max_difference_in_xillver_band(ener, conv_out_ref, conv_out_summed, n_ener) < LIMIT_PREC_CONV);
+
+  delete[] xill_spec_zones;
+  delete[] xill_spec;
+  delete[] conv_out_zones;
+  delete[] conv_out_ref;
+  delete[] conv_out_summed;
+  delete rel_param;
+}
+
+TEST_CASE(" Combining the xillver inclinations in Fourier space", "[conv]") {
+
+  int status = EXIT_SUCCESS;
+
+  const int nzones = 3;
+  relline_spec_multizone *rel_profile = nullptr;
+  relParam *rel_param = nullptr;
+  get_RelProfileConstEmisZones(&rel_profile, &rel_param, nzones, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  const int n_ener = rel_profile->n_ener;
+  double *ener = rel_profile->ener;
+
+  xillSpec *xill_spec_table = get_std_xill_spec(&status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  auto xill_spec = new xillSpec *[nzones];
+  auto dist = new double *[nzones];
+  auto norm_factors = new double[nzones];
+  auto xill_spec_zones = new const double *[nzones];
+  auto xill_flux = new double[xill_spec_table->n_ener];
+  for (int ii = 0; ii < nzones; ii++) {
+    xill_spec[ii] = xill_spec_table;
+    norm_factors[ii] = 1.0 + 0.1 * ii;
+    dist[ii] = new double[xill_spec_table->n_incl];
+    for (int jj = 0; jj < xill_spec_table->n_incl; jj++) {
+      dist[ii][jj] = 1.0 / (1.0 + jj + ii);
+    }
+
+    // the standard way: weight the spectra in real space and rebin them
+    calc_xillver_angdep(xill_flux, xill_spec_table, dist[ii], &status);
+    for (int jj = 0; jj < xill_spec_table->n_ener; jj++) {
+      xill_flux[jj] /= norm_factors[ii];
+    }
+    auto xill_rebinned = new double[n_ener];
+    rebin_spectrum(ener, xill_rebinned, n_ener, xill_spec_table->ener, xill_flux, xill_spec_table->n_ener);
+    xill_spec_zones[ii] = xill_rebinned;
+  }
+
+  specCache *spec_cache = init_global_specCache(&status);
+  auto conv_out_ref = new double[nzones * n_ener];
+  fftw_conv_spectrum_zones(ener, xill_spec_zones, rel_profile->flux, conv_out_ref, n_ener, nzones, 1, 1,
+                           spec_cache, &status);
+
+  spec_cache->xill_incl_fft_valid = 0;
+  fftw_mix_xillver_inclinations(ener, n_ener, xill_spec, dist, norm_factors, nzones, spec_cache, &status);
+  auto conv_out_mixed = new double[nzones * n_ener];
+  fftw_conv_spectrum_zones(ener, xill_spec_zones, rel_profile->flux, conv_out_mixed, n_ener, nzones, 0, 0,
+                           spec_cache, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  for (int ii = 0; ii < nzones; ii++) {
+    REQUIRE(get_max_difference_in_xillver_band(ener, conv_out_ref + ii * n_ener, conv_out_mixed + ii * n_ener, n_ener)
+                < LIMIT_PREC_CONV);
+    delete[] xill_spec_zones[ii];
+    delete[] dist[ii];
+  }
+
+  delete[] xill_spec;
+  delete[] xill_spec_zones;
+  delete[] dist;
+  delete[] norm_factors;
+  delete[] xill_flux;
+  delete[] conv_out_ref;
+  delete[] conv_out_mixed;
+  delete rel_param;
+}
+
+#ifdef RELXILL_FFTW_FLOAT
+TEST_CASE(" Single precision convolution of several zones", "[conv]") {
+
+  int status = EXIT_SUCCESS;
+  const char *env = "RELXILL_FFTW_FLOAT";
+
+  relline_spec_multizone *rel_profile_std = nullptr;
+  double *xill_spec = nullptr;
+  init_std_relXill_spec(&rel_profile_std, &xill_spec, &status);
+
+  const int nzones = 5;
+  relline_spec_multizone *rel_profile = nullptr;
+  relParam *rel_param = nullptr;
+  get_RelProfileConstEmisZones(&rel_profile, &rel_param, nzones, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  const int n_ener = rel_profile->n_ener;
+  double *ener = rel_profile->ener;
+
+  auto xill_spec_zones = new const double *[nzones];
+  for (int ii = 0; ii < nzones; ii++) {
+    xill_spec_zones[ii] = xill_spec;
+  }
+
+  specCache *spec_cache = init_global_specCache(&status);
+  auto conv_out_double = new double[nzones * n_ener];
+  fftw_conv_spectrum_zones(ener, xill_spec_zones, rel_profile->flux, conv_out_double, n_ener, nzones, 1, 1,
+                           spec_cache, &status);
+
+  setenv(env, "1", 1);
+  auto conv_out_float = new double[nzones * n_ener];
+  fftw_conv_spectrum_zones(ener, xill_spec_zones, rel_profile->flux, conv_out_float, n_ener, nzones, 1, 1,
+                           spec_cache, &status);
+  unsetenv(env);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  for (int ii = 0; ii < nzones; ii++) {
+    REQUIRE(get_max_difference_in_xillver_band(ener, conv_out_double + ii * n_ener, conv_out_float + ii * n_ener,
+                                               n_ener) < FFTW_FLOAT_MAX_DEVIATION);
+  }
+
+  delete[] xill_spec_zones;
+  delete[] xill_spec;
+  delete[] conv_out_double;
+  delete[] conv_out_float;
+  delete rel_param;
+}
+#endif
+
+TEST_CASE(" Adaptive convolution energy grid", "[conv]") {
+
+  int status = EXIT_SUCCESS;
+  const char *env = "RELXILL_CONV_GRID_ADAPTIVE";
+
+  DefaultSpec default_spec(0.3, 10.0, 500);
+  auto spec = default_spec.get_xspec_spectrum();
+  LocalModel lmod(ModelName::relxill);
+  lmod.set_par(XPar::a, 0.9);
+
+  int n_ener_std;
+  double *ener_std;
+  get_relxill_conv_energy_grid(&n_ener_std, &ener_std, &status);
+
+  relParam *rel_param = lmod.get_rel_params();
+  RelSysPar *sys_par = get_system_parameters(rel_param, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  setenv(env, "1", 1);
+  int n_ener;
+  double *ener;
+  get_relxill_conv_energy_grid_adaptive(spec.energy[0], spec.energy[spec.num_flux_bins()], sys_par,
+                                        &n_ener, &ener, &status);
+  unsetenv(env);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  // a sub-grid of the standard grid, which contains the requested band
+  REQUIRE(n_ener < n_ener_std);
+  REQUIRE(n_ener % 2 == 0);
+  REQUIRE(ener >= ener_std);
+  REQUIRE(ener + n_ener <= ener_std + n_ener_std);
+  REQUIRE(ener[0] < spec.energy[0]);
+  REQUIRE(ener[n_ener] > spec.energy[spec.num_flux_bins()]);
+
+  lmod.eval_model(spec);
+  auto flux_std = new double[spec.num_flux_bins()];
+  for (int ii = 0; ii < spec.num_flux_bins(); ii++) {
+    flux_std[ii] = spec.flux[ii];
+  }
+
+  // the change of the spin makes sure that the spectrum is not taken from the cache
+  setenv(env, "1", 1);
+  lmod.set_par(XPar::a, 0.5);
+  lmod.eval_model(spec);
+  lmod.set_par(XPar::a, 0.9);
+  lmod.eval_model(spec);
+  unsetenv(env);
+
+  for (int ii = 0; ii < spec.num_flux_bins(); ii++) {
+    REQUIRE(fabs(spec.flux[ii] / flux_std[ii] - 1) < LIMIT_PREC_ADAPTIVE_GRID);
+  }
+
+  delete[] flux_std;
+  delete rel_param;
+}
+
+static void set_powerlaw_input_flux(const XspecSpectrum &spec, double gamma) {
+  for (int ii = 0; ii < spec.num_flux_bins(); ii++) {
+    spec.flux[ii] = pow(0.5 * (spec.energy[ii] + spec.energy[ii + 1]), -gamma)
+        * (spec.energy[ii + 1] - spec.energy[ii]);
+  }
+}
+
+TEST_CASE(" Relconv re-uses the transform of its kernel", "[conv]") {
+
+  DefaultSpec default_spec(0.1, 100.0, 1000);
+  auto spec = default_spec.get_xspec_spectrum();
+  LocalModel lmod(ModelName::relconv);
+  lmod.set_par(XPar::a, 0.9);
+
+  // the second evaluation only changes the input spectrum, i.e., uses the cached kernel and its transform
+  set_powerlaw_input_flux(spec, 2.0);
+  lmod.eval_model(spec);
+  const auto context = lmod.get_cache_context();
+  const size_t hits_before = context->hits;
+  const long n_rel_transforms_before = context->spec_cache->n_rel_transforms;
+  set_powerlaw_input_flux(spec, 1.7);
+  lmod.eval_model(spec);
+  REQUIRE(context->hits == hits_before + 1);
+  REQUIRE(context->spec_cache->n_rel_transforms == n_rel_transforms_before);
+
+  auto flux_cached = new double[spec.num_flux_bins()];
+  for (int ii = 0; ii < spec.num_flux_bins(); ii++) {
+    flux_cached[ii] = spec.flux[ii];
+  }
+
+  // changing the spin in between forces the kernel to be re-calculated
+  lmod.set_par(XPar::a, 0.5);
+  lmod.eval_model(spec);
+  REQUIRE(context->spec_cache->n_rel_transforms == n_rel_transforms_before + 1);
+  lmod.set_par(XPar::a, 0.9);
+  set_powerlaw_input_flux(spec, 1.7);
+  lmod.eval_model(spec);
+
+  for (int ii = 0; ii < spec.num_flux_bins(); ii++) {
+    REQUIRE(fabs(spec.flux[ii] - flux_cached[ii]) <= LIMIT_PREC_CONV * fabs(flux_cached[ii]));
+  }
+
+  delete[] flux_cached;
+}
@@ -19,6 +19,11 @@
 #include "catch2/catch_amalgamated.hpp"
 #include "LocalModel.h"
 #include "common-functions.h"
+#include "Relprofile.h"
+#include "Relbase.h"
+#include "Relsimd.h"
+
+#include <algorithm>
 
 extern "C" {
 #include "writeOutfiles.h"
@@ -40,6 +45,178 @@ TEST_CASE(" compare standard relline profile with reference flux "){
 }
 
 
+static void calc_relline_profile_for_index(LocalModel &lmod, double index, relline_spec_multizone **spec,
+                                           std::vector<double> &flux, int *status) {
+  lmod.set_par(XPar::index1, index);
+  lmod.set_par(XPar::index2, index);
+  relParam *rel_param = lmod.get_rel_params();
+
+  int n_ener;
+  double *ener;
+  get_relxill_conv_energy_grid(&n_ener, &ener, status);
+  double radial_zones[2] = {rel_param->rin, rel_param->rout};
+  init_relline_spec_multizone(spec, rel_param, nullptr, radial_zones, &ener, n_ener, status);
+
+  RelSysPar *sys_par = get_system_parameters(rel_param, status);
+  calc_relline_profile(*spec, sys_par, rel_param, status);
+  flux.assign((*spec)->flux[0], (*spec)->flux[0] + n_ener);
+
+  delete rel_param;  // the energy grid is the global one of get_relxill_conv_energy_grid
+}
+
+TEST_CASE(" relline profile for a changed emissivity from the cached radial profiles", "[relline]") {
+
+  int status = EXIT_SUCCESS;
+  LocalModel lmod(ModelName::relline);
+  relline_spec_multizone *spec = nullptr;
+
+  // the second profile is only the sum of the cached radial profiles, as only the emissivity changes
+  std::vector<double> flux_cached;
+  calc_relline_profile_for_index(lmod, 3.0, &spec, flux_cached, &status);
+  calc_relline_profile_for_index(lmod, 2.0, &spec, flux_cached, &status);
+
+  free_relprofile_cache();
+  std::vector<double> flux_ref;
+  calc_relline_profile_for_index(lmod, 2.0, &spec, flux_ref, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  for (size_t ii = 0; ii < flux_ref.size(); ii++) {
+    REQUIRE(fabs(flux_cached[ii] - flux_ref[ii]) <= 1e-10 * fabs(flux_ref[ii]));
+  }
+
+  free_rel_spec(spec);
+
+}
+
+TEST_CASE(" relline profile from the cumulative integral agrees with the Romberg integration", "[relline]") {
+
+  int status = EXIT_SUCCESS;
+  LocalModel lmod(ModelName::relline);
+  relline_spec_multizone *spec = nullptr;
+
+  std::vector<double> flux_romberg;
+  calc_relline_profile_for_index(lmod, 3.0, &spec, flux_romberg, &status);
+
+  setenv("RELXILL_RELLINE_CDF", "1", 1);
+  std::vector<double> flux_cdf;
+  calc_relline_profile_for_index(lmod, 3.0, &spec, flux_cdf, &status);
+  setenv("RELXILL_RELLINE_CDF", "0", 1);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  // The bounds are set by int_edge of the Romberg engine, not by the CDF engine (which agrees with an
+  // exact quadrature of the same transfer function to 3e-4 per bin): int_edge approximates the edges
+  // g*=[0,GFAC_H] and [1-GFAC_H,1] by the value at GFAC_H (1-GFAC_H) and neglects the change of E^3
+  // within them. It misses about 1.6% of the flux of these edges, which dominate the bins at the
+  // edges of the line of the inner radii (up to 2% difference per bin and 1e-3 of the total flux).
+  // With the edges integrated exactly, both engines agree to about 1e-3 per bin.
+  double flux_max = *std::max_element(flux_romberg.begin(), flux_romberg.end());
+  for (size_t ii = 0; ii < flux_romberg.size(); ii++) {
+    if (flux_romberg[ii] > 1e-3 * flux_max) {
+      REQUIRE(fabs(flux_cdf[ii] - flux_romberg[ii]) <= 0.03 * flux_romberg[ii]);
+    }
+  }
+
+  REQUIRE(fabs(sum_flux(flux_cdf.data(), static_cast<int>(flux_cdf.size()))
+                   / sum_flux(flux_romberg.data(), static_cast<int>(flux_romberg.size())) - 1) < 2e-3);
+
+  free_rel_spec(spec);
+
+}
+
+TEST_CASE(" relline profile does not depend on the number of threads", "[relline]") {
+
+  int status = EXIT_SUCCESS;
+  LocalModel lmod(ModelName::relline);
+  relline_spec_multizone *spec = nullptr;
+
+  free_relprofile_cache();
+  std::vector<double> flux_single;
+  calc_relline_profile_for_index(lmod, 3.0, &spec, flux_single, &status);
+
+  setenv("RELXILL_NUM_THREADS", "4", 1);
+  free_relprofile_cache();
+  std::vector<double> flux_threads;
+  calc_relline_profile_for_index(lmod, 3.0, &spec, flux_threads, &status);
+  setenv("RELXILL_NUM_THREADS", "1", 1);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  for (size_t ii = 0; ii < flux_single.size(); ii++) {
+    REQUIRE(flux_threads[ii] == flux_single[ii]);
+  }
+
+  free_rel_spec(spec);
+
+}
+
+TEST_CASE(" relline profile and system parameters from SIMD lanes are identical to the scalar ones", "[relline]") {
+
+  int status = EXIT_SUCCESS;
+  LocalModel lmod(ModelName::relline);
+  relline_spec_multizone *spec = nullptr;
+  setenv("RELXILL_RELLINE_CDF", "1", 1);
+
+  // limb law 0 and 1 are evaluated in SIMD lanes (if the CPU supports it), 2 is always scalar
+  for (int limb = 0; limb <= 2; limb++) {
+    lmod.set_par(XPar::limb, limb);
+
+    free_cache_syspar();
+    free_relprofile_cache();
+    std::vector<double> flux_simd;
+    calc_relline_profile_for_index(lmod, 3.0, &spec, flux_simd, &status);
+
+    setenv(ENV_RELXILL_SIMD, "0", 1);
+    free_cache_syspar();
+    free_relprofile_cache();
+    std::vector<double> flux_scalar;
+    calc_relline_profile_for_index(lmod, 3.0, &spec, flux_scalar, &status);
+    unsetenv(ENV_RELXILL_SIMD);
+    REQUIRE(status == EXIT_SUCCESS);
+
+    for (size_t ii = 0; ii < flux_scalar.size(); ii++) {
+      REQUIRE(flux_simd[ii] == flux_scalar[ii]);
+    }
+  }
+
+  setenv("RELXILL_RELLINE_CDF", "0", 1);
+  free_rel_spec(spec);
+
+}
+
+TEST_CASE(" system parameters for a changed rin from the cached interpolation in the a-mu0 plane", "[relline]") {
+
+  int status = EXIT_SUCCESS;
+  LocalModel lmod(ModelName::relline);
+
+  // the second call only rebins the cached a-mu0 plane, as a and incl do not change
+  lmod.set_par(XPar::rin, 3.0);
+  relParam *rel_param = lmod.get_rel_params();
+  get_system_parameters(rel_param, &status);
+  delete rel_param;
+  lmod.set_par(XPar::rin, 8.0);
+  rel_param = lmod.get_rel_params();
+  RelSysPar *sys_par_cached = get_system_parameters(rel_param, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+  std::vector<double> re_cached(sys_par_cached->re, sys_par_cached->re + sys_par_cached->nr);
+  std::vector<double> trff_cached(get_syspar_trff(sys_par_cached, 0, 0),
+                                  get_syspar_trff(sys_par_cached, 0, 0) + 2 * sys_par_cached->nr * sys_par_cached->ng);
+
+  // the cached system parameters are freed here as well
+  free_cache_syspar();
+  free_relprofile_cache();
+  RelSysPar *sys_par_ref = get_system_parameters(rel_param, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  for (size_t ii = 0; ii < re_cached.size(); ii++) {
+    REQUIRE(re_cached[ii] == sys_par_ref->re[ii]);
+  }
+  for (size_t ii = 0; ii < trff_cached.size(); ii++) {
+    REQUIRE(trff_cached[ii] == get_syspar_trff(sys_par_ref, 0, 0)[ii]);
+  }
+
+  delete rel_param;
+
+}
+
 /*
 TEST_CASE(" compare standard xillver evaluation with reference flux") {
 
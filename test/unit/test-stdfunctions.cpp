@@ -21,9 +21,11 @@
 #include "common-functions.h"
 #include "Relbase.h"
 #include "Relphysics.h"
+#include "Relcache.h"
 
 extern "C" {
 #include "relutility.h"
+#include "relshm.h"
 }
 #define LIMIT_PREC 1e-6
 
@@ -126,6 +128,55 @@ TEST_CASE( "Lamp Post Table Values read from FITS", "[basic]") {
 }
 
 
+TEST_CASE(" Relline and Lamp Post Tables in shared memory are identical to the FITS tables", "[basic]") {
+
+  int status = EXIT_SUCCESS;
+  relTable *rel_ref = nullptr;
+  lpTable *lp_ref = nullptr;
+  read_relline_table(RELTABLE_FILENAME, &rel_ref, &status);
+  read_lp_table(LPTABLE_FILENAME, &lp_ref, &status);
+
+  // the first load publishes the tables, the second one only maps them
+  setenv(ENV_SHARED_TABLES, "1", 1);
+  for (int kk = 0; kk < 2; kk++) {
+    relTable *rel_tab = nullptr;
+    lpTable *lp_tab = nullptr;
+    read_relline_table(RELTABLE_FILENAME, &rel_tab, &status);
+    read_lp_table(LPTABLE_FILENAME, &lp_tab, &status);
+    REQUIRE(status == EXIT_SUCCESS);
+    REQUIRE(rel_tab->shm != nullptr);
+    REQUIRE(lp_tab->shm != nullptr);
+
+    REQUIRE(rel_tab->a[RELTABLE_NA - 1] == rel_ref->a[RELTABLE_NA - 1]);
+    REQUIRE(rel_tab->mu0[RELTABLE_NMU0 - 1] == rel_ref->mu0[RELTABLE_NMU0 - 1]);
+    for (int ii = 0; ii < RELTABLE_NR; ii++) {
+      REQUIRE(rel_tab->arr[RELTABLE_NA - 1][1]->gmax[ii] == rel_ref->arr[RELTABLE_NA - 1][1]->gmax[ii]);
+      REQUIRE(rel_tab->arr[RELTABLE_NA - 1][1]->cosne2[ii][RELTABLE_NG - 1]
+                  == rel_ref->arr[RELTABLE_NA - 1][1]->cosne2[ii][RELTABLE_NG - 1]);
+    }
+
+    REQUIRE(lp_tab->a[LPTABLE_NA - 1] == lp_ref->a[LPTABLE_NA - 1]);
+    for (int ii = 0; ii < LPTABLE_NH; ii++) {
+      REQUIRE(lp_tab->dat[LPTABLE_NA - 1]->h[ii] == lp_ref->dat[LPTABLE_NA - 1]->h[ii]);
+      REQUIRE(lp_tab->dat[LPTABLE_NA - 1]->del_inc[ii][LPTABLE_NR - 1]
+                  == lp_ref->dat[LPTABLE_NA - 1]->del_inc[ii][LPTABLE_NR - 1]);
+    }
+
+    if (kk == 1) {
+      remove_shm_table(rel_tab->shm);
+      remove_shm_table(lp_tab->shm);
+    }
+    free_relTable(rel_tab);
+    free_lpTable(lp_tab);
+  }
+  unsetenv(ENV_SHARED_TABLES);
+
+  free_relTable(rel_ref);
+  free_lpTable(lp_ref);
+
+}
+
+
 TEST_CASE("rebin spectrum", "[basic]") {
 
   int n0 = 6;
@@ -297,3 +348,54 @@ TEST_CASE(" Normlization of the FFT Convolution", "[bbasic]") {
 
 }
 
+static size_t size_of_test_value(const double *) {
+  return 100;
+}
+
+static void free_test_value(double *val) {
+  delete val;
+}
+
+TEST_CASE(" LRU cache keeps the most recently used values within its budget", "[basic]") {
+
+  LruCache<double> cache(300, size_of_test_value, free_test_value);
+
+  CacheKey keys[4];
+  for (int ii = 0; ii < 4; ii++) {
+    keys[ii].add(1.0 * ii);
+    keys[ii].add(ii);
+  }
+
+  // values within CACHE_LIMIT give the same key
+  CacheKey key_close;
+  key_close.add(1.0 + 0.1 * CACHE_LIMIT);
+  key_close.add(1);
+  REQUIRE(key_close == keys[1]);
+  REQUIRE(key_close.hash() == keys[1].hash());
+
+  for (int ii = 0; ii < 3; ii++) {
+    cache.insert(keys[ii], new double(ii));
+  }
+  REQUIRE(*cache.find(keys[0]) == 0.0);
+
+  // the budget allows only 3 values, so the least recently used one (keys[1]) is deleted
+  cache.insert(keys[3], new double(3));
+  REQUIRE(cache.size() == 3);
+  REQUIRE(cache.num_bytes() == 300);
+  REQUIRE(cache.find(keys[1]) == nullptr);
+  REQUIRE(cache.find(key_close) == nullptr);
+  REQUIRE(*cache.find(keys[3]) == 3.0);
+  REQUIRE(cache.hits() == 2);
+  REQUIRE(cache.misses() == 2);
+
+  // even if the budget only allows a single value, the value found before stays valid while the next one is added
+  LruCache<double> small_cache(150, size_of_test_value, free_test_value);
+  small_cache.insert(keys[0], new double(0));
+  small_cache.insert(keys[1], new double(1));
+  const double *value_found = small_cache.find(keys[0]);
+  small_cache.insert(keys[2], new double(2));
+  REQUIRE(small_cache.size() == LRU_CACHE_MIN_ENTRIES);
+  REQUIRE(small_cache.find(keys[1]) == nullptr);
+  REQUIRE(*value_found == 0.0);
+
+}
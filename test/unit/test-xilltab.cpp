@@ -21,9 +21,15 @@
 #include "LocalModel.h"
 #include "Relbase.h"
 #include "Xillspec.h"
+#include "Xillprefetch.h"
+
+#include <filesystem>
 
 extern "C" {
 #include "xilltable.h"
+#include "xillstore.h"
+#include "xillresidency.h"
+#include "relshm.h"
 }
 
 
@@ -206,6 +212,285 @@ TEST_CASE(" check for existing table ", "[xilltab]") {
 }
 
 
+TEST_CASE(" xillver spectra from the binary store are identical to the ones from the table", "[xilltab]") {
+
+  int status = EXIT_SUCCESS;
+  LocalModel lmod(ModelName::relxill);
+  xillParam *param = lmod.get_xill_params();
+
+  setenv(ENV_XILLVER_STORE, "0", 1);
+  free_cached_xillTable();
+  xillSpec *spec_table = get_xillver_spectra(param, &status);
+
+  const std::string store_dir = std::filesystem::temp_directory_path().string();
+  setenv(ENV_XILLVER_STORE, store_dir.c_str(), 1);
+  char *store_filename = get_xillstore_filename(XILLTABLE_FILENAME, &status);
+  convert_xillver_table_to_store(XILLTABLE_FILENAME, store_filename, 0.0, 15.0, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  free_cached_xillTable();
+  xillSpec *spec_store = get_xillver_spectra(param, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  xillTable *tab = nullptr;
+  get_init_xillver_table(&tab, param->model_type, param->prim_type, &status);
+  REQUIRE(tab->store_spectra != nullptr);
+
+  for (int ii = 0; ii < spec_table->n_incl; ii++) {
+    for (int jj = 0; jj < spec_table->n_ener; jj++) {
+      REQUIRE(spec_store->flu[ii][jj] == spec_table->flu[ii][jj]);
+    }
+  }
+
+  free_cached_xillTable();
+  unsetenv(ENV_XILLVER_STORE);
+  remove(store_filename);
+  free(store_filename);
+  free_xill_spec(spec_table);
+  free_xill_spec(spec_store);
+  delete param;
+
+}
+
+
+static int num_loaded_xillspec(const xillTable *tab) {
+  int num_loaded = 0;
+  for (int ii = 0; ii < tab->num_elements; ii++) {
+    if (tab->data_storage[ii] != nullptr) {
+      num_loaded++;
+    }
+  }
+  return num_loaded;
+}
+
+TEST_CASE(" preloaded xillver spectra are identical to the ones loaded by the evaluation", "[xilltab]") {
+
+  int status = EXIT_SUCCESS;
+  LocalModel lmod(ModelName::relxill);
+  xillParam *param = lmod.get_xill_params();
+  setenv(ENV_XILLVER_STORE, "0", 1);
+
+  free_cached_xillTable();
+  xillSpec *spec_ref = get_xillver_spectra(param, &status);
+
+  xillTableParam *param_lo = get_xilltab_param(param, &status);
+  xillTableParam *param_hi = get_xilltab_param(param, &status);
+  param_lo->gam -= 0.2;
+  param_hi->gam += 0.2;
+  param_lo->lxi -= 0.5;
+  param_hi->lxi += 0.5;
+
+  free_cached_xillTable();
+  preload_xillver_spectra_table(param_lo, param_hi, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  xillTable *tab = nullptr;
+  get_init_xillver_table(&tab, param->model_type, param->prim_type, &status);
+  const int num_preloaded = num_loaded_xillspec(tab);
+  REQUIRE(num_preloaded > 0);
+
+  // all spectra within the range are available, so nothing else is loaded
+  xillSpec *spec_preload = get_xillver_spectra(param, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+  REQUIRE(num_loaded_xillspec(tab) == num_preloaded);
+
+  for (int ii = 0; ii < spec_ref->n_incl; ii++) {
+    for (int jj = 0; jj < spec_ref->n_ener; jj++) {
+      REQUIRE(spec_preload->flu[ii][jj] == spec_ref->flu[ii][jj]);
+    }
+  }
+
+  free_cached_xillTable();
+  unsetenv(ENV_XILLVER_STORE);
+  free(param_lo);
+  free(param_hi);
+  free_xill_spec(spec_ref);
+  free_xill_spec(spec_preload);
+  delete param;
+
+}
+
+
+TEST_CASE(" xillver spectra are prefetched in the direction of the parameter change", "[xilltab]") {
+
+  int status = EXIT_SUCCESS;
+  LocalModel lmod(ModelName::relxill);
+  xillParam *param = lmod.get_xill_params();
+  setenv(ENV_XILLVER_STORE, "0", 1);
+
+  free_cached_tables();
+  xillSpec *spec = get_xillver_spectra(param, &status);
+  free_xill_spec(spec);
+
+  xillTable *tab = nullptr;
+  get_init_xillver_table(&tab, param->model_type, param->prim_type, &status);
+  const int ind_gam = get_xilltab_param_index(tab, PARAM_GAM);
+  const float *gam_vals = tab->param_vals[ind_gam];
+  REQUIRE(tab->num_param_vals[ind_gam] >= 3);
+
+  // move Gamma within its first cell, such that the next cell is requested
+  setenv("RELXILL_XILLVER_PREFETCH", "1", 1);
+  param->gam = gam_vals[0] + 0.25 * (gam_vals[1] - gam_vals[0]);
+  spec = get_xillver_spectra(param, &status);
+  free_xill_spec(spec);
+  param->gam = gam_vals[0] + 0.5 * (gam_vals[1] - gam_vals[0]);
+  spec = get_xillver_spectra(param, &status);
+  free_xill_spec(spec);
+  XillverPrefetcher::instance().wait();
+  unsetenv("RELXILL_XILLVER_PREFETCH");
+
+  const int num_prefetched = num_loaded_xillspec(tab);
+
+  param->gam = gam_vals[1] + 0.5 * (gam_vals[2] - gam_vals[1]);
+  xillSpec *spec_prefetch = get_xillver_spectra(param, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+  REQUIRE(num_loaded_xillspec(tab) == num_prefetched);
+
+  free_cached_tables();
+  xillSpec *spec_ref = get_xillver_spectra(param, &status);
+  for (int ii = 0; ii < spec_ref->n_incl; ii++) {
+    for (int jj = 0; jj < spec_ref->n_ener; jj++) {
+      REQUIRE(spec_prefetch->flu[ii][jj] == spec_ref->flu[ii][jj]);
+    }
+  }
+
+  free_cached_tables();
+  unsetenv(ENV_XILLVER_STORE);
+  free_xill_spec(spec_prefetch);
+  free_xill_spec(spec_ref);
+  delete param;
+
+}
+
+
+TEST_CASE(" xillver spectra stay within the memory budget", "[xilltab]") {
+
+  int status = EXIT_SUCCESS;
+  LocalModel lmod(ModelName::relxill);
+  xillParam *param = lmod.get_xill_params();
+  setenv(ENV_XILLVER_STORE, "0", 1);
+
+  const std::vector<double> gamma_values = {1.5, 2.5, 1.6, 3.0, 2.0};
+
+  free_cached_tables();
+  std::vector<xillSpec *> spec_ref;
+  for (auto gam: gamma_values) {
+    param->gam = gam;
+    spec_ref.push_back(get_xillver_spectra(param, &status));
+  }
+
+  setenv(ENV_XILLVER_MAX_MB, "4", 1);
+  free_cached_tables();
+  for (size_t ii = 0; ii < gamma_values.size(); ii++) {
+    param->gam = gamma_values[ii];
+    xillSpec *spec = get_xillver_spectra(param, &status);
+    REQUIRE(status == EXIT_SUCCESS);
+    for (int jj = 0; jj < spec->n_incl; jj++) {
+      for (int kk = 0; kk < spec->n_ener; kk++) {
+        REQUIRE(spec->flu[jj][kk] == spec_ref[ii]->flu[jj][kk]);
+      }
+    }
+    free_xill_spec(spec);
+  }
+
+  xillTable *tab = nullptr;
+  get_init_xillver_table(&tab, param->model_type, param->prim_type, &status);
+  xillResidencyStats stats = get_xillresidency_stats(tab->residency);
+  REQUIRE(stats.max_bytes == 4 * 1024 * 1024);
+  REQUIRE(stats.num_evicted > 0);
+  REQUIRE(stats.resident_bytes <= stats.max_bytes);
+  REQUIRE(num_loaded_xillspec(tab) == stats.num_resident);
+
+  free_cached_tables();
+  unsetenv(ENV_XILLVER_MAX_MB);
+  unsetenv(ENV_XILLVER_STORE);
+  for (auto spec: spec_ref) {
+    free_xill_spec(spec);
+  }
+  delete param;
+
+}
+
+TEST_CASE(" Prefetched xillver spectra are freed before the used ones", "[xilltab]") {
+
+  int status = EXIT_SUCCESS;
+  setenv(ENV_XILLVER_MAX_MB, "2", 1);
+  const size_t spec_bytes = 1024 * 1024;
+  xillResidency *res = new_xillresidency(3, spec_bytes, &status);
+  unsetenv(ENV_XILLVER_MAX_MB);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  float *data_storage[3];
+  for (auto &spec: data_storage) {
+    spec = (float *) malloc(spec_bytes);
+  }
+
+  xillresidency_add(res, 0);
+  xillresidency_add(res, 1);
+  xillresidency_set_prefetching(res, 1);
+  xillresidency_add(res, 2);
+  xillresidency_touch(res, 2);
+  xillresidency_set_prefetching(res, 0);
+  xillresidency_touch(res, 0);
+
+  xillresidency_evict(res, data_storage);
+  REQUIRE(data_storage[0] != nullptr);
+  REQUIRE(data_storage[1] != nullptr);
+  REQUIRE(data_storage[2] == nullptr);
+  REQUIRE(get_xillresidency_stats(res).num_evicted == 1);
+
+  free(data_storage[0]);
+  free(data_storage[1]);
+  free_xillresidency(res);
+
+}
+
+
+TEST_CASE(" xillver spectra from shared memory are identical to the ones from the table", "[xilltab]") {
+
+  int status = EXIT_SUCCESS;
+  LocalModel lmod(ModelName::relxill);
+  xillParam *param = lmod.get_xill_params();
+  setenv(ENV_XILLVER_STORE, "0", 1);
+
+  free_cached_tables();
+  xillSpec *spec_ref = get_xillver_spectra(param, &status);
+
+  // the first load publishes the table, the second one only maps it
+  setenv(ENV_SHARED_TABLES, "1", 1);
+  free_cached_tables();
+  xillSpec *spec_publish = get_xillver_spectra(param, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  free_cached_tables();
+  xillSpec *spec_shared = get_xillver_spectra(param, &status);
+  REQUIRE(status == EXIT_SUCCESS);
+
+  xillTable *tab = nullptr;
+  get_init_xillver_table(&tab, param->model_type, param->prim_type, &status);
+  REQUIRE(tab->shm != nullptr);
+  REQUIRE(tab->store_spectra != nullptr);
+  REQUIRE(num_loaded_xillspec(tab) == 0);
+
+  for (int ii = 0; ii < spec_ref->n_incl; ii++) {
+    for (int jj = 0; jj < spec_ref->n_ener; jj++) {
+      REQUIRE(spec_publish->flu[ii][jj] == spec_ref->flu[ii][jj]);
+      REQUIRE(spec_shared->flu[ii][jj] == spec_ref->flu[ii][jj]);
+    }
+  }
+
+  remove_shm_table(tab->shm);
+  free_cached_tables();
+  unsetenv(ENV_SHARED_TABLES);
+  unsetenv(ENV_XILLVER_STORE);
+  free_xill_spec(spec_ref);
+  free_xill_spec(spec_publish);
+  free_xill_spec(spec_shared);
+  delete param;
+
+}
+
+
 static void testNormfacBand(xillSpec **spec, double elo, double ehi, double prec) {
 
   double sum0 = calcSumInEnergyBand(spec[0]->flu[0], spec[0]->n_ener, spec[0]->ener, elo, ehi);
@@ -23,6 +23,7 @@
 #include "common-functions.h"
 
 #include <vector>
+#include <thread>
 #include <filesystem>
 
 
@@ -254,4 +255,166 @@ TEST_CASE(" Testing caching an change of parameters for memory leaks", "[valgrin
   lmod.set_par(XPar::logxi, 2.135);
   REQUIRE_NOTHROW(lmod.eval_model(spec2));
 
-}
\ No newline at end of file
+}
+TEST_CASE(" Re-use the spectra of the last parameter values", "[model]") {
+  DefaultSpec default_spec{};
+  auto spec = default_spec.get_xspec_spectrum();
+
+  LocalModel lmod(ModelName::relxill);
+
+  // evaluate the model at p, p+delta and again at p (as done for the derivatives in the fit)
+  lmod.set_par(XPar::a, 0.9);
+  lmod.eval_model(spec);
+  std::vector<double> flux_ref(spec.flux, spec.flux + spec.num_flux_bins());
+
+  lmod.set_par(XPar::a, 0.91);
+  lmod.eval_model(spec);
+  const size_t hits_before = get_relxill_output_cache()->hits();
+
+  lmod.set_par(XPar::a, 0.9);
+  lmod.eval_model(spec);
+
+  REQUIRE(get_relxill_output_cache()->hits() == hits_before + 1);
+  for (size_t ii = 0; ii < flux_ref.size(); ii++) {
+    REQUIRE(spec.flux[ii] == flux_ref[ii]);
+  }
+
+}
+
+static std::vector<double> eval_model_flux(LocalModel &lmod, XspecSpectrum &spec) {
+  lmod.eval_model(spec);
+  return {spec.flux, spec.flux + spec.num_flux_bins()};
+}
+
+TEST_CASE(" Two components of the same model do not overwrite their caches", "[model]") {
+  DefaultSpec default_spec{};
+  auto spec = default_spec.get_xspec_spectrum();
+
+  setenv("RELXILL_OUTPUT_CACHE_SIZE", "0", 1);
+
+  // fresh context, such that no cache context of an earlier test is found
+  RelxillContext context;
+  RelxillContextGuard context_guard(&context);
+
+  // two components in the same dataset, separated by their handles
+  auto param_values = ModelDatabase::instance().get_default_values_array(ModelName::relxill);
+  LocalModel lmod0(param_values.data(), ModelName::relxill, 1, new_model_cache_handle());
+  LocalModel lmod1(param_values.data(), ModelName::relxill, 1, new_model_cache_handle());
+  lmod1.set_par(XPar::incl, 60.0);
+  REQUIRE(lmod0.get_cache_context() != lmod1.get_cache_context());
+
+  auto flux_ref0 = eval_model_flux(lmod0, spec);
+  auto flux_ref1 = eval_model_flux(lmod1, spec);
+
+  // evaluating the two components alternately re-uses their cached spectra
+  auto flux0 = eval_model_flux(lmod0, spec);
+  auto flux1 = eval_model_flux(lmod1, spec);
+  unsetenv("RELXILL_OUTPUT_CACHE_SIZE");
+
+  REQUIRE(lmod0.get_cache_context()->misses == 1);
+  REQUIRE(lmod0.get_cache_context()->hits == 1);
+  REQUIRE(lmod1.get_cache_context()->misses == 1);
+  REQUIRE(lmod1.get_cache_context()->hits == 1);
+  for (size_t ii = 0; ii < flux_ref0.size(); ii++) {
+    REQUIRE(flux0[ii] == flux_ref0[ii]);
+    REQUIRE(flux1[ii] == flux_ref1[ii]);
+  }
+
+}
+
+TEST_CASE(" Evaluate a model in several threads, each with its own context", "[model]") {
+  DefaultSpec default_spec{};
+  auto spec = default_spec.get_xspec_spectrum();
+
+  LocalModel lmod(ModelName::relxilllp);
+  auto flux_ref = eval_model_flux(lmod, spec);
+
+  const int num_threads = 4;
+  std::vector<std::vector<double>> flux_threads(num_threads);
+  std::vector<std::thread> threads;
+  for (int ithread = 0; ithread < num_threads; ithread++) {
+    threads.emplace_back([&flux_threads, ithread]() {
+      DefaultSpec thread_spec{};
+      auto xspec_spec = thread_spec.get_xspec_spectrum();
+      RelxillContext context;
+      LocalModel lmod_thread(ModelName::relxilllp);
+      lmod_thread.eval_model(xspec_spec, &context);
+      flux_threads[ithread].assign(xspec_spec.flux, xspec_spec.flux + xspec_spec.num_flux_bins());
+    });
+  }
+  for (auto &thread: threads) {
+    thread.join();
+  }
+
+  for (const auto &flux: flux_threads) {
+    for (size_t ii = 0; ii < flux_ref.size(); ii++) {
+      REQUIRE(flux[ii] == flux_ref[ii]);
+    }
+  }
+
+}
+
+TEST_CASE(" Zones of relxill calculated in parallel give the same spectrum", "[model]") {
+  DefaultSpec default_spec{};
+  auto spec = default_spec.get_xspec_spectrum();
+
+  setenv("RELXILL_OUTPUT_CACHE_SIZE", "0", 1);
+
+  // separate instances, such that the second evaluation does not re-use the spectra of the first
+  LocalModel lmod_serial(ModelName::relxilllpCp, 0);
+  LocalModel lmod_parallel(ModelName::relxilllpCp, 1);
+  lmod_serial.set_par(XPar::switch_iongrad_type, 2);
+  lmod_parallel.set_par(XPar::switch_iongrad_type, 2);
+
+  set_num_threads(1);
+  auto flux_serial = eval_model_flux(lmod_serial, spec);
+  set_num_threads(4);
+  auto flux_parallel = eval_model_flux(lmod_parallel, spec);
+  set_num_threads(0);
+  unsetenv("RELXILL_OUTPUT_CACHE_SIZE");
+
+  // the zones are transformed in the same chunks for any number of threads
+  for (size_t ii = 0; ii < flux_serial.size(); ii++) {
+    REQUIRE(flux_parallel[ii] == flux_serial[ii]);
+  }
+
+}
+
+TEST_CASE(" Evaluate a batch of parameter sets at once", "[model]") {
+  DefaultSpec default_spec{};
+  const int num_bins = static_cast<int>(default_spec.num_flux_bins);
+
+  // sets with the same relat. parameters and different xillver parameters, and vice versa
+  const int num_param_sets = 6;
+  std::vector<double> param_values;
+  for (int iset = 0; iset < num_param_sets; iset++) {
+    LocalModel lmod(ModelName::relxill);
+    lmod.set_par(XPar::incl, (iset % 2 == 0) ? 30.0 : 60.0);
+    lmod.set_par(XPar::logxi, 1.0 + 0.5 * (iset / 2));
+    auto param_set = lmod.get_model_params();
+    for (const auto &parname: param_set.get_parnames()) {
+      param_values.push_back(param_set[parname]);
+    }
+  }
+  const size_t num_params = param_values.size() / num_param_sets;
+
+  std::vector<double> flux_batch(num_param_sets * num_bins);
+  REQUIRE(xspec_C_wrapper_eval_model_batch(ModelName::relxill, param_values.data(), num_param_sets,
+                                           flux_batch.data(), num_bins, default_spec.energy, 2) == 0);
+
+  std::vector<double> flux_single(num_bins);
+  for (int iset = 0; iset < num_param_sets; iset++) {
+    xspec_C_wrapper_eval_model(ModelName::relxill, param_values.data() + iset * num_params, flux_single.data(),
+                               num_bins, default_spec.energy);
+    for (int ii = 0; ii < num_bins; ii++) {
+      REQUIRE(flux_batch[iset * num_bins + ii] == flux_single[ii]);
+    }
+  }
+
+  // the next batch is evaluated with the caches of the previous one
+  std::vector<double> flux_batch_next(num_param_sets * num_bins);
+  REQUIRE(xspec_C_wrapper_eval_model_batch(ModelName::relxill, param_values.data(), num_param_sets,
+                                           flux_batch_next.data(), num_bins, default_spec.energy, 2) == 0);
+  REQUIRE(flux_batch_next == flux_batch);
+
+}